@@ -0,0 +1,40 @@
+#version 450
+
+// Vertices already skinned by skinning.comp, in model space
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inUV;
+layout(location = 3) in vec4 inTan;
+
+
+layout(location = 0) out vec3 fragPos;
+layout(location = 1) out vec3 fragNorm;
+layout(location = 2) out vec2 fragUV;
+layout(location = 3) out vec4 fragTan;
+
+// matches depth-skinned.vert for the depth pre-pass
+invariant gl_Position;
+
+
+layout(set = 1, binding = 0) uniform ModelUniformBufferObject {
+    mat4  model;
+    uint jointOffset;
+} ubo;
+
+layout(set = 0, binding = 0) uniform LightUniformBufferObject{
+    mat4 view;
+    mat4 projection;
+    vec3 position;
+    vec3 eyePos;
+} cubo;
+
+
+void main() {
+
+    gl_Position = cubo.projection * cubo.view * ubo.model * vec4(inPosition, 1.0);
+    fragNorm = mat3(ubo.model) * inNormal;
+    fragPos = vec3(ubo.model * vec4(inPosition, 1.0));
+    fragUV = inUV;
+    fragTan = vec4(mat3(ubo.model) * inTan.xyz, inTan.w);
+
+}
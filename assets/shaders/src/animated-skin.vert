@@ -17,9 +17,14 @@ layout(location = 3) out vec4 fragTan;
 
 layout(set = 1, binding = 0) uniform ModelUniformBufferObject {
     mat4  model;
-    mat4 jointTransformMatrices[100];
+    uint jointOffset;
 } ubo;
 
+// top three rows of the joint matrices of every skin, see JointPalettes
+layout(std430, set = 2, binding = 0) readonly buffer JointPalettes {
+    mat3x4 joints[];
+} palettes;
+
 layout(set = 0, binding = 0) uniform LightUniformBufferObject{
     mat4 view;
     mat4 projection;
@@ -30,23 +35,27 @@ layout(set = 0, binding = 0) uniform LightUniformBufferObject{
 
 
 mat4 calcSkinMat() {
-    mat4 skinMat =
-    inJointWeights.x * ubo.jointTransformMatrices[int(inJointIndices.x)] +
-    inJointWeights.y * ubo.jointTransformMatrices[int(inJointIndices.y)] +
-    inJointWeights.z * ubo.jointTransformMatrices[int(inJointIndices.z)] +
-    inJointWeights.w * ubo.jointTransformMatrices[int(inJointIndices.w)];
-    return skinMat;
+    mat3x4 rows =
+    inJointWeights.x * palettes.joints[ubo.jointOffset + uint(inJointIndices.x)] +
+    inJointWeights.y * palettes.joints[ubo.jointOffset + uint(inJointIndices.y)] +
+    inJointWeights.z * palettes.joints[ubo.jointOffset + uint(inJointIndices.z)] +
+    inJointWeights.w * palettes.joints[ubo.jointOffset + uint(inJointIndices.w)];
+    return transpose(mat4(rows[0], rows[1], rows[2], vec4(0.0, 0.0, 0.0, 1.0)));
 }
 
 
 void main() {
 
     mat4 skinMat = calcSkinMat();
+    // skinned like skinning.comp does, so both paths light the skin the same
+    vec4 skinnedPos = skinMat * vec4(inPosition.xyz, 1.0);
+    vec3 skinnedNormal = normalize(mat3(skinMat) * inNormal);
+    vec3 skinnedTan = mat3(skinMat) * inTan.xyz;
     mat4 viewModel = cubo.view * ubo.model;
-    gl_Position = cubo.projection * viewModel * skinMat * vec4(inPosition.xyz, 1.0);
-    fragNorm = mat3(ubo.model ) *inNormal;
-    fragPos = vec3(ubo.model * vec4(inPosition, 1.0));
+    gl_Position = cubo.projection * viewModel * skinnedPos;
+    fragNorm = mat3(ubo.model) * skinnedNormal;
+    fragPos = vec3(ubo.model * skinnedPos);
     fragUV = inUV;
-    fragTan = vec4((mat4(1) * vec4(inTan.xyz, 0.0)).xyz, inTan.w);
+    fragTan = vec4(mat3(ubo.model) * skinnedTan, inTan.w);
 
 }
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 450
+
+// Depth pre-pass of the instanced systems, no fragment shader
+layout(location = 0) in vec3 inPosition;
+// per-instance model matrix, occupies locations 1..4
+layout(location = 1) in mat4 inModel;
+
+layout(set = 0, binding = 0) uniform CameraUniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec3 position;
+    vec3 eyePos;
+} cubo;
+
+// the main pass tests with EQUAL, so both passes must compute the same depth:
+// same expression as metallic.vert and stationary.vert
+invariant gl_Position;
+
+void main() {
+    vec4 worldPos = inModel * vec4(inPosition, 1.0);
+    gl_Position = cubo.proj * cubo.view * worldPos;
+}
@@ -0,0 +1,22 @@
+#version 450
+
+// Depth pre-pass of the skinned systems, reads only the position of the skinning.comp output
+layout(location = 0) in vec3 inPosition;
+
+layout(set = 1, binding = 0) uniform ModelUniformBufferObject {
+    mat4 model;
+} ubo;
+
+layout(set = 0, binding = 0) uniform CameraUniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec3 position;
+    vec3 eyePos;
+} cubo;
+
+// same expression as pepsiman-static.vert and animated-skin-static.vert
+invariant gl_Position;
+
+void main() {
+    gl_Position = cubo.proj * cubo.view * ubo.model * vec4(inPosition, 1.0);
+}
@@ -1,13 +1,17 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 FragPos;
 layout(location = 1) in vec3 Normal;
 layout(location = 2) in vec2 TexCoords;
 layout(location = 3) in mat3 TBN;
 
-layout(set = 1, binding = 1) uniform sampler2D baseColorMap;
-layout(set = 1, binding = 2) uniform sampler2D metalnessRoughnessMap;
-layout(set = 1, binding = 3) uniform sampler2D normalMap;
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+layout(push_constant) uniform Material {
+    uint baseColorMap;
+    uint metalnessRoughnessMap;
+    uint normalMap;
+} material;
 layout(set = 0, binding = 2) uniform AmbientUniformBufferObject{
     vec3 cxp;
     vec3 cxn;
@@ -86,12 +90,12 @@ vec3 reinhardToneMapping(vec3 hdrColor) {
 
 void main() {
     // Sample textures
-    vec3 albedo = texture(baseColorMap, TexCoords).rgb;
-    vec3 mR = texture(metalnessRoughnessMap, TexCoords).rgb;
+    vec3 albedo = texture(textures[material.baseColorMap], TexCoords).rgb;
+    vec3 mR = texture(textures[material.metalnessRoughnessMap], TexCoords).rgb;
     float roughness = clamp(mR.g, 0.05, 1.0);// Ensure roughness is not too low
     float metalness = clamp(mR.b, 0.05, 1.0);// Ensure metalness is within valid range
 
-    vec3 normal = texture(normalMap, TexCoords).rgb * 2.0 - 1.0;
+    vec3 normal = texture(textures[material.normalMap], TexCoords).rgb * 2.0 - 1.0;
     normal = normalize(TBN * normal);
 
     // View direction
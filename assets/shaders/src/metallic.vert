@@ -5,10 +5,8 @@ layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoords;
 layout(location = 3) in vec3 inColor;
 layout(location = 4) in vec3 aTangent;
-
-layout(set = 1, binding = 0) uniform ModelUniformBufferObject {
-    mat4  model;
-} mubo;
+// per-instance model matrix, occupies locations 5..8
+layout(location = 5) in mat4 inModel;
 
 layout(set = 0, binding = 0) uniform CameraUniformBufferObject {
     mat4 view;
@@ -22,13 +20,16 @@ layout(location = 1) out vec3 Normal;       // Normal in world space
 layout(location = 2) out vec2 TexCoords;    // Texture coordinates
 layout(location = 3) out mat3 TBN;          // Tangent, Bitangent, Normal matrix
 
+// matches depth-instanced.vert for the depth pre-pass
+invariant gl_Position;
+
 void main()
 {
-    vec4 worldPos =  mubo.model * vec4(aPos, 1.0);
+    vec4 worldPos =  inModel * vec4(aPos, 1.0);
     FragPos = worldPos.xyz;
 
-    vec3 normal = mat3(mubo.model) * aNormal;
-    vec3 tangent = normalize(mat3(mubo.model ) * aTangent);
+    vec3 normal = mat3(inModel) * aNormal;
+    vec3 tangent = normalize(mat3(inModel ) * aTangent);
     vec3 bitangent = cross(normal, tangent);
     TBN = mat3(tangent, bitangent, normal);
 
@@ -0,0 +1,40 @@
+#version 450
+
+// Vertices already skinned by skinning.comp, in model space
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inUV;
+layout(location = 3) in vec4 inTan;
+
+
+layout(set = 1, binding = 0) uniform ModelUniformBufferObject {
+    mat4  model;
+    uint jointOffset;
+} ubo;
+
+layout(set = 0, binding = 0) uniform CameraUniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec3 cameraPos;
+    vec3 eyePos;
+} cubo;
+
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec2 outUV;
+layout (location = 2) out vec4 fragTan;
+layout (location = 3) out vec3 fragPos;
+
+// matches depth-skinned.vert for the depth pre-pass
+invariant gl_Position;
+
+void main() {
+
+    gl_Position = cubo.proj * cubo.view * ubo.model * vec4(inPosition, 1.0);
+
+    outNormal = mat3(ubo.model) * inNormal;
+    fragTan = vec4(mat3(ubo.model) * inTan.xyz, inTan.w);
+    fragPos = vec3(ubo.model * vec4(inPosition, 1.0));
+    outUV = inUV;
+
+}
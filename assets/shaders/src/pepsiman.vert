@@ -12,9 +12,14 @@ layout(location = 6) in vec4 inTan;
 
 layout(set = 1, binding = 0) uniform ModelUniformBufferObject {
     mat4  model;
-    mat4 jointTransformMatrices[100];
+    uint jointOffset;
 } ubo;
 
+// top three rows of the joint matrices of every skin, see JointPalettes
+layout(std430, set = 2, binding = 0) readonly buffer JointPalettes {
+    mat3x4 joints[];
+} palettes;
+
 layout(set = 0, binding = 0) uniform CameraUniformBufferObject {
     mat4 view;
     mat4 proj;
@@ -29,25 +34,27 @@ layout (location = 2) out vec4 fragTan;
 layout (location = 3) out vec3 fragPos;
 
 mat4 calcSkinMat() {
-    mat4 skinMat =
-    inJointWeights.x * ubo.jointTransformMatrices[int(inJointIndices.x)] +
-    inJointWeights.y * ubo.jointTransformMatrices[int(inJointIndices.y)] +
-    inJointWeights.z * ubo.jointTransformMatrices[int(inJointIndices.z)] +
-    inJointWeights.w * ubo.jointTransformMatrices[int(inJointIndices.w)];
-    return skinMat;
+    mat3x4 rows =
+    inJointWeights.x * palettes.joints[ubo.jointOffset + uint(inJointIndices.x)] +
+    inJointWeights.y * palettes.joints[ubo.jointOffset + uint(inJointIndices.y)] +
+    inJointWeights.z * palettes.joints[ubo.jointOffset + uint(inJointIndices.z)] +
+    inJointWeights.w * palettes.joints[ubo.jointOffset + uint(inJointIndices.w)];
+    return transpose(mat4(rows[0], rows[1], rows[2], vec4(0.0, 0.0, 0.0, 1.0)));
 }
 
 void main() {
 
     mat4 skinMat = calcSkinMat();
+    // skinned like skinning.comp does, so both paths light the skin the same
+    vec4 skinnedPos = skinMat * vec4(inPosition.xyz, 1.0);
+    vec3 skinnedNormal = normalize(mat3(skinMat) * inNormal);
+    vec3 skinnedTan = mat3(skinMat) * inTan.xyz;
     mat4 viewModel = cubo.view * ubo.model;
-    gl_Position = cubo.proj * viewModel * skinMat * vec4(inPosition.xyz, 1.0);
-
-    outNormal = mat3(ubo.model ) *inNormal;
+    gl_Position = cubo.proj * viewModel * skinnedPos;
 
-//    normalize(transpose(inverse(mat3(viewModel * skinMat))) * inNormal);
-    fragTan = vec4((mat4(1) * vec4(inTan.xyz, 0.0)).xyz, inTan.w);
-    fragPos = vec3(ubo.model * vec4(inPosition, 1.0));
+    outNormal = mat3(ubo.model) * skinnedNormal;
+    fragTan = vec4(mat3(ubo.model) * skinnedTan, inTan.w);
+    fragPos = vec3(ubo.model * skinnedPos);
     outUV = inUV;
 
 }
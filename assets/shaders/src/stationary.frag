@@ -1,11 +1,15 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 fragPos;
 layout(location = 1) in vec3 fragNorm;
 layout(location = 2) in vec2 fragUV;
 
 
-layout(set = 1, binding = 1) uniform sampler2D baseTex;
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+layout(push_constant) uniform Material {
+    uint baseTexture;
+} material;
 layout(set = 0, binding = 1) uniform LightUniformBufferObject{
     vec3 position;
     vec3 direction;
@@ -53,7 +57,7 @@ void main(){
     vec3 lightDir =normalize(light.direction);
     vec3 EyeDir = normalize(camera.eyePos - fragPos);
     vec3 lightColor = light.color.rgb;
-    vec4 baseColor = texture(baseTex, fragUV);
+    vec4 baseColor = texture(textures[material.baseTexture], fragUV);
 
     vec3 Ambient = ((Norm.x > 0 ? ambient.cxp : ambient.cxn) * (Norm.x * Norm.x) +
     (Norm.y > 0 ? ambient.cyp : ambient.cyn) * (Norm.y * Norm.y) +
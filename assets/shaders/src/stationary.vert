@@ -4,6 +4,8 @@ layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNorm;
 layout(location = 2) in vec2 inUV;
 layout(location = 3) in vec4 inColor;
+// per-instance model matrix, occupies locations 4..7
+layout(location = 4) in mat4 inModel;
 
 
 
@@ -11,10 +13,9 @@ layout(location = 0) out vec3 fragPos;
 layout(location = 1) out vec3 fragNorm;
 layout(location = 2) out vec2 fragUV;
 
+// matches depth-instanced.vert for the depth pre-pass
+invariant gl_Position;
 
-layout(set = 1, binding = 0) uniform ModelUniformBufferObject {
-    mat4  model;
-} mubo;
 
 layout(set = 0, binding = 0) uniform CameraUniformBufferObject {
     mat4 view;
@@ -24,9 +25,9 @@ layout(set = 0, binding = 0) uniform CameraUniformBufferObject {
 } cubo;
 
 void main(){
-    mat4 mvp = cubo.proj * cubo.view * mubo.model;
-    gl_Position = mvp* vec4(inPosition, 1.0);
-    fragPos = vec3(mubo.model * vec4(inPosition, 1.0));
-    fragNorm = mat3(mubo.model) * inNorm;
+    vec4 worldPos = inModel * vec4(inPosition, 1.0);
+    gl_Position = cubo.proj * cubo.view * worldPos;
+    fragPos = vec3(worldPos);
+    fragNorm = mat3(inModel) * inNorm;
     fragUV = inUV;
 }
\ No newline at end of file
@@ -46,14 +46,6 @@ public:
         isCubeMap = true;
     }
 
-    PoolSizes getPoolSizes() {
-        PoolSizes poolSizes{};
-        poolSizes.setsInPool = 1;
-        poolSizes.uniformBlocksInPool = 1;
-        poolSizes.texturesInPool = 6;
-        return poolSizes;
-    }
-
     void setModel(std::string path, ModelType type) {
         modelPath = std::move(path);
         modelType = type;
@@ -75,6 +67,7 @@ public:
 
         M.init(bp, &VD, modelPath, modelType);
 
+        BaseTexture.skyBox = true;
         if(isCubeMap){
             BaseTexture.initCubic(BP, cubeMapPaths, VK_FORMAT_R8G8B8A8_UNORM);
         } else {
@@ -125,11 +118,12 @@ public:
         M.cleanup();
     }
 
-    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) {
-        P.bind(commandBuffer);
-        DS.bind(commandBuffer, P, (int) SET_ID, currentImage);
+    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, BindState &state) {
+        P.bind(commandBuffer, state);
+        DS.bind(commandBuffer, P, (int) SET_ID, currentImage, state);
 
-        M.bind(commandBuffer);
+        state.bindVertexBuffer(commandBuffer, 0, M.vertexBuffer);
+        state.bindIndexBuffer(commandBuffer, M.indexBuffer);
 
         vkCmdDrawIndexed(commandBuffer,
                          static_cast<uint32_t>(M.indices.size()), 1, 0, 0, 0);
@@ -1,23 +1,105 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <cstddef>
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include "animated-model/joint.hpp"
 
+enum AnimationInterpolation {
+    INTERPOLATION_LINEAR,
+    INTERPOLATION_STEP,
+    INTERPOLATION_CUBICSPLINE
+};
+
+enum AnimationPath {
+    PATH_TRANSLATION,
+    PATH_ROTATION,
+    PATH_SCALE
+};
+
 struct AnimationSampler
 {
-    std::string            interpolation;
+    AnimationInterpolation interpolation = INTERPOLATION_LINEAR;
     std::vector<float>     inputs;
+    // CUBICSPLINE stores three outputs per keyframe: in-tangent, value, out-tangent
     std::vector<glm::vec4> outputsVec4;
 };
 
 struct AnimationChannel
 {
-    std::string path;
+    AnimationPath path;
     Joint *      joint;
     uint32_t    samplerIndex;
+    // keyframe interval sampled last, see findKeyframe
+    uint32_t    keyframe = 0;
 };
 
+// Intervals the cursor walks forward before falling back to a binary search
+const uint32_t MAX_KEYFRAME_STEPS = 4;
+
+// Index i of the keyframe interval [inputs[i], inputs[i + 1]] holding time, -1 when time is out of
+// the keyframes' range. Starts at the interval of the previous call: while time moves forward a
+// little this takes a step or two, a seek or a wrap-around falls back to a binary search.
+inline int findKeyframe(const std::vector<float> &inputs, float time, uint32_t &cursor) {
+    if (inputs.size() < 2 || time < inputs.front() || time > inputs.back()) {
+        return -1;
+    }
+    uint32_t last = static_cast<uint32_t>(inputs.size()) - 2;
+    uint32_t i = std::min(cursor, last);
+    if (time >= inputs[i]) {
+        for (uint32_t steps = 0; steps < MAX_KEYFRAME_STEPS && i < last && time > inputs[i + 1]; steps++) {
+            i++;
+        }
+        if (time <= inputs[i + 1]) {
+            cursor = i;
+            return static_cast<int>(i);
+        }
+    }
+    auto next = std::upper_bound(inputs.begin(), inputs.end(), time);
+    i = std::min(static_cast<uint32_t>(std::max<std::ptrdiff_t>(next - inputs.begin() - 1, 0)), last);
+    cursor = i;
+    return static_cast<int>(i);
+}
+
+// Hermite spline between keyframes i and i + 1 of a CUBICSPLINE sampler, glTF tangents are
+// scaled by the interval's length
+inline glm::vec4 sampleCubicSpline(const AnimationSampler &sampler, int i, float a, float span) {
+    const glm::vec4 *outputs = &sampler.outputsVec4[3 * i];
+    float a2 = a * a;
+    float a3 = a2 * a;
+    return (2.0f * a3 - 3.0f * a2 + 1.0f) * outputs[1] +
+           (a3 - 2.0f * a2 + a) * span * outputs[2] +
+           (-2.0f * a3 + 3.0f * a2) * outputs[4] +
+           (a3 - a2) * span * outputs[3];
+}
+
+// Translation or scale at a of the way through keyframe interval i, span long
+inline glm::vec3 sampleVec3(const AnimationSampler &sampler, int i, float a, float span) {
+    switch (sampler.interpolation) {
+        case INTERPOLATION_STEP:
+            return glm::vec3(sampler.outputsVec4[i]);
+        case INTERPOLATION_CUBICSPLINE:
+            return glm::vec3(sampleCubicSpline(sampler, i, a, span));
+        default:
+            return glm::vec3(glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], a));
+    }
+}
+
+// Outputs hold quaternions as x, y, z, w
+inline glm::quat sampleRotation(const AnimationSampler &sampler, int i, float a, float span) {
+    auto toQuat = [](const glm::vec4 &v) { return glm::quat(v.w, v.x, v.y, v.z); };
+    switch (sampler.interpolation) {
+        case INTERPOLATION_STEP:
+            return toQuat(sampler.outputsVec4[i]);
+        case INTERPOLATION_CUBICSPLINE:
+            return glm::normalize(toQuat(sampleCubicSpline(sampler, i, a, span)));
+        default:
+            return glm::normalize(glm::slerp(toQuat(sampler.outputsVec4[i]), toQuat(sampler.outputsVec4[i + 1]), a));
+    }
+}
+
 struct Animation
 {
     std::string                   name;
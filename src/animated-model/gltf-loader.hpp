@@ -225,7 +225,13 @@ public:
             for (size_t j = 0; j < glTFAnimation.samplers.size(); j++) {
                 tinygltf::AnimationSampler glTFSampler = glTFAnimation.samplers[j];
                 AnimationSampler &dstSampler = animations[i].samplers[j];
-                dstSampler.interpolation = glTFSampler.interpolation;
+                if (glTFSampler.interpolation == "STEP") {
+                    dstSampler.interpolation = INTERPOLATION_STEP;
+                } else if (glTFSampler.interpolation == "CUBICSPLINE") {
+                    dstSampler.interpolation = INTERPOLATION_CUBICSPLINE;
+                } else {
+                    dstSampler.interpolation = INTERPOLATION_LINEAR;
+                }
 
                 // Read sampler keyframe input time values
                 {
@@ -286,13 +292,39 @@ public:
 
 
             // Channels
-            animations[i].channels.resize(glTFAnimation.channels.size());
+            animations[i].channels.reserve(glTFAnimation.channels.size());
             for (size_t j = 0; j < glTFAnimation.channels.size(); j++) {
                 tinygltf::AnimationChannel glTFChannel = glTFAnimation.channels[j];
-                AnimationChannel &dstChannel = animations[i].channels[j];
-                dstChannel.path = glTFChannel.target_path;
+                AnimationChannel dstChannel;
+                if (glTFChannel.target_path == "translation") {
+                    dstChannel.path = PATH_TRANSLATION;
+                } else if (glTFChannel.target_path == "rotation") {
+                    dstChannel.path = PATH_ROTATION;
+                } else if (glTFChannel.target_path == "scale") {
+                    dstChannel.path = PATH_SCALE;
+                } else {
+                    std::cout << "Animation " << glTFAnimation.name << ": skipping unsupported channel path "
+                              << glTFChannel.target_path << std::endl;
+                    continue;
+                }
+                auto joint = jointMap.find(glTFChannel.target_node);
+                if (joint == jointMap.end() || glTFChannel.sampler < 0 ||
+                    glTFChannel.sampler >= static_cast<int>(animations[i].samplers.size())) {
+                    std::cout << "Animation " << glTFAnimation.name << ": skipping channel of node "
+                              << glTFChannel.target_node << " without a joint or sampler" << std::endl;
+                    continue;
+                }
+                const AnimationSampler &sampler = animations[i].samplers[glTFChannel.sampler];
+                size_t outputsPerKeyframe = sampler.interpolation == INTERPOLATION_CUBICSPLINE ? 3 : 1;
+                if (sampler.outputsVec4.size() < sampler.inputs.size() * outputsPerKeyframe) {
+                    std::cout << "Animation " << glTFAnimation.name << ": skipping channel with "
+                              << sampler.outputsVec4.size() << " outputs for " << sampler.inputs.size()
+                              << " keyframes" << std::endl;
+                    continue;
+                }
                 dstChannel.samplerIndex = glTFChannel.sampler;
-                dstChannel.joint = jointMap[glTFChannel.target_node];
+                dstChannel.joint = joint->second;
+                animations[i].channels.push_back(dstChannel);
             }
         }
 
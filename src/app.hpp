@@ -1,7 +1,6 @@
 // This has been adapted from the Vulkan tutorial
 #pragma once
 
-#include <thread>
 #include "modules/Starter.hpp"
 #include "animated-model/gltf-loader.hpp"
 #include "helper-structs.hpp"
@@ -11,6 +10,10 @@
 #include "scene/scene-base.hpp"
 #include "scene/city-scene.hpp"
 #include "scene/road-scene.hpp"
+#include "headers/json.hpp"
+#include "benchmark.hpp"
+#include <fstream>
+#include <map>
 
 class App : public BaseProject {
 protected:
@@ -40,6 +43,10 @@ protected:
         initialBackgroundColor = {0.01f, 0.01f, 0.01f, 1.0f};
 
         Ar = (float) windowWidth / (float) windowHeight;
+        loadSettings(SETTINGS_FILE);
+        if (headless) {
+            loadBenchmark();
+        }
 
     }
 
@@ -51,72 +58,529 @@ protected:
     }
 
     void localInit() {
-
+        auto start = std::chrono::steady_clock::now();
+        // every texture and mesh upload of the scenes goes into one submission
+        beginUploads();
         for (auto [K, s]: scenes) {
             s->load(this, Ar);
-            PoolSizes p = s->getPoolSizes();
-            DPSZs.uniformBlocksInPool += p.uniformBlocksInPool;
-            DPSZs.texturesInPool += p.texturesInPool;
-            DPSZs.setsInPool += p.setsInPool;
+            s->setTickRate(tickRate);
+            s->maxTicksPerStep = maxTicksPerStep;
+            if (benchmark.depthPrePass) {
+                s->depthPrePass = *benchmark.depthPrePass;
+            }
             s->init();
         }
+        flushUploads();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Scenes loaded in " << ms << " ms, " << objectCache.size() << " cached Vulkan objects\n";
     }
 
-    bool debounce = false;
-    int curDebounce = -1;
     int curScene = GLFW_KEY_1;
 
+    const std::string SETTINGS_FILE = "assets/settings.json";
+    // cycled with F1, custom only when the settings file defines it
+    std::vector<QualitySettings> qualityPresets = {QualitySettings::low(), QualitySettings::medium(),
+                                                   QualitySettings::high()};
+
+    // cycled with V
+    std::vector<std::pair<std::string, VkPresentModeKHR>> presentModes = {
+            {"fifo",         VK_PRESENT_MODE_FIFO_KHR},
+            {"fifo_relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR},
+            {"mailbox",      VK_PRESENT_MODE_MAILBOX_KHR},
+            {"immediate",    VK_PRESENT_MODE_IMMEDIATE_KHR},
+    };
+    // toggled with F2 together with the GPU profiler: the most expensive profiler scopes in the
+    // title, all of them on stdout
+    bool profilerOverlay = false;
+    const size_t PROFILER_TITLE_SCOPES = 3;
+    // simulation ticks per second and per frame, see SceneBase::step
+    float tickRate = 60.0f;
+    int maxTicksPerStep = 8;
+
+    std::string getPresentModeName(VkPresentModeKHR mode) {
+        for (const auto &[name, m]: presentModes) {
+            if (m == mode) {
+                return name;
+            }
+        }
+        return "unknown";
+    }
+
+    // Renders the benchmark script headless instead of opening the window, call before run
+    void setBenchmark(const std::string &path) {
+        benchmarkPath = path;
+        headless = true;
+    }
+
+    void loadSettings(const std::string &path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cout << "No settings at " << path << ", using " << quality.name << " quality" << std::endl;
+            return;
+        }
+        nlohmann::json json = nlohmann::json::parse(file);
+        if (json.contains("display")) {
+            loadDisplaySettings(json["display"]);
+        }
+        if (json.contains("simulation")) {
+            loadSimulationSettings(json["simulation"]);
+        }
+        loadQualitySettings(json);
+    }
+
+    // {"presentMode": "fifo" | "fifo_relaxed" | "mailbox" | "immediate", "frameRateLimit": 0 (unlimited),
+    //  "lowLatency": false}
+    void loadDisplaySettings(const nlohmann::json &json) {
+        framePacing.frameRateLimit = json.value("frameRateLimit", framePacing.frameRateLimit);
+        lowLatencyMode = json.value("lowLatency", lowLatencyMode);
+        std::string modeName = json.value("presentMode", getPresentModeName(preferredPresentMode));
+        for (const auto &[name, mode]: presentModes) {
+            if (name == modeName) {
+                preferredPresentMode = mode;
+                return;
+            }
+        }
+        throw std::runtime_error("Unknown present mode '" + modeName + "'");
+    }
+
+    // {"tickRate": 60, "maxTicksPerFrame": 8}
+    void loadSimulationSettings(const nlohmann::json &json) {
+        tickRate = json.value("tickRate", tickRate);
+        maxTicksPerStep = json.value("maxTicksPerFrame", maxTicksPerStep);
+        if (tickRate <= 0.0f || maxTicksPerStep < 1) {
+            throw std::runtime_error("Invalid simulation settings");
+        }
+    }
+
+    // {"preset": "low" | "medium" | "high" | "custom", "custom": {...}}, missing fields keep the high values
+    void loadQualitySettings(const nlohmann::json &json) {
+        if (json.contains("custom")) {
+            nlohmann::json c = json["custom"];
+            QualitySettings custom = QualitySettings::high();
+            custom.name = "custom";
+            int msaaSamples = c.value("msaaSamples", (int) custom.msaaSamples);
+            // one of VK_SAMPLE_COUNT_1_BIT to VK_SAMPLE_COUNT_64_BIT
+            if (msaaSamples < 1 || msaaSamples > 64 || (msaaSamples & (msaaSamples - 1)) != 0) {
+                throw std::runtime_error("Invalid msaaSamples " + std::to_string(msaaSamples) +
+                                         ", must be a power of two up to 64");
+            }
+            custom.msaaSamples = static_cast<VkSampleCountFlagBits>(msaaSamples);
+            custom.sampleShading = c.value("sampleShading", custom.sampleShading);
+            custom.maxAnisotropy = c.value("maxAnisotropy", custom.maxAnisotropy);
+            custom.mipLodBias = c.value("mipLodBias", custom.mipLodBias);
+            custom.maxTextureSize = c.value("maxTextureSize", custom.maxTextureSize);
+            custom.maxSkyBoxSize = c.value("maxSkyBoxSize", custom.maxSkyBoxSize);
+            custom.textureBudget = c.value("textureBudget", custom.textureBudget);
+            qualityPresets.push_back(custom);
+        }
+
+        selectQualityPreset(json.value("preset", quality.name));
+    }
+
+    void selectQualityPreset(const std::string &presetName) {
+        for (const auto &preset: qualityPresets) {
+            if (preset.name == presetName) {
+                quality = preset;
+                return;
+            }
+        }
+        throw std::runtime_error("Unknown quality preset '" + presetName + "'");
+    }
+
+    void cycleQuality() {
+        size_t next = 0;
+        for (size_t i = 0; i < qualityPresets.size(); i++) {
+            if (qualityPresets[i].name == quality.name) {
+                next = (i + 1) % qualityPresets.size();
+            }
+        }
+        reportQualityCost(quality.name);
+        setQuality(qualityPresets[next]);
+    }
+
+    // Unsupported modes fall back to FIFO, see chooseSwapPresentMode
+    void cyclePresentMode() {
+        size_t next = 0;
+        for (size_t i = 0; i < presentModes.size(); i++) {
+            if (presentModes[i].second == preferredPresentMode) {
+                next = (i + 1) % presentModes.size();
+            }
+        }
+        std::cout << "Present mode: " << presentModes[next].first << std::endl;
+        setPresentMode(presentModes[next].second);
+    }
+
+    // Average cost of the frames rendered with each preset in this run
+    struct QualityCost {
+        uint32_t frames = 0;
+        double wallTime = 0.0;
+        double gpuTime = 0.0;
+        double scale = 0.0;
+    };
+    std::map<std::string, QualityCost> qualityCosts;
+    // frames ignored after a switch, while pipelines and caches warm up
+    const uint32_t QUALITY_WARMUP_FRAMES = 30;
+    uint32_t qualityWarmup = 30;
+    std::string measuredQuality;
+
+    void measureQualityCost() {
+        if (measuredQuality != quality.name) {
+            measuredQuality = quality.name;
+            qualityWarmup = QUALITY_WARMUP_FRAMES;
+        }
+        if (qualityWarmup > 0) {
+            qualityWarmup--;
+            return;
+        }
+        QualityCost &cost = qualityCosts[quality.name];
+        cost.frames++;
+        cost.wallTime += frameTime;
+        cost.gpuTime += gpuFrameTime;
+        cost.scale += dynamicResolution.scale;
+    }
+
+    void reportQualityCost(const std::string &name) {
+        auto it = qualityCosts.find(name);
+        if (it == qualityCosts.end() || it->second.frames == 0) {
+            return;
+        }
+        const QualityCost &cost = it->second;
+        std::cout << "Quality " << name << ": " << cost.frames << " frames, frame "
+                  << cost.wallTime / cost.frames * 1000.0 << " ms, gpu " << cost.gpuTime / cost.frames * 1000.0
+                  << " ms, resolution scale " << cost.scale / cost.frames << std::endl;
+    }
+
+    // Average cost of each scene's frames with and without the depth pre-pass in this run, to see
+    // whether the saved fragment shading outweighs the extra geometry pass
+    struct PrePassCost {
+        uint32_t frames = 0;
+        double gpuTime = 0.0;
+        double overdraw = 0.0;
+    };
+    // "<scene> on" / "<scene> off"
+    std::map<std::string, PrePassCost> prePassCosts;
+    uint32_t prePassWarmup = 30;
+    std::string measuredPrePass;
+
+    std::string getPrePassName(SceneBase *scene) {
+        return scene->id + (scene->depthPrePass ? " on" : " off");
+    }
+
+    void measurePrePassCost(SceneBase *scene) {
+        std::string name = getPrePassName(scene);
+        if (measuredPrePass != name) {
+            measuredPrePass = name;
+            prePassWarmup = QUALITY_WARMUP_FRAMES;
+        }
+        if (prePassWarmup > 0) {
+            prePassWarmup--;
+            return;
+        }
+        PrePassCost &cost = prePassCosts[name];
+        cost.frames++;
+        cost.gpuTime += gpuFrameTime;
+        cost.overdraw += overdrawStats.lastOverdraw;
+    }
+
+    void reportPrePassCost(const std::string &name) {
+        auto it = prePassCosts.find(name);
+        if (it == prePassCosts.end() || it->second.frames == 0) {
+            return;
+        }
+        const PrePassCost &cost = it->second;
+        std::cout << "Depth pre-pass " << name << ": " << cost.frames << " frames, gpu "
+                  << cost.gpuTime / cost.frames * 1000.0 << " ms, overdraw " << cost.overdraw / cost.frames
+                  << std::endl;
+    }
+
+    void toggleDepthPrePass(SceneBase *scene) {
+        reportPrePassCost(getPrePassName(scene));
+        scene->setDepthPrePass(!scene->depthPrePass);
+        reportPrePassCost(getPrePassName(scene));
+    }
+
+    // Steps of the current scene run on the simulation thread one frame ahead: each frame draws
+    // the step that ran during the previous one, while the next step runs. In low latency mode
+    // the step runs before the frame that draws it instead, so its input is not a frame old.
+    SimulationThread simulation;
+    // scene of the last submitted step
+    SceneBase *simulatedScene = nullptr;
+
     void updateUniformBuffer(uint32_t currentImage) override {
 
 
-        float deltaT;
-        glm::vec3 m = glm::vec3(0.0f), r = glm::vec3(0.0f);
-        bool fire = false;
-        getSixAxis(deltaT, m, r, fire);
+        float deltaT = sampleInput();
+        // axes and keys are filled in by the step, from the events queued until it runs
+        UserInput userInput{};
+        userInput.deltaTime = deltaT;
+        userInput.aspectRatio = Ar;
+        userInput.frameTime = frameTime;
+        userInput.sampleTime = inputSampleTime;
+
+        // the scene can only change between two steps
+        simulation.wait();
+        if (headless) {
+            applyBenchmarkScene();
+        } else {
+            processKeys();
+        }
+        measureQualityCost();
+
+        auto currentScene = scenes[curScene];
+        if (currentScene != simulatedScene) {
+            // its last snapshot may be from long ago, bring it up to date without advancing time
+            UserInput still = userInput;
+            still.frameTime = 0.0f;
+            stepScene(currentScene, still, benchmarkFrame);
+            simulatedScene = currentScene;
+        }
+        if (lowLatencyMode) {
+            stepScene(currentScene, userInput, benchmarkFrame);
+            currentScene->acquireSnapshot();
+        } else {
+            currentScene->acquireSnapshot();
+            uint32_t nextFrame = benchmarkFrame + 1;
+            simulation.submit([this, currentScene, userInput, nextFrame]() {
+                stepScene(currentScene, userInput, nextFrame);
+            });
+        }
+        drawnInputTime = currentScene->getSnapshotInputTime();
 
-        UserInput userInput = {m, r, curDebounce, deltaT, Ar};
+        measurePrePassCost(currentScene);
+        currentScene->render(currentImage);
+        if (!headless) {
+            showStats(currentScene, deltaT);
+        }
+    }
 
+    // Keys of the last drained input that control the app rather than the scene
+    void processKeys() {
         for (auto [K, s]: scenes) {
-            if (K == curDebounce && curScene != K && debounce) {
-                curScene = curDebounce;
+            if (input.wasPressed(K) && curScene != K) {
+                curScene = K;
                 std::cout << "Switching to scene: " << curScene << std::endl;
-                RebuildPipeline();
-                delay(100);
-                curDebounce = -1;
-                debounce = false;
-                return;
+                // Pipelines and descriptor sets of every scene are already alive,
+                // only the recorded draw list has to change.
+                invalidateCommandBuffers();
+                break;
             }
         }
-        auto currentScene = scenes[curScene];
-        currentScene->updateUniformBuffer(currentImage, userInput);
+        if (input.wasPressed(GLFW_KEY_F1)) {
+            cycleQuality();
+        }
+        if (input.wasPressed(GLFW_KEY_V)) {
+            cyclePresentMode();
+        }
+        if (input.wasPressed(GLFW_KEY_L)) {
+            std::cout << "Latency with low latency mode " << (lowLatencyMode ? "on" : "off") << ": input to submit "
+                      << latency.inputToSubmit * 1000.0 << " ms, input to GPU complete "
+                      << latency.inputToGpuComplete * 1000.0 << " ms" << std::endl;
+            setLowLatencyMode(!lowLatencyMode);
+        }
+        if (input.wasPressed(GLFW_KEY_F2)) {
+            profilerOverlay = !profilerOverlay;
+            setGpuProfiling(profilerOverlay);
+        }
+        if (input.wasPressed(GLFW_KEY_Z)) {
+            toggleDepthPrePass(scenes[curScene]);
+        }
+    }
 
-        checkKey();
+    std::string benchmarkPath;
+    BenchmarkScript benchmark;
+    BenchmarkResults benchmarkResults;
+    uint32_t benchmarkFrame = 0;
+    // the frame after a screenshot starts with an idle GPU, it is not measured
+    bool benchmarkSkipFrame = false;
+
+    void loadBenchmark() {
+        benchmark = BenchmarkScript::load(benchmarkPath);
+        windowWidth = benchmark.width;
+        windowHeight = benchmark.height;
+        Ar = (float) windowWidth / (float) windowHeight;
+        preferredDevice = benchmark.device;
+        if (!benchmark.quality.empty()) {
+            selectQualityPreset(benchmark.quality);
+        }
+        dynamicResolution.enabled = benchmark.dynamicResolution;
+        fixedFrameTime = benchmark.timeStep;
+        simulationOnly = benchmark.simulationOnly;
+        // for the gpuScopes of the report
+        gpuProfiler.enabled = true;
+        framePacing.frameRateLimit = 0.0f;
+        lowLatencyMode = false;
+        std::cout << "Benchmark " << benchmarkPath << ": " << benchmark.frames << " frames at " << windowWidth
+                  << "x" << windowHeight << ", " << quality.name << " quality" << std::endl;
     }
 
+    // Scene of the current benchmark frame
+    void applyBenchmarkScene() {
+        std::string sceneId = benchmark.getScene(benchmarkFrame);
+        for (auto [K, s]: scenes) {
+            if (s->id == sceneId && K != curScene) {
+                curScene = K;
+                invalidateCommandBuffers();
+            }
+        }
+    }
 
-    void checkKey() {
-        for (int i = 32; i <= 348; i++) {
-            if (glfwGetKey(window, i)) {
-                if (!debounce) {
-                    debounce = true;
-                    curDebounce = i;
-                }
-            } else {
-                if ((curDebounce == i) && debounce) {
-                    debounce = false;
-                    curDebounce = -1;
-                }
+    // Camera of the benchmark frame that draws the step, called by the step itself
+    void applyBenchmarkCamera(SceneBase *scene, uint32_t frame) {
+        BenchmarkScript::CameraKey key;
+        if (benchmark.getCamera(frame, key)) {
+            Camera *camera = scene->camera;
+            camera->setEuler(glm::radians(key.yaw), glm::radians(key.pitch), camera->CamRoll);
+            if (key.distance > 0.0f) {
+                camera->CamDistance = key.distance;
             }
+        }
+    }
+
+    // key edges and cursor movement of steps that ran no tick, handed to the next step
+    InputState unconsumedInput;
+
+    // Runs a step with the input queued since the previous one. frame: the frame that draws the step
+    void stepScene(SceneBase *scene, UserInput userInput, uint32_t frame) {
+        drainInput();
+        InputState keys = input;
+        keys.carryEdges(unconsumedInput);
+        bool fire = false;
+        getSixAxis(keys, userInput.axis, userInput.rotation, fire);
+        userInput.keys = keys;
+        if (headless) {
+            applyBenchmarkCamera(scene, frame);
+        }
+        unconsumedInput = keys;
+        if (scene->step(userInput) > 0) {
+            unconsumedInput.clearEdges();
+        }
+    }
 
+    // The steps run on this thread, there is no rendering to overlap them with
+    void simulateFrame() override {
+        applyBenchmarkScene();
+        UserInput userInput{};
+        userInput.deltaTime = frameTime;
+        userInput.aspectRatio = Ar;
+        userInput.frameTime = frameTime;
+        stepScene(scenes[curScene], userInput, benchmarkFrame);
+    }
+
+    void onFrameEnd() override {
+        if (!headless) {
+            return;
+        }
+        // the GPU time read back this frame belongs to an earlier frame of the same image
+        if (benchmarkFrame >= benchmark.warmupFrames && !benchmarkSkipFrame) {
+            benchmarkResults.add(scenes[curScene]->id, frameWallTime, gpuFrameTime, overdrawStats.lastOverdraw);
+        }
+        benchmarkSkipFrame = false;
+        if (benchmark.screenshots.count(benchmarkFrame) > 0 && !simulationOnly) {
+            vkDeviceWaitIdle(device);
+            std::string file = benchmark.screenshotPrefix + std::to_string(benchmarkFrame) + ".png";
+            saveScreenshot(file.c_str(), lastImageIndex);
+            benchmarkSkipFrame = true;
+        }
+        if (++benchmarkFrame == benchmark.frames) {
+            writeBenchmarkReport();
+            running = false;
         }
     }
 
-    static void delay(int milliseconds) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+    void writeBenchmarkReport() {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+        nlohmann::json report = benchmarkResults.toJson();
+        report["script"] = benchmarkPath;
+        report["device"] = properties.deviceName;
+        report["width"] = windowWidth;
+        report["height"] = windowHeight;
+        report["quality"] = quality.name;
+        report["frames"] = benchmark.frames;
+        report["warmupFrames"] = benchmark.warmupFrames;
+        report["simulationOnly"] = simulationOnly;
+        report["tickRate"] = tickRate;
+        for (auto [K, s]: scenes) {
+            report["depthPrePass"][s->id] = s->depthPrePass;
+        }
+        report["gpuScopesDropped"] = gpuProfiler.droppedScopes;
+        report["gpuScopes"] = nlohmann::json::array();
+        for (const auto &result: gpuProfiler.results) {
+            report["gpuScopes"].push_back({{"name", result.name}, {"mean", result.average * 1000.0},
+                                           {"max", result.max * 1000.0}});
+        }
+
+        std::ofstream file(benchmark.output);
+        if (!file.is_open()) {
+            throw std::runtime_error("Benchmark: cannot write " + benchmark.output);
+        }
+        file << report.dump(2) << std::endl;
+        std::cout << "Benchmark report written to " << benchmark.output << std::endl;
+    }
+
+
+    float statsTimer = 0.0f;
+
+    // Per frame statistics of the current scene, shown in the window title once per second
+    void showStats(SceneBase *scene, float deltaT) {
+        statsTimer += deltaT;
+        if (statsTimer < 1.0f) {
+            return;
+        }
+        statsTimer = 0.0f;
+        CullingStats stats = scene->cullingStats;
+        std::string title = windowTitle + " | culling: " + std::to_string(stats.visible) + "/" +
+                            std::to_string(stats.total) + " visible, " + std::to_string(stats.occluded) + " occluded, " +
+                            std::to_string(stats.tested) + " tested" +
+                            " | quality: " + quality.name +
+                            " | resolution: " + std::to_string((int) std::round(dynamicResolution.scale * 100.0f)) +
+                            "%, gpu " + std::to_string(gpuFrameTime * 1000.0f) + " ms" +
+                            " | " + getPresentModeName(presentMode) + ": " +
+                            std::to_string(framePacing.meanInterval * 1000.0) + " +- " +
+                            std::to_string(framePacing.intervalStdDev * 1000.0) + " ms, " +
+                            std::to_string(framePacing.windowMissed) + " missed" +
+                            " | latency" + (lowLatencyMode ? " (low)" : "") + ": submit " +
+                            std::to_string(latency.inputToSubmit * 1000.0) + " ms, GPU complete " +
+                            std::to_string(latency.inputToGpuComplete * 1000.0) + " ms";
+        if (statisticsQueryPool != VK_NULL_HANDLE) {
+            title += " | overdraw" + std::string(scene->depthPrePass ? " (pre-pass): " : ": ") +
+                     std::to_string(overdrawStats.overdraw);
+        }
+        if (profilerOverlay) {
+            title += " | " + showProfilerResults();
+        }
+        glfwSetWindowTitle(window, title.c_str());
+    }
+
+    // Prints every scope of the last profiler window, returns the most expensive ones for the title
+    std::string showProfilerResults() {
+        std::vector<GpuProfiler::Result> results = gpuProfiler.results;
+        if (results.empty()) {
+            return "gpu profiler: no timestamps";
+        }
+        std::cout << "GPU profiler, average (max) over " << gpuProfiler.windowFrames << " frames, "
+                  << gpuProfiler.droppedScopes << " scopes dropped so far:\n";
+        for (const auto &result: results) {
+            std::cout << "  " << result.name << ": " << result.average * 1000.0 << " ms ("
+                      << result.max * 1000.0 << " ms)\n";
+        }
+        std::cout << std::flush;
+
+        std::sort(results.begin(), results.end(), [](const auto &a, const auto &b) {
+            return a.average > b.average;
+        });
+        std::string top;
+        for (size_t i = 0; i < std::min(PROFILER_TITLE_SCOPES, results.size()); i++) {
+            top += (i > 0 ? ", " : "") + results[i].name + " " + std::to_string(results[i].average * 1000.0) + " ms";
+        }
+        return top;
     }
 
     void pipelinesAndDescriptorSetsInit() override {
         for (auto [K, s]: scenes) {
+            // the samplers may have been recreated for new quality settings
+            s->textureTable.refresh();
+            s->resizeSkinning();
             s->pipelinesAndDescriptorSetsInit();
         }
     }
@@ -129,12 +593,23 @@ protected:
 
 
     void localCleanup() override {
+        simulation.wait();
+        for (const auto &[name, cost]: qualityCosts) {
+            reportQualityCost(name);
+        }
+        for (const auto &[name, cost]: prePassCosts) {
+            reportPrePassCost(name);
+        }
         for (auto [K, s]: scenes) {
             s->localCleanup();
         }
     }
 
 
+    void populateComputeCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) override {
+        scenes[curScene]->populateComputeCommandBuffer(commandBuffer, currentImage);
+    }
+
     void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) override {
         scenes[curScene]->populateCommandBuffer(commandBuffer, currentImage);
     }
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+#include "headers/json.hpp"
+
+/**
+ * Scripted headless run, loaded from a JSON file:
+ *
+ * {
+ *   "frames": 600, "warmupFrames": 60, "width": 1280, "height": 720, "timeStep": 0.016667,
+ *   "device": "llvmpipe", "quality": "medium", "dynamicResolution": false, "depthPrePass": true,
+ *   "simulationOnly": false,
+ *   "scenes": [{"frame": 0, "scene": "road-scene"}, {"frame": 300, "scene": "city-scene"}],
+ *   "camera": [{"frame": 0, "yaw": 180, "pitch": 20, "distance": 10}, {"frame": 300, "yaw": 360, "pitch": 30}],
+ *   "screenshots": [100, 400], "screenshotPrefix": "benchmark-frame-", "output": "benchmark-report.json"
+ * }
+ *
+ * The camera keys set the orbit angles of the scene camera in degrees, yaw in [0, 360] and
+ * pitch in [0, 180], and optionally its distance, linearly interpolated between keys.
+ * depthPrePass overrides the setting of every scene file. Frames before warmupFrames are not measured.
+ * simulationOnly steps the scenes without rendering anything, the cpu times are then the cost of
+ * the simulation alone and screenshots are skipped.
+ */
+struct BenchmarkScript {
+    struct SceneKey {
+        uint32_t frame;
+        std::string scene;
+    };
+
+    struct CameraKey {
+        uint32_t frame;
+        float yaw;
+        float pitch;
+        // <= 0: the scene's own distance
+        float distance;
+    };
+
+    uint32_t frames = 600;
+    uint32_t warmupFrames = 60;
+    uint32_t width = 1280;
+    uint32_t height = 720;
+    // animations advance by this much per frame, so every run renders the same images
+    float timeStep = 1.0f / 60.0f;
+    std::string device;
+    std::string quality;
+    bool dynamicResolution = false;
+    std::optional<bool> depthPrePass;
+    bool simulationOnly = false;
+    std::vector<SceneKey> scenes;
+    std::vector<CameraKey> camera;
+    std::set<uint32_t> screenshots;
+    std::string screenshotPrefix = "benchmark-frame-";
+    std::string output = "benchmark-report.json";
+
+    static BenchmarkScript load(const std::string &path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Benchmark: cannot open " + path);
+        }
+        nlohmann::json json = nlohmann::json::parse(file);
+
+        BenchmarkScript script;
+        script.frames = json.value("frames", script.frames);
+        script.warmupFrames = json.value("warmupFrames", script.warmupFrames);
+        script.width = json.value("width", script.width);
+        script.height = json.value("height", script.height);
+        script.timeStep = json.value("timeStep", script.timeStep);
+        script.device = json.value("device", script.device);
+        script.quality = json.value("quality", script.quality);
+        script.dynamicResolution = json.value("dynamicResolution", script.dynamicResolution);
+        if (json.contains("depthPrePass")) {
+            script.depthPrePass = json["depthPrePass"].get<bool>();
+        }
+        script.simulationOnly = json.value("simulationOnly", script.simulationOnly);
+        script.screenshotPrefix = json.value("screenshotPrefix", script.screenshotPrefix);
+        script.output = json.value("output", script.output);
+        for (const auto &key: json.value("scenes", nlohmann::json::array())) {
+            script.scenes.push_back({key["frame"].get<uint32_t>(), key["scene"].get<std::string>()});
+        }
+        for (const auto &key: json.value("camera", nlohmann::json::array())) {
+            script.camera.push_back({key["frame"].get<uint32_t>(), key["yaw"].get<float>(), key["pitch"].get<float>(),
+                                     key.value("distance", 0.0f)});
+        }
+        for (uint32_t frame: json.value("screenshots", std::vector<uint32_t>())) {
+            script.screenshots.insert(frame);
+        }
+
+        auto byFrame = [](const auto &a, const auto &b) { return a.frame < b.frame; };
+        std::sort(script.scenes.begin(), script.scenes.end(), byFrame);
+        std::sort(script.camera.begin(), script.camera.end(), byFrame);
+        if (script.warmupFrames >= script.frames) {
+            throw std::runtime_error("Benchmark: warmupFrames must be less than frames");
+        }
+        return script;
+    }
+
+    // Scene of the last key at or before the frame, empty before the first key
+    std::string getScene(uint32_t frame) const {
+        std::string scene;
+        for (const auto &key: scenes) {
+            if (key.frame > frame) {
+                break;
+            }
+            scene = key.scene;
+        }
+        return scene;
+    }
+
+    // Interpolated camera key, false when the script does not move the camera
+    bool getCamera(uint32_t frame, CameraKey &result) const {
+        if (camera.empty()) {
+            return false;
+        }
+        auto next = std::find_if(camera.begin(), camera.end(),
+                                 [frame](const CameraKey &key) { return key.frame > frame; });
+        if (next == camera.begin() || next == camera.end()) {
+            result = next == camera.end() ? camera.back() : camera.front();
+            return true;
+        }
+        const CameraKey &a = *(next - 1);
+        const CameraKey &b = *next;
+        float t = (float) (frame - a.frame) / (float) (b.frame - a.frame);
+        result = {frame, a.yaw + t * (b.yaw - a.yaw), a.pitch + t * (b.pitch - a.pitch),
+                  a.distance > 0.0f && b.distance > 0.0f ? a.distance + t * (b.distance - a.distance) : a.distance};
+        return true;
+    }
+};
+
+// Frame time samples in seconds, summarized in milliseconds
+class FrameTimeStats {
+public:
+    void add(double seconds) {
+        samples.push_back(seconds);
+    }
+
+    size_t size() const {
+        return samples.size();
+    }
+
+    nlohmann::json summary() const {
+        if (samples.empty()) {
+            return nullptr;
+        }
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0, squaredSum = 0.0;
+        for (double sample: sorted) {
+            sum += sample;
+            squaredSum += sample * sample;
+        }
+        double mean = sum / sorted.size();
+        double stdDev = std::sqrt(std::max(0.0, squaredSum / sorted.size() - mean * mean));
+        return {
+                {"frames", sorted.size()},
+                {"mean",   mean * 1000.0},
+                {"stdDev", stdDev * 1000.0},
+                {"min",    sorted.front() * 1000.0},
+                {"p50",    percentile(sorted, 0.50) * 1000.0},
+                {"p95",    percentile(sorted, 0.95) * 1000.0},
+                {"p99",    percentile(sorted, 0.99) * 1000.0},
+                {"max",    sorted.back() * 1000.0},
+        };
+    }
+
+private:
+    std::vector<double> samples;
+
+    // nearest rank
+    static double percentile(const std::vector<double> &sorted, double p) {
+        size_t rank = (size_t) std::ceil(p * sorted.size());
+        return sorted[std::clamp(rank, (size_t) 1, sorted.size()) - 1];
+    }
+};
+
+// Measured frames of a benchmark run, overall and per scene
+struct BenchmarkResults {
+    FrameTimeStats cpu;
+    FrameTimeStats gpu;
+    std::map<std::string, std::pair<FrameTimeStats, FrameTimeStats>> scenes;
+    // scene -> (sum, frames) of the fragment shader invocations per pixel
+    std::map<std::string, std::pair<double, uint32_t>> overdraw;
+
+    void add(const std::string &scene, double cpuTime, double gpuTime, double overdrawRatio) {
+        cpu.add(cpuTime);
+        scenes[scene].first.add(cpuTime);
+        // 0 until the first timestamps are read back, or without timestamp support
+        if (gpuTime > 0.0) {
+            gpu.add(gpuTime);
+            scenes[scene].second.add(gpuTime);
+        }
+        // 0 without pipeline statistics support
+        if (overdrawRatio > 0.0) {
+            overdraw[scene].first += overdrawRatio;
+            overdraw[scene].second++;
+        }
+    }
+
+    nlohmann::json toJson() const {
+        nlohmann::json json = {{"cpu", cpu.summary()}, {"gpu", gpu.summary()}};
+        for (const auto &[scene, stats]: scenes) {
+            json["scenes"][scene] = {{"cpu", stats.first.summary()}, {"gpu", stats.second.summary()}};
+            auto it = overdraw.find(scene);
+            json["scenes"][scene]["overdraw"] = it == overdraw.end() ? nlohmann::json(nullptr) :
+                                                nlohmann::json(it->second.first / it->second.second);
+        }
+        return json;
+    }
+};
@@ -107,6 +107,29 @@ public:
 //        matrices.view[1][1] *= -1;
     }
 
+    // Frustum planes of perspective * view as (normal, distance), normals point inside.
+    // Order: left, right, bottom, top, near, far. Depth range is [0, 1].
+    std::array<glm::vec4, 6> getFrustumPlanes() {
+        glm::mat4 m = matrices.perspective * matrices.view;
+        glm::vec4 row0 = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1 = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2 = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3 = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        std::array<glm::vec4, 6> planes = {
+                row3 + row0,
+                row3 - row0,
+                row3 + row1,
+                row3 - row1,
+                row2,
+                row3 - row2
+        };
+        for (auto &plane: planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return planes;
+    }
+
     void setEuler(float yaw, float pitch, float roll) {
         CamYaw = yaw;
         CamPitch = pitch;
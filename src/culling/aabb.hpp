@@ -0,0 +1,48 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include <cfloat>
+
+// Axis aligned bounding box. An empty box has min > max.
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool isEmpty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    void expand(const glm::vec3 &p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void expand(const AABB &other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    glm::vec3 center() const {
+        return (min + max) * 0.5f;
+    }
+
+    glm::vec3 extents() const {
+        return (max - min) * 0.5f;
+    }
+
+    // Box enclosing this one after the affine transform m
+    AABB transform(const glm::mat4 &m) const {
+        if (isEmpty()) {
+            return *this;
+        }
+        glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+        glm::vec3 e = extents();
+        glm::vec3 newExtents = glm::abs(glm::vec3(m[0])) * e.x
+                               + glm::abs(glm::vec3(m[1])) * e.y
+                               + glm::abs(glm::vec3(m[2])) * e.z;
+        AABB result;
+        result.min = c - newExtents;
+        result.max = c + newExtents;
+        return result;
+    }
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "culling/aabb.hpp"
+#include "culling/frustum.hpp"
+
+struct CullingStats {
+    // bounding volumes tested against the frustum (nodes and items)
+    uint32_t tested = 0;
+    // items found inside or intersecting the frustum and not occluded
+    uint32_t visible = 0;
+    // frustum visible items rejected by the occlusion test
+    uint32_t occluded = 0;
+    uint32_t total = 0;
+};
+
+struct BvhNode {
+    AABB bounds;
+    int left = -1;
+    int right = -1;
+    int parent = -1;
+    // range in Bvh::itemOrder, count > 0 only for leaves
+    int first = 0;
+    int count = 0;
+
+    bool isLeaf() const {
+        return count > 0;
+    }
+};
+
+/**
+ * Bounding volume hierarchy over item boxes, built top-down with a median split on the
+ * largest axis of the centroid bounds. Moving items are updated with refit(), which only
+ * walks from the item's leaf up to the root, so the tree topology is kept until the next build.
+ */
+class Bvh {
+public:
+    static const int MAX_LEAF_ITEMS = 4;
+
+    void build(const std::vector<AABB> &bounds) {
+        itemBounds = bounds;
+        nodes.clear();
+        itemOrder.resize(bounds.size());
+        itemLeaf.assign(bounds.size(), -1);
+        for (int i = 0; i < (int) bounds.size(); i++) {
+            itemOrder[i] = i;
+        }
+        if (!bounds.empty()) {
+            nodes.reserve(2 * bounds.size());
+            buildNode(0, (int) bounds.size(), -1);
+        }
+    }
+
+    void refit(int item, const AABB &bounds) {
+        itemBounds[item] = bounds;
+        int node = itemLeaf[item];
+        while (node != -1) {
+            BvhNode &n = nodes[node];
+            n.bounds = AABB();
+            if (n.isLeaf()) {
+                for (int i = n.first; i < n.first + n.count; i++) {
+                    n.bounds.expand(itemBounds[itemOrder[i]]);
+                }
+            } else {
+                n.bounds.expand(nodes[n.left].bounds);
+                n.bounds.expand(nodes[n.right].bounds);
+            }
+            node = n.parent;
+        }
+    }
+
+    // Calls onVisible(item) for every item inside or intersecting the frustum
+    template<typename F>
+    void query(const Frustum &frustum, F onVisible, CullingStats &stats) const {
+        stats = CullingStats();
+        stats.total = itemBounds.size();
+        if (nodes.empty()) {
+            return;
+        }
+        queryNode(0, frustum, onVisible, stats, false);
+    }
+
+    size_t size() const {
+        return itemBounds.size();
+    }
+
+private:
+    std::vector<BvhNode> nodes;
+    std::vector<int> itemOrder;
+    std::vector<int> itemLeaf;
+    std::vector<AABB> itemBounds;
+
+    int buildNode(int first, int count, int parent) {
+        int index = (int) nodes.size();
+        nodes.emplace_back();
+        nodes[index].parent = parent;
+
+        AABB bounds;
+        AABB centroids;
+        for (int i = first; i < first + count; i++) {
+            bounds.expand(itemBounds[itemOrder[i]]);
+            centroids.expand(itemBounds[itemOrder[i]].center());
+        }
+        nodes[index].bounds = bounds;
+
+        if (count <= MAX_LEAF_ITEMS) {
+            nodes[index].first = first;
+            nodes[index].count = count;
+            for (int i = first; i < first + count; i++) {
+                itemLeaf[itemOrder[i]] = index;
+            }
+            return index;
+        }
+
+        glm::vec3 size = centroids.max - centroids.min;
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        int mid = first + count / 2;
+        std::nth_element(itemOrder.begin() + first, itemOrder.begin() + mid, itemOrder.begin() + first + count,
+                         [&](int a, int b) {
+                             return itemBounds[a].center()[axis] < itemBounds[b].center()[axis];
+                         });
+
+        // nodes may reallocate while building the children, so no references are kept
+        int left = buildNode(first, mid - first, index);
+        int right = buildNode(mid, first + count - mid, index);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    template<typename F>
+    void queryNode(int index, const Frustum &frustum, F &onVisible, CullingStats &stats, bool inside) const {
+        const BvhNode &node = nodes[index];
+        if (!inside) {
+            stats.tested++;
+            FrustumTest test = frustum.testAABB(node.bounds);
+            if (test == FRUSTUM_OUTSIDE) {
+                return;
+            }
+            // everything below a fully contained node is visible without further tests
+            inside = test == FRUSTUM_INSIDE;
+        }
+
+        if (node.isLeaf()) {
+            for (int i = node.first; i < node.first + node.count; i++) {
+                int item = itemOrder[i];
+                if (!inside && node.count > 1) {
+                    stats.tested++;
+                    if (frustum.testAABB(itemBounds[item]) == FRUSTUM_OUTSIDE) {
+                        continue;
+                    }
+                }
+                stats.visible++;
+                onVisible(item);
+            }
+            return;
+        }
+        queryNode(node.left, frustum, onVisible, stats, inside);
+        queryNode(node.right, frustum, onVisible, stats, inside);
+    }
+};
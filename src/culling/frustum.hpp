@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include "glm/glm.hpp"
+#include "culling/aabb.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_USE_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#define FRUSTUM_USE_NEON
+#include <arm_neon.h>
+#endif
+
+enum FrustumTest {
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE
+};
+
+/**
+ * Frustum planes stored as structure of arrays, so one box is tested against four planes per
+ * SIMD instruction. The six planes are padded to eight with planes that never reject anything.
+ */
+struct Frustum {
+    alignas(16) float nx[8];
+    alignas(16) float ny[8];
+    alignas(16) float nz[8];
+    alignas(16) float d[8];
+
+    // planes as returned by Camera::getFrustumPlanes, normals pointing inside
+    void setPlanes(const std::array<glm::vec4, 6> &planes) {
+        for (int i = 0; i < 8; i++) {
+            glm::vec4 p = i < 6 ? planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            nx[i] = p.x;
+            ny[i] = p.y;
+            nz[i] = p.z;
+            d[i] = p.w;
+        }
+    }
+
+    FrustumTest testAABB(const AABB &box) const {
+        glm::vec3 c = box.center();
+        glm::vec3 e = box.extents();
+        bool intersects = false;
+
+#if defined(FRUSTUM_USE_SSE)
+        const __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+        const __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        for (int i = 0; i < 8; i += 4) {
+            __m128 px = _mm_load_ps(nx + i), py = _mm_load_ps(ny + i), pz = _mm_load_ps(nz + i);
+            // signed distance of the center and projected radius of the box on each normal
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)),
+                                     _mm_add_ps(_mm_mul_ps(pz, cz), _mm_load_ps(d + i)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex),
+                                                  _mm_mul_ps(_mm_andnot_ps(signMask, py), ey)),
+                                       _mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+            if (_mm_movemask_ps(_mm_cmplt_ps(dist, _mm_sub_ps(_mm_setzero_ps(), radius))) != 0) {
+                return FRUSTUM_OUTSIDE;
+            }
+            intersects |= _mm_movemask_ps(_mm_cmplt_ps(dist, radius)) != 0;
+        }
+#elif defined(FRUSTUM_USE_NEON)
+        const float32x4_t cx = vdupq_n_f32(c.x), cy = vdupq_n_f32(c.y), cz = vdupq_n_f32(c.z);
+        const float32x4_t ex = vdupq_n_f32(e.x), ey = vdupq_n_f32(e.y), ez = vdupq_n_f32(e.z);
+        for (int i = 0; i < 8; i += 4) {
+            float32x4_t px = vld1q_f32(nx + i), py = vld1q_f32(ny + i), pz = vld1q_f32(nz + i);
+            float32x4_t dist = vaddq_f32(vaddq_f32(vmulq_f32(px, cx), vmulq_f32(py, cy)),
+                                         vaddq_f32(vmulq_f32(pz, cz), vld1q_f32(d + i)));
+            float32x4_t radius = vaddq_f32(vaddq_f32(vmulq_f32(vabsq_f32(px), ex), vmulq_f32(vabsq_f32(py), ey)),
+                                           vmulq_f32(vabsq_f32(pz), ez));
+            uint32x4_t outside = vcltq_f32(dist, vnegq_f32(radius));
+            if ((vgetq_lane_u32(outside, 0) | vgetq_lane_u32(outside, 1) |
+                 vgetq_lane_u32(outside, 2) | vgetq_lane_u32(outside, 3)) != 0) {
+                return FRUSTUM_OUTSIDE;
+            }
+            uint32x4_t crossing = vcltq_f32(dist, radius);
+            intersects |= (vgetq_lane_u32(crossing, 0) | vgetq_lane_u32(crossing, 1) |
+                           vgetq_lane_u32(crossing, 2) | vgetq_lane_u32(crossing, 3)) != 0;
+        }
+#else
+        for (int i = 0; i < 6; i++) {
+            float dist = nx[i] * c.x + ny[i] * c.y + nz[i] * c.z + d[i];
+            float radius = std::abs(nx[i]) * e.x + std::abs(ny[i]) * e.y + std::abs(nz[i]) * e.z;
+            if (dist < -radius) {
+                return FRUSTUM_OUTSIDE;
+            }
+            intersects |= dist < radius;
+        }
+#endif
+        return intersects ? FRUSTUM_INTERSECTS : FRUSTUM_INSIDE;
+    }
+};
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cmath>
+#include "glm/glm.hpp"
+#include "culling/aabb.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OCCLUSION_USE_SSE
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON)
+#define OCCLUSION_USE_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * CPU occlusion culling. Occluder triangles (world space) are rasterized into a small depth buffer
+ * keeping the nearest depth per pixel, then the screen rectangle of each tested box is compared
+ * with the farthest occluder depth under it. A box is occluded only if its nearest point is behind
+ * every occluder pixel it covers, so the test never hides a visible object because of the
+ * low resolution.
+ *
+ * The work runs on a worker thread, started with the first submit(): submit() hands over one
+ * frame, wait() returns its result.
+ */
+class OcclusionCuller {
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+
+    OcclusionCuller() {
+        depth.resize(WIDTH * HEIGHT);
+    }
+
+    ~OcclusionCuller() {
+        if (!worker.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        jobReady.notify_one();
+        worker.join();
+    }
+
+    // world space triangle list, three vertices per triangle
+    void setOccluders(std::vector<glm::vec3> triangles) {
+        wait();
+        occluderTriangles = std::move(triangles);
+    }
+
+    size_t getOccluderTriangleCount() {
+        return occluderTriangles.size() / 3;
+    }
+
+    void submit(const glm::mat4 &viewProjection, std::vector<AABB> boxes) {
+        if (!worker.joinable()) {
+            worker = std::thread([this]() { run(); });
+        }
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobViewProjection = viewProjection;
+            jobBoxes = std::move(boxes);
+            jobPending = true;
+        }
+        jobReady.notify_one();
+    }
+
+    // Blocks until the submitted job is done. occluded[i] refers to the i-th submitted box.
+    const std::vector<bool> &wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobDone.wait(lock, [this]() { return !jobPending; });
+        return occluded;
+    }
+
+private:
+    std::vector<float> depth;
+    std::vector<glm::vec3> occluderTriangles;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    bool jobPending = false;
+    bool quit = false;
+    glm::mat4 jobViewProjection = glm::mat4(1.0f);
+    std::vector<AABB> jobBoxes;
+    std::vector<bool> occluded;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            jobReady.wait(lock, [this]() { return jobPending || quit; });
+            if (quit) {
+                return;
+            }
+            // the job data is only touched by this thread until jobPending is cleared
+            lock.unlock();
+            rasterizeOccluders(jobViewProjection);
+            occluded.assign(jobBoxes.size(), false);
+            for (size_t i = 0; i < jobBoxes.size(); i++) {
+                occluded[i] = isOccluded(jobViewProjection, jobBoxes[i]);
+            }
+            lock.lock();
+            jobPending = false;
+            jobDone.notify_all();
+        }
+    }
+
+    glm::vec3 toScreen(const glm::vec4 &clip) {
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z);
+    }
+
+    void rasterizeOccluders(const glm::mat4 &viewProjection) {
+        std::fill(depth.begin(), depth.end(), 1.0f);
+
+        for (size_t t = 0; t + 2 < occluderTriangles.size(); t += 3) {
+            glm::vec4 c0 = viewProjection * glm::vec4(occluderTriangles[t], 1.0f);
+            glm::vec4 c1 = viewProjection * glm::vec4(occluderTriangles[t + 1], 1.0f);
+            glm::vec4 c2 = viewProjection * glm::vec4(occluderTriangles[t + 2], 1.0f);
+            // triangles crossing the near plane are dropped instead of clipped: fewer occluders
+            // only make the result more conservative
+            const float nearW = 1e-4f;
+            if (c0.w < nearW || c1.w < nearW || c2.w < nearW) {
+                continue;
+            }
+            rasterizeTriangle(toScreen(c0), toScreen(c1), toScreen(c2));
+        }
+    }
+
+    void rasterizeTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2) {
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (std::abs(area) < 1e-6f) {
+            return;
+        }
+        // both windings are rasterized, make the edge functions positive inside
+        if (area < 0.0f) {
+            std::swap(v1, v2);
+            area = -area;
+        }
+
+        int minX = std::max(0, (int) std::floor(std::min({v0.x, v1.x, v2.x})));
+        int maxX = std::min(WIDTH - 1, (int) std::ceil(std::max({v0.x, v1.x, v2.x})));
+        int minY = std::max(0, (int) std::floor(std::min({v0.y, v1.y, v2.y})));
+        int maxY = std::min(HEIGHT - 1, (int) std::ceil(std::max({v0.y, v1.y, v2.y})));
+        if (minX > maxX || minY > maxY) {
+            return;
+        }
+        minX &= ~3;
+
+        // edge i is opposite to vertex i: E(p) = A * x + B * y + C
+        float a0 = v1.y - v2.y, b0 = v2.x - v1.x, k0 = v1.x * v2.y - v1.y * v2.x;
+        float a1 = v2.y - v0.y, b1 = v0.x - v2.x, k1 = v2.x * v0.y - v2.y * v0.x;
+        float a2 = v0.y - v1.y, b2 = v1.x - v0.x, k2 = v0.x * v1.y - v0.y * v1.x;
+        // depth is linear in screen space: z = (E0 * z0 + E1 * z1 + E2 * z2) / area
+        float invArea = 1.0f / area;
+        float z0 = v0.z * invArea, z1 = v1.z * invArea, z2 = v2.z * invArea;
+
+        for (int y = minY; y <= maxY; y++) {
+            float py = y + 0.5f;
+            float* row = &depth[y * WIDTH];
+#if defined(OCCLUSION_USE_SSE)
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            for (int x = minX; x <= maxX; x += 4) {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float) x), laneOffsets);
+                __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a0), px), _mm_set1_ps(b0 * py + k0));
+                __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a1), px), _mm_set1_ps(b1 * py + k1));
+                __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a2), px), _mm_set1_ps(b2 * py + k2));
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                                           _mm_cmpge_ps(e2, zero));
+                if (_mm_movemask_ps(inside) == 0) {
+                    continue;
+                }
+                __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e0, _mm_set1_ps(z0)), _mm_mul_ps(e1, _mm_set1_ps(z1))),
+                                      _mm_mul_ps(e2, _mm_set1_ps(z2)));
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_min_ps(old, z);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+            }
+#elif defined(OCCLUSION_USE_NEON)
+            const float32x4_t zero = vdupq_n_f32(0.0f);
+            const float laneOffsetValues[4] = {0.5f, 1.5f, 2.5f, 3.5f};
+            const float32x4_t laneOffsets = vld1q_f32(laneOffsetValues);
+            for (int x = minX; x <= maxX; x += 4) {
+                float32x4_t px = vaddq_f32(vdupq_n_f32((float) x), laneOffsets);
+                float32x4_t e0 = vaddq_f32(vmulq_n_f32(px, a0), vdupq_n_f32(b0 * py + k0));
+                float32x4_t e1 = vaddq_f32(vmulq_n_f32(px, a1), vdupq_n_f32(b1 * py + k1));
+                float32x4_t e2 = vaddq_f32(vmulq_n_f32(px, a2), vdupq_n_f32(b2 * py + k2));
+                uint32x4_t inside = vandq_u32(vandq_u32(vcgeq_f32(e0, zero), vcgeq_f32(e1, zero)),
+                                              vcgeq_f32(e2, zero));
+                if ((vgetq_lane_u32(inside, 0) | vgetq_lane_u32(inside, 1) |
+                     vgetq_lane_u32(inside, 2) | vgetq_lane_u32(inside, 3)) == 0) {
+                    continue;
+                }
+                float32x4_t z = vaddq_f32(vaddq_f32(vmulq_n_f32(e0, z0), vmulq_n_f32(e1, z1)), vmulq_n_f32(e2, z2));
+                float32x4_t old = vld1q_f32(row + x);
+                vst1q_f32(row + x, vbslq_f32(inside, vminq_f32(old, z), old));
+            }
+#else
+            for (int x = minX; x <= maxX; x++) {
+                float px = x + 0.5f;
+                float e0 = a0 * px + b0 * py + k0;
+                float e1 = a1 * px + b1 * py + k1;
+                float e2 = a2 * px + b2 * py + k2;
+                if (e0 < 0.0f || e1 < 0.0f || e2 < 0.0f) {
+                    continue;
+                }
+                row[x] = std::min(row[x], e0 * z0 + e1 * z1 + e2 * z2);
+            }
+#endif
+        }
+    }
+
+    bool isOccluded(const glm::mat4 &viewProjection, const AABB &box) {
+        float minX = WIDTH, maxX = 0, minY = HEIGHT, maxY = 0;
+        float nearestZ = 1.0f;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner = glm::vec3(i & 1 ? box.max.x : box.min.x,
+                                         i & 2 ? box.max.y : box.min.y,
+                                         i & 4 ? box.max.z : box.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+            // boxes reaching behind the camera cannot be tested in screen space
+            if (clip.w < 1e-4f) {
+                return false;
+            }
+            glm::vec3 s = toScreen(clip);
+            minX = std::min(minX, s.x);
+            maxX = std::max(maxX, s.x);
+            minY = std::min(minY, s.y);
+            maxY = std::max(maxY, s.y);
+            nearestZ = std::min(nearestZ, s.z);
+        }
+
+        int x0 = std::max(0, (int) std::floor(minX));
+        int x1 = std::min(WIDTH - 1, (int) std::ceil(maxX));
+        int y0 = std::max(0, (int) std::floor(minY));
+        int y1 = std::min(HEIGHT - 1, (int) std::ceil(maxY));
+        if (x0 > x1 || y0 > y1) {
+            // off screen, the frustum test decides
+            return false;
+        }
+        // widening the rectangle to whole SIMD lanes only adds pixels, which keeps the test conservative
+        x0 &= ~3;
+        x1 = std::min(WIDTH - 1, x1 | 3);
+
+        for (int y = y0; y <= y1; y++) {
+            const float* row = &depth[y * WIDTH];
+#if defined(OCCLUSION_USE_SSE)
+            const __m128 boxZ = _mm_set1_ps(nearestZ);
+            for (int x = x0; x <= x1; x += 4) {
+                // any occluder pixel behind the box nearest point leaves it visible
+                if (_mm_movemask_ps(_mm_cmple_ps(boxZ, _mm_loadu_ps(row + x))) != 0) {
+                    return false;
+                }
+            }
+#elif defined(OCCLUSION_USE_NEON)
+            const float32x4_t boxZ = vdupq_n_f32(nearestZ);
+            for (int x = x0; x <= x1; x += 4) {
+                uint32x4_t behind = vcleq_f32(boxZ, vld1q_f32(row + x));
+                if ((vgetq_lane_u32(behind, 0) | vgetq_lane_u32(behind, 1) |
+                     vgetq_lane_u32(behind, 2) | vgetq_lane_u32(behind, 3)) != 0) {
+                    return false;
+                }
+            }
+#else
+            for (int x = x0; x <= x1; x++) {
+                if (nearestZ <= row[x]) {
+                    return false;
+                }
+            }
+#endif
+        }
+        return true;
+    }
+};
@@ -6,6 +6,8 @@
 #include "common.hpp"
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include <map>
+#include "culling/aabb.hpp"
 
 
 class GameObjectBase {
@@ -38,6 +40,45 @@ public:
         return id;
     }
 
+    void setBounds(AABB b) {
+        bounds = b;
+    }
+
+    // model space bounds of the mesh
+    AABB getBounds() {
+        return bounds;
+    }
+
+    // Moving objects get their BVH leaf refitted every frame, static ones only on rebuild
+    void setDynamic(bool d) {
+        dynamic = d;
+    }
+
+    bool isDynamic() {
+        return dynamic;
+    }
+
+    void setModelPath(std::string path) {
+        modelPath = path;
+    }
+
+    std::string getModelPath() {
+        return modelPath;
+    }
+
+    // Objects with the same key share one vertex/index buffer and are drawn as instances
+    std::string getInstanceKey() {
+        std::string key = std::to_string(renderType) + "|" + (modelPath.empty() ? id : modelPath);
+        std::map<std::string, std::string> sortedTextures;
+        for (auto &[name, texture]: textures) {
+            sortedTextures[name] = texture.path;
+        }
+        for (auto &[name, path]: sortedTextures) {
+            key += "|" + name + "=" + path;
+        }
+        return key;
+    }
+
 
     void setTranslation(glm::vec3 pos) {
         translation = pos;
@@ -90,6 +131,9 @@ public:
     RenderType renderType = RenderType::STATIONARY;
 protected:
     std::string id;
+    std::string modelPath;
+    AABB bounds;
+    bool dynamic = false;
     glm::mat4 LocalMatrix = glm::mat4(1.0f);
     glm::vec3 translation = glm::vec3(0.0);
     glm::vec3 scaling = glm::vec3(1.0);
@@ -3,6 +3,7 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include "culling/aabb.hpp"
 
 
 class GameObjectLoader {
@@ -15,6 +16,8 @@ public:
         glm::mat4 Wm;
         std::string name = "";
         std::string baseColorTexture = "";
+        // model space bounds of the vertices
+        AABB bounds;
     };
     struct GameObjectMultiLoaderResult {
         std::vector<GameObjectLoaderResult> meshes;
@@ -71,6 +74,7 @@ public:
         }
         std::cout << "[OBJ] Vertices: " << result.vertices.size() << "\n";
         std::cout << "Indices: " << result.indices.size() << "\n";
+        computeBounds(result);
 
         return result;
     }
@@ -227,6 +231,7 @@ public:
             }
             result.name = mesh.name;
             result.Wm = glm::mat4(1.0f);
+            computeBounds(result);
             groupResult.meshes.push_back(result);
         }
 
@@ -463,8 +468,16 @@ public:
         result.Wm = glm::translate(glm::mat4(1), T) *
                     glm::mat4(Q) *
                     glm::scale(glm::mat4(1), S);
+        computeBounds(result);
 
         return result;
     }
 
+    static void computeBounds(GameObjectLoaderResult &result) {
+        result.bounds = AABB();
+        for (const auto &v: result.vertices) {
+            result.bounds.expand(v.pos);
+        }
+    }
+
 };
\ No newline at end of file
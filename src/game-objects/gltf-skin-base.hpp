@@ -108,10 +108,19 @@ public:
         return glm::vec3(model[3]);
     }
 
-    virtual std::unordered_map<int, glm::mat4> getJointMatrices() {
+    virtual const std::unordered_map<int, glm::mat4> &getJointMatrices() {
         return jointMatrices;
     }
 
+    // Entries of the joint palette, the joint matrices are keyed by their palette index
+    uint32_t getPaletteSize() {
+        int size = 0;
+        for (const auto &[index, matrix]: jointMatrices) {
+            size = std::max(size, index + 1);
+        }
+        return static_cast<uint32_t>(size);
+    }
+
     glm::mat4 getTransformedWorldMatrix() {
         glm::mat4 M = LocalMatrix;
 
@@ -163,8 +172,7 @@ public:
 
     void updateAnimation(float deltaTime) {
 
-        if (activeAnimation > static_cast<uint32_t>(animations.size()) - 1) {
-            std::cout << "No animation with index " << activeAnimation << std::endl;
+        if (activeAnimation >= animations.size()) {
             return;
         }
         auto animation = &animations[activeAnimation];
@@ -174,41 +182,25 @@ public:
         }
 
         for (auto &channel: animation->channels) {
-            auto sampler = animation->samplers[channel.samplerIndex];
-            for (size_t i = 0; i < sampler.inputs.size() - 1; i++) {
-                if (sampler.interpolation != "LINEAR") {
-                    std::cout << "This sample only supports linear interpolations\n";
-                    continue;
-                }
-
-                // Get the input keyframe values for the current time stamp
-                if ((animation->currentTime >= sampler.inputs[i]) &&
-                    (animation->currentTime <= sampler.inputs[i + 1])) {
-                    float a = (animation->currentTime - sampler.inputs[i]) /
-                              (sampler.inputs[i + 1] - sampler.inputs[i]);
-                    if (channel.path == "translation") {
-                        channel.joint->translation = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], a);
-                    }
-
-                    if (channel.path == "rotation") {
-                        glm::quat q1;
-                        q1.x = sampler.outputsVec4[i].x;
-                        q1.y = sampler.outputsVec4[i].y;
-                        q1.z = sampler.outputsVec4[i].z;
-                        q1.w = sampler.outputsVec4[i].w;
-
-                        glm::quat q2;
-                        q2.x = sampler.outputsVec4[i + 1].x;
-                        q2.y = sampler.outputsVec4[i + 1].y;
-                        q2.z = sampler.outputsVec4[i + 1].z;
-                        q2.w = sampler.outputsVec4[i + 1].w;
-
-                        channel.joint->rotation = glm::normalize(glm::slerp(q1, q2, a));
-                    }
-                    if (channel.path == "scale") {
-                        channel.joint->scale = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], a);
-                    }
-                }
+            const AnimationSampler &sampler = animation->samplers[channel.samplerIndex];
+
+            // Get the input keyframe values for the current time stamp
+            int i = findKeyframe(sampler.inputs, animation->currentTime, channel.keyframe);
+            if (i < 0) {
+                continue;
+            }
+            float span = sampler.inputs[i + 1] - sampler.inputs[i];
+            float a = span > 0.0f ? (animation->currentTime - sampler.inputs[i]) / span : 0.0f;
+            switch (channel.path) {
+                case PATH_TRANSLATION:
+                    channel.joint->translation = sampleVec3(sampler, i, a, span);
+                    break;
+                case PATH_ROTATION:
+                    channel.joint->rotation = sampleRotation(sampler, i, a, span);
+                    break;
+                case PATH_SCALE:
+                    channel.joint->scale = sampleVec3(sampler, i, a, span);
+                    break;
             }
         }
     }
@@ -1,14 +1,21 @@
 #pragma once
 
+#include <chrono>
 #include "glm/glm.hpp"
 #include "common.hpp"
+#include "modules/Input.hpp"
 
 struct UserInput {
     glm::vec3 axis;
     glm::vec3 rotation;
-    int key;
+    // level and edges of the keys, edges only in the first tick of a step
+    InputState keys;
     float deltaTime;
     float aspectRatio;
+    // duration of the last frame, drives the animations
+    float frameTime;
+    // when the input was sampled, see BaseProject::sampleInput
+    std::chrono::steady_clock::time_point sampleTime;
 };
 
 struct skyBoxUniformBufferObject {
@@ -20,6 +27,7 @@ struct skyBoxVertex {
 };
 
 
+// speeds are per second of simulated time
 struct GameConfig {
     float heroSpeed = 0.0f;
     float heroRotationSpeed = 0.0f;
@@ -1,7 +1,13 @@
 #include "app.hpp"
 
-int main() {
+// app [--benchmark script.json]
+int main(int argc, char **argv) {
     App app;
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--benchmark" && i + 1 < argc) {
+            app.setBenchmark(argv[++i]);
+        }
+    }
     try {
         app.run();
     }
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+// like Starter.hpp, whichever is included first
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+/**
+ * Ring buffer between one producer and one consumer thread, without locks. push() fails when the
+ * queue is full. Capacity must be a power of two.
+ */
+template<typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    bool push(const T &item) {
+        size_t back = tail.load(std::memory_order_relaxed);
+        if (back - head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        items[back & (Capacity - 1)] = item;
+        tail.store(back + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) {
+        size_t front = head.load(std::memory_order_relaxed);
+        if (front == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items[front & (Capacity - 1)];
+        head.store(front + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> items{};
+    // on separate cache lines, each is written by one side only
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+enum InputEventType {
+    INPUT_KEY,
+    INPUT_MOUSE_BUTTON,
+    INPUT_CURSOR,
+    INPUT_GAMEPAD
+};
+
+struct InputEvent {
+    InputEventType type;
+    // key, mouse button or joystick id
+    int code;
+    // GLFW_PRESS / GLFW_RELEASE, GLFW_CONNECTED / GLFW_DISCONNECTED for gamepads
+    int action;
+    glm::dvec2 cursor;
+    GLFWgamepadstate gamepad;
+};
+
+/**
+ * Keys and mouse buttons held down and pressed or released since the last drain, the cursor
+ * movement and the connected gamepads, as told by the queued input events.
+ */
+class InputState {
+public:
+    static const int KEY_COUNT = GLFW_KEY_LAST + 1;
+    // GLFW_JOYSTICK_1 to GLFW_JOYSTICK_4
+    static const int GAMEPAD_COUNT = 4;
+
+    // cursor movement in pixels since the last drain
+    glm::vec2 cursorDelta = glm::vec2(0.0f);
+
+    template<size_t Capacity>
+    void drain(SpscQueue<InputEvent, Capacity> &queue) {
+        clearEdges();
+        InputEvent event;
+        while (queue.pop(event)) {
+            apply(event);
+        }
+    }
+
+    // Also forgets the cursor movement
+    void clearEdges() {
+        pressed.reset();
+        released.reset();
+        cursorDelta = glm::vec2(0.0f);
+    }
+
+    // Adds the edges and cursor movement of an earlier drain that nothing consumed
+    void carryEdges(const InputState &earlier) {
+        pressed |= earlier.pressed;
+        released |= earlier.released;
+        cursorDelta += earlier.cursorDelta;
+    }
+
+    bool isDown(int key) const {
+        return key >= 0 && key < KEY_COUNT && down[key];
+    }
+
+    bool wasPressed(int key) const {
+        return key >= 0 && key < KEY_COUNT && pressed[key];
+    }
+
+    bool wasReleased(int key) const {
+        return key >= 0 && key < KEY_COUNT && released[key];
+    }
+
+    bool isMouseDown(int button) const {
+        return button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST && mouseDown[button];
+    }
+
+    // nullptr when no gamepad is connected as joystick id
+    const GLFWgamepadstate *getGamepad(int id) const {
+        return id >= 0 && id < GAMEPAD_COUNT && gamepadConnected[id] ? &gamepads[id] : nullptr;
+    }
+
+private:
+    std::bitset<KEY_COUNT> down;
+    std::bitset<KEY_COUNT> pressed;
+    std::bitset<KEY_COUNT> released;
+    std::bitset<GLFW_MOUSE_BUTTON_LAST + 1> mouseDown;
+    glm::dvec2 cursor = glm::dvec2(0.0);
+    bool hasCursor = false;
+    std::array<GLFWgamepadstate, GAMEPAD_COUNT> gamepads{};
+    std::bitset<GAMEPAD_COUNT> gamepadConnected;
+
+    void apply(const InputEvent &event) {
+        switch (event.type) {
+            case INPUT_KEY:
+                if (event.code < 0 || event.code >= KEY_COUNT) {
+                    break;
+                }
+                // a press and release within one drain still counts as a press
+                if (event.action == GLFW_PRESS) {
+                    pressed[event.code] = !down[event.code] || pressed[event.code];
+                    down[event.code] = true;
+                } else if (event.action == GLFW_RELEASE) {
+                    released[event.code] = down[event.code] || released[event.code];
+                    down[event.code] = false;
+                }
+                break;
+            case INPUT_MOUSE_BUTTON:
+                if (event.code >= 0 && event.code <= GLFW_MOUSE_BUTTON_LAST) {
+                    mouseDown[event.code] = event.action == GLFW_PRESS;
+                }
+                break;
+            case INPUT_CURSOR:
+                if (hasCursor) {
+                    cursorDelta += glm::vec2(event.cursor - cursor);
+                }
+                cursor = event.cursor;
+                hasCursor = true;
+                break;
+            case INPUT_GAMEPAD:
+                if (event.code >= 0 && event.code < GAMEPAD_COUNT) {
+                    gamepadConnected[event.code] = event.action == GLFW_CONNECTED;
+                    gamepads[event.code] = event.gamepad;
+                }
+                break;
+        }
+    }
+};
@@ -8,6 +8,7 @@
 #include <vector>
 #include <cstring>
 #include <optional>
+#include <unordered_map>
 #include <set>
 #include <cstdint>
 #include <algorithm>
@@ -26,6 +27,7 @@
 #include <glm/gtx/transform2.hpp>
 
 #include <chrono>
+#include <thread>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
@@ -40,6 +42,7 @@
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include "Input.hpp"
 
 #include <plusaes.hpp>
 
@@ -270,6 +273,15 @@ struct Texture {
 							 float maxLod
 							);
 
+	// sampler as requested by createTextureSampler, before the quality settings are applied
+	VkSamplerCreateInfo samplerSettings{};
+	bool hasSampler = false;
+	// limited by QualitySettings::maxSkyBoxSize instead of maxTextureSize, set before init
+	bool skyBox = false;
+	void createSampler();
+	// recreates the sampler with the current quality settings, the device must be idle
+	void updateSampler();
+
 	void init(BaseProject *bp, std::string file, VkFormat Fmt, bool initSampler);
 	void initCubic(BaseProject *bp, std::vector<std::string>, VkFormat Fmt);
 	void cleanup();
@@ -284,22 +296,36 @@ struct DescriptorSetLayoutBinding {
 };
 
 
+// One entry of the data a descriptor update template reads, see DescriptorSetLayout::updateTemplate
+union DescriptorInfo {
+	VkDescriptorBufferInfo buffer;
+	VkDescriptorImageInfo image;
+};
+
 struct DescriptorSetLayout {
 	BaseProject *BP;
  	VkDescriptorSetLayout descriptorSetLayout;
 	std::vector<DescriptorSetLayoutBinding> Bindings;
 	int imgInfoSize;
+	// writes a whole set from an array of templateSize DescriptorInfo, the descriptors of
+	// Bindings[j] starting at templateSlots[j]
+	VkDescriptorUpdateTemplate updateTemplate = VK_NULL_HANDLE;
+	std::vector<uint32_t> templateSlots;
+	uint32_t templateSize = 0;
 
  	void init(BaseProject *bp, std::vector<DescriptorSetLayoutBinding> B);
 	void cleanup();
 };
 
+struct BindState;
+
 struct Pipeline {
 	BaseProject *BP;
 	VkPipeline graphicsPipeline;
   	VkPipelineLayout pipelineLayout;
 
 	VkShaderModule vertShaderModule;
+	// VK_NULL_HANDLE for depth-only pipelines, see init
 	VkShaderModule fragShaderModule;
 	std::vector<DescriptorSetLayout *> D;
 
@@ -307,22 +333,45 @@ struct Pipeline {
 	VkPolygonMode polyModel;
  	VkCullModeFlagBits CM;
  	bool transp;
+	bool depthWrite;
 
 	VertexDescriptor *VD;
+	std::vector<VkPushConstantRange> pushConstantRanges;
 
   	void init(BaseProject *bp, VertexDescriptor *vd,
 			  const std::string& VertShader, const std::string& FragShader,
   			  std::vector<DescriptorSetLayout *> D);
   	void setAdvancedFeatures(VkCompareOp _compareOp, VkPolygonMode _polyModel,
  						VkCullModeFlagBits _CM, bool _transp);
+	void setDepthWrite(bool _depthWrite);
+  	void addPushConstants(VkShaderStageFlags stages, uint32_t offset, uint32_t size);
   	void create();
   	void destroy();
   	void bind(VkCommandBuffer commandBuffer);
+  	void bind(VkCommandBuffer commandBuffer, BindState &state);
 
   	VkShaderModule createShaderModule(const std::vector<char>& code);
 	void cleanup();
 };
 
+struct ComputePipeline {
+	BaseProject *BP;
+	VkPipeline computePipeline;
+	VkPipelineLayout pipelineLayout;
+
+	VkShaderModule compShaderModule;
+	std::vector<DescriptorSetLayout *> D;
+	std::vector<VkPushConstantRange> pushConstantRanges;
+
+	void init(BaseProject *bp, const std::string& CompShader,
+			  std::vector<DescriptorSetLayout *> D);
+	void addPushConstants(uint32_t offset, uint32_t size);
+	void create();
+	void destroy();
+	void bind(VkCommandBuffer commandBuffer);
+	void cleanup();
+};
+
 struct DescriptorSet {
 	BaseProject *BP;
 
@@ -337,14 +386,783 @@ struct DescriptorSet {
 						 std::vector<Texture *>Txs);
 	void cleanup();
   	void bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId, int currentImage);
+  	void bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId, int currentImage, BindState &state);
   	void map(int currentImage, void *src, int slot);
 };
 
+// Graphics pipeline, descriptor sets and vertex and index buffers bound so far in a command buffer,
+// so draws recorded one after the other only bind what differs, see RenderQueue::record
+struct BindState {
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	// layout the sets were bound with, sets bound with another layout are not tracked
+	VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+	std::vector<VkDescriptorSet> sets;
+	// bound at offset 0, indices are 32 bit
+	std::vector<VkBuffer> vertexBuffers;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+
+	void bindPipeline(VkCommandBuffer commandBuffer, VkPipeline graphicsPipeline) {
+		if (graphicsPipeline == pipeline) {
+			return;
+		}
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		pipeline = graphicsPipeline;
+	}
+
+	void bindDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineLayout layout, uint32_t setId,
+						   VkDescriptorSet set) {
+		if (layout != pipelineLayout) {
+			pipelineLayout = layout;
+			sets.clear();
+		}
+		if (sets.size() <= setId) {
+			sets.resize(setId + 1, VK_NULL_HANDLE);
+		}
+		if (sets[setId] == set) {
+			return;
+		}
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, setId, 1, &set, 0,
+								nullptr);
+		sets[setId] = set;
+	}
+
+	void bindVertexBuffer(VkCommandBuffer commandBuffer, uint32_t binding, VkBuffer buffer) {
+		if (vertexBuffers.size() <= binding) {
+			vertexBuffers.resize(binding + 1, VK_NULL_HANDLE);
+		}
+		if (vertexBuffers[binding] == buffer) {
+			return;
+		}
+		VkDeviceSize offset = 0;
+		vkCmdBindVertexBuffers(commandBuffer, binding, 1, &buffer, &offset);
+		vertexBuffers[binding] = buffer;
+	}
+
+	void bindIndexBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer) {
+		if (indexBuffer == buffer) {
+			return;
+		}
+		vkCmdBindIndexBuffer(commandBuffer, buffer, 0, VK_INDEX_TYPE_UINT32);
+		indexBuffer = buffer;
+	}
+};
+
+// Render quality knobs, chosen at startup and changed with BaseProject::setQuality
+struct QualitySettings {
+	std::string name = "high";
+	// lowered to the highest count the device supports
+	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_64_BIT;
+	// runs the fragment shader once per sample instead of once per pixel
+	bool sampleShading = true;
+	// 1 disables anisotropic filtering, clamped to the device limit
+	float maxAnisotropy = 16.0f;
+	float mipLodBias = 0.0f;
+	// largest texture mip that is sampled (0: full size), texture table textures never stream above it
+	uint32_t maxTextureSize = 0;
+	uint32_t maxSkyBoxSize = 0;
+	// MB of streamed texture table mips kept in memory (0: unlimited), see TextureTable
+	uint32_t textureBudget = 512;
+
+	static QualitySettings low() {
+		return {"low", VK_SAMPLE_COUNT_1_BIT, false, 1.0f, 1.0f, 1024, 1024, 128};
+	}
+
+	static QualitySettings medium() {
+		return {"medium", VK_SAMPLE_COUNT_4_BIT, false, 4.0f, 0.0f, 2048, 2048, 256};
+	}
+
+	static QualitySettings high() {
+		return {"high", VK_SAMPLE_COUNT_64_BIT, true, 16.0f, 0.0f, 0, 0, 512};
+	}
+};
+
+// Frame rate limiter and present-to-present statistics
+struct FramePacing {
+	using Clock = std::chrono::steady_clock;
+
+	// frames per second, 0: unlimited
+	float frameRateLimit = 0.0f;
+	// the limiter sleeps until this long before the deadline and spins for the rest,
+	// sleeps can overshoot by a scheduler tick
+	double spinTime = 0.002;
+	// used as the frame deadline when there is no limit
+	float refreshRate = 60.0f;
+
+	// statistics over windows of windowFrames presents, in seconds
+	uint32_t windowFrames = 120;
+	double meanInterval = 0.0;
+	double intervalStdDev = 0.0;
+	uint32_t windowMissed = 0;
+	uint32_t totalMissed = 0;
+
+	double targetInterval() const {
+		return 1.0 / (frameRateLimit > 0.0f ? frameRateLimit : refreshRate);
+	}
+
+	// Blocks until the next frame may start
+	void wait() {
+		if (frameRateLimit <= 0.0f) {
+			return;
+		}
+		auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(targetInterval()));
+		auto now = Clock::now();
+		// after a long frame start over instead of rushing frames to catch up
+		if (nextFrame == Clock::time_point() || now > nextFrame + period) {
+			nextFrame = now;
+		}
+		auto sleepUntil = nextFrame - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(spinTime));
+		if (now < sleepUntil) {
+			std::this_thread::sleep_until(sleepUntil);
+		}
+		while (Clock::now() < nextFrame) {
+			std::this_thread::yield();
+		}
+		nextFrame += period;
+	}
+
+	// Called right after each present
+	void presented() {
+		auto now = Clock::now();
+		if (lastPresent != Clock::time_point()) {
+			double interval = std::chrono::duration<double>(now - lastPresent).count();
+			intervalSum += interval;
+			intervalSquaredSum += interval * interval;
+			intervalCount++;
+			// later than half a frame past the deadline: the frame took two slots
+			if (interval > 1.5 * targetInterval()) {
+				missed++;
+				totalMissed++;
+			}
+			if (intervalCount == windowFrames) {
+				meanInterval = intervalSum / intervalCount;
+				intervalStdDev = std::sqrt(std::max(0.0, intervalSquaredSum / intervalCount - meanInterval * meanInterval));
+				windowMissed = missed;
+				intervalSum = intervalSquaredSum = 0.0;
+				intervalCount = 0;
+				missed = 0;
+			}
+		}
+		lastPresent = now;
+	}
+
+	// e.g. after a swap chain rebuild, whose stall is not a pacing problem
+	void restart() {
+		lastPresent = Clock::time_point();
+		nextFrame = Clock::time_point();
+	}
+
+private:
+	Clock::time_point nextFrame;
+	Clock::time_point lastPresent;
+	double intervalSum = 0.0;
+	double intervalSquaredSum = 0.0;
+	uint32_t intervalCount = 0;
+	uint32_t missed = 0;
+};
+
+// Latency from the sampling of the input a frame shows, averaged over recent frames, in seconds
+struct LatencyStats {
+	double smoothing = 0.05;
+	double inputToSubmit = 0.0;
+	// until the CPU sees the frame's fence signaled, i.e. the GPU is done with it. The present
+	// queue, the compositor and, in FIFO modes, the wait for the vertical blank come on top.
+	double inputToGpuComplete = 0.0;
+
+	void add(double &average, double sample) {
+		average = average == 0.0 ? sample : average + smoothing * (sample - average);
+	}
+
+	void reset() {
+		inputToSubmit = 0.0;
+		inputToGpuComplete = 0.0;
+	}
+};
+
+// Fragment shader invocations of the scene rendering, averaged over recent frames. The overdraw is
+// the invocations per covered pixel (per sample with sample shading): 1 when every pixel is shaded
+// exactly once, the skybox included.
+struct OverdrawStats {
+	double smoothing = 0.05;
+	double fragmentInvocations = 0.0;
+	double overdraw = 0.0;
+	// of the last frame read back, unsmoothed
+	double lastOverdraw = 0.0;
+
+	void add(uint64_t invocations, uint64_t pixels) {
+		if (pixels == 0) {
+			return;
+		}
+		double ratio = (double) invocations / (double) pixels;
+		lastOverdraw = ratio;
+		fragmentInvocations = fragmentInvocations == 0.0 ? (double) invocations :
+			fragmentInvocations + smoothing * ((double) invocations - fragmentInvocations);
+		overdraw = overdraw == 0.0 ? ratio : overdraw + smoothing * (ratio - overdraw);
+	}
+
+	void reset() {
+		fragmentInvocations = 0.0;
+		overdraw = 0.0;
+		lastOverdraw = 0.0;
+	}
+};
+
+// Shares the Vulkan objects created from identical create infos: samplers, descriptor set layouts,
+// pipeline layouts, shader modules and graphics pipelines. Every get adds a reference to the object
+// and the matching release drops it, the object is destroyed with its last reference.
+class ObjectCache {
+public:
+	void init(VkDevice pDevice) {
+		device = pDevice;
+	}
+
+	// pNext is not part of the key and must be null
+	VkSampler getSampler(const VkSamplerCreateInfo &info) {
+		std::string key;
+		append(key, info.flags, info.magFilter, info.minFilter, info.mipmapMode, info.addressModeU,
+			   info.addressModeV, info.addressModeW, info.mipLodBias, info.anisotropyEnable, info.maxAnisotropy,
+			   info.compareEnable, info.compareOp, info.minLod, info.maxLod, info.borderColor,
+			   info.unnormalizedCoordinates);
+		return acquire(samplers, key, [&]() {
+			VkSampler sampler;
+			VkResult result = vkCreateSampler(device, &info, nullptr, &sampler);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to create texture sampler!");
+			}
+			return sampler;
+		});
+	}
+
+	// bindingFlags is either empty or has one entry per binding
+	VkDescriptorSetLayout getDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding> &bindings,
+												 const std::vector<VkDescriptorBindingFlags> &bindingFlags = {},
+												 VkDescriptorSetLayoutCreateFlags flags = 0) {
+		std::string key;
+		append(key, flags);
+		for (size_t i = 0; i < bindings.size(); i++) {
+			append(key, bindings[i].binding, bindings[i].descriptorType, bindings[i].descriptorCount,
+				   bindings[i].stageFlags, bindingFlags.empty() ? 0 : bindingFlags[i]);
+		}
+		return acquire(descriptorSetLayouts, key, [&]() {
+			VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+			flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+			flagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+			flagsInfo.pBindingFlags = bindingFlags.data();
+
+			VkDescriptorSetLayoutCreateInfo layoutInfo{};
+			layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+			layoutInfo.pNext = bindingFlags.empty() ? nullptr : &flagsInfo;
+			layoutInfo.flags = flags;
+			layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+			layoutInfo.pBindings = bindings.data();
+
+			VkDescriptorSetLayout layout;
+			VkResult result = vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to create descriptor set layout!");
+			}
+			return layout;
+		});
+	}
+
+	// Pipelines with the same shaders, layout, vertex input and fixed function state are one
+	// handle, so render systems of the same type share their pipeline. The viewport and scissor
+	// are dynamic and left out of the key.
+	VkPipeline getGraphicsPipeline(const VkGraphicsPipelineCreateInfo &info) {
+		std::string key;
+		append(key, getId(info.layout), getId(info.renderPass), info.subpass);
+		for (uint32_t i = 0; i < info.stageCount; i++) {
+			append(key, info.pStages[i].stage, getId(info.pStages[i].module));
+		}
+		const VkPipelineVertexInputStateCreateInfo &vertexInput = *info.pVertexInputState;
+		for (uint32_t i = 0; i < vertexInput.vertexBindingDescriptionCount; i++) {
+			const auto &binding = vertexInput.pVertexBindingDescriptions[i];
+			append(key, binding.binding, binding.stride, binding.inputRate);
+		}
+		for (uint32_t i = 0; i < vertexInput.vertexAttributeDescriptionCount; i++) {
+			const auto &attribute = vertexInput.pVertexAttributeDescriptions[i];
+			append(key, attribute.location, attribute.binding, attribute.format, attribute.offset);
+		}
+		const auto &rasterizer = *info.pRasterizationState;
+		append(key, info.pInputAssemblyState->topology, rasterizer.polygonMode, rasterizer.cullMode,
+			   rasterizer.frontFace);
+		const auto &multisampling = *info.pMultisampleState;
+		append(key, multisampling.rasterizationSamples, multisampling.sampleShadingEnable,
+			   multisampling.minSampleShading);
+		const auto &depthStencil = *info.pDepthStencilState;
+		append(key, depthStencil.depthTestEnable, depthStencil.depthWriteEnable, depthStencil.depthCompareOp);
+		for (uint32_t i = 0; i < info.pColorBlendState->attachmentCount; i++) {
+			const auto &blend = info.pColorBlendState->pAttachments[i];
+			append(key, blend.colorWriteMask, blend.blendEnable, blend.srcColorBlendFactor,
+				   blend.dstColorBlendFactor);
+		}
+		return acquire(pipelines, key, [&]() {
+			VkPipeline pipeline;
+			VkResult result = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &info, nullptr, &pipeline);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to create graphics pipeline!");
+			}
+			return pipeline;
+		});
+	}
+
+	// identical set layouts are the same handle, so the handles are enough for the key
+	VkPipelineLayout getPipelineLayout(const std::vector<VkDescriptorSetLayout> &setLayouts,
+									   const std::vector<VkPushConstantRange> &pushConstantRanges) {
+		std::string key;
+		for (VkDescriptorSetLayout layout: setLayouts) {
+			append(key, getId(layout));
+		}
+		for (const auto &range: pushConstantRanges) {
+			append(key, range.stageFlags, range.offset, range.size);
+		}
+		return acquire(pipelineLayouts, key, [&]() {
+			VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+			pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+			pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+			pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+			pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+			pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
+
+			VkPipelineLayout layout;
+			VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &layout);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to create pipeline layout!");
+			}
+			return layout;
+		});
+	}
+
+	// keyed by the SPIR-V code itself, so the same shader read from two paths is one module
+	VkShaderModule getShaderModule(const std::vector<char> &code) {
+		return acquire(shaderModules, std::string(code.begin(), code.end()), [&]() {
+			VkShaderModuleCreateInfo createInfo{};
+			createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+			createInfo.codeSize = code.size();
+			createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+			VkShaderModule shaderModule;
+			VkResult result = vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to create shader module!");
+			}
+			return shaderModule;
+		});
+	}
+
+	void releaseSampler(VkSampler sampler) {
+		release(samplers, sampler, [this](VkSampler s) { vkDestroySampler(device, s, nullptr); });
+	}
+
+	void releaseDescriptorSetLayout(VkDescriptorSetLayout layout) {
+		release(descriptorSetLayouts, layout,
+				[this](VkDescriptorSetLayout l) { vkDestroyDescriptorSetLayout(device, l, nullptr); });
+	}
+
+	void releasePipelineLayout(VkPipelineLayout layout) {
+		release(pipelineLayouts, layout, [this](VkPipelineLayout l) { vkDestroyPipelineLayout(device, l, nullptr); });
+	}
+
+	void releaseShaderModule(VkShaderModule shaderModule) {
+		release(shaderModules, shaderModule, [this](VkShaderModule m) { vkDestroyShaderModule(device, m, nullptr); });
+	}
+
+	void releasePipeline(VkPipeline pipeline) {
+		release(pipelines, pipeline, [this](VkPipeline p) { vkDestroyPipeline(device, p, nullptr); });
+	}
+
+	// live objects, whatever the number of users
+	size_t size() const {
+		return samplers.byKey.size() + descriptorSetLayouts.byKey.size() + pipelineLayouts.byKey.size() +
+			   shaderModules.byKey.size() + pipelines.byKey.size();
+	}
+
+	// Destroys the objects still referenced, before the device
+	void cleanup() {
+		for (auto &[key, entry]: pipelines.byKey) {
+			vkDestroyPipeline(device, entry.handle, nullptr);
+		}
+		for (auto &[key, entry]: samplers.byKey) {
+			vkDestroySampler(device, entry.handle, nullptr);
+		}
+		for (auto &[key, entry]: pipelineLayouts.byKey) {
+			vkDestroyPipelineLayout(device, entry.handle, nullptr);
+		}
+		for (auto &[key, entry]: descriptorSetLayouts.byKey) {
+			vkDestroyDescriptorSetLayout(device, entry.handle, nullptr);
+		}
+		for (auto &[key, entry]: shaderModules.byKey) {
+			vkDestroyShaderModule(device, entry.handle, nullptr);
+		}
+		samplers = {};
+		pipelineLayouts = {};
+		descriptorSetLayouts = {};
+		shaderModules = {};
+		pipelines = {};
+	}
+
+private:
+	template<typename T>
+	struct Objects {
+		struct Entry {
+			T handle;
+			uint32_t references;
+		};
+		std::unordered_map<std::string, Entry> byKey;
+		// handle -> key
+		std::unordered_map<uint64_t, std::string> keys;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	Objects<VkSampler> samplers;
+	Objects<VkDescriptorSetLayout> descriptorSetLayouts;
+	Objects<VkPipelineLayout> pipelineLayouts;
+	Objects<VkShaderModule> shaderModules;
+	Objects<VkPipeline> pipelines;
+
+	// handles are pointers on 64 bit platforms and integers elsewhere
+	template<typename T>
+	static uint64_t getId(T handle) {
+		uint64_t id = 0;
+		memcpy(&id, &handle, sizeof(handle));
+		return id;
+	}
+
+	template<typename... Ts>
+	static void append(std::string &key, const Ts &... values) {
+		(key.append(reinterpret_cast<const char *>(&values), sizeof(values)), ...);
+	}
+
+	template<typename T, typename Create>
+	T acquire(Objects<T> &objects, const std::string &key, Create create) {
+		auto it = objects.byKey.find(key);
+		if (it != objects.byKey.end()) {
+			it->second.references++;
+			return it->second.handle;
+		}
+		T handle = create();
+		objects.byKey[key] = {handle, 1};
+		objects.keys[getId(handle)] = key;
+		return handle;
+	}
+
+	// handles the cache did not create are ignored
+	template<typename T, typename Destroy>
+	void release(Objects<T> &objects, T handle, Destroy destroy) {
+		auto it = objects.keys.find(getId(handle));
+		if (it == objects.keys.end()) {
+			return;
+		}
+		auto entry = objects.byKey.find(it->second);
+		if (--entry->second.references == 0) {
+			destroy(handle);
+			objects.byKey.erase(entry);
+			objects.keys.erase(it);
+		}
+	}
+};
+
+// Allocates descriptor sets from a chain of pools, adding a larger pool whenever the current ones
+// run out, so nothing has to count the sets and descriptors up front. Sets are not freed one by
+// one: reset() returns every set at once and keeps the pools for the next allocations.
+class DescriptorAllocator {
+public:
+	static const uint32_t FIRST_POOL_SETS = 64;
+	static const uint32_t MAX_POOL_SETS = 4096;
+
+	void init(VkDevice pDevice) {
+		device = pDevice;
+	}
+
+	void allocate(const std::vector<VkDescriptorSetLayout> &layouts, VkDescriptorSet *sets) {
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+		allocInfo.pSetLayouts = layouts.data();
+
+		VkResult result = VK_ERROR_OUT_OF_POOL_MEMORY;
+		while (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+			bool freshPool = current == pools.size();
+			if (freshPool) {
+				pools.push_back(createPool());
+			}
+			allocInfo.descriptorPool = pools[current];
+			result = vkAllocateDescriptorSets(device, &allocInfo, sets);
+			if (result == VK_SUCCESS) {
+				break;
+			}
+			if (freshPool) {
+				// the request does not even fit an empty pool
+				break;
+			}
+			current++;
+		}
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to allocate descriptor sets!");
+		}
+	}
+
+	// Frees every set allocated so far, none may still be used by a pending command buffer
+	void reset() {
+		for (VkDescriptorPool pool: pools) {
+			vkResetDescriptorPool(device, pool, 0);
+		}
+		current = 0;
+	}
+
+	void cleanup() {
+		for (VkDescriptorPool pool: pools) {
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		}
+		pools.clear();
+		current = 0;
+		nextPoolSets = FIRST_POOL_SETS;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	std::vector<VkDescriptorPool> pools;
+	// pools before it are full until the next reset
+	size_t current = 0;
+	uint32_t nextPoolSets = FIRST_POOL_SETS;
+
+	// descriptors per set the pools are sized for, a global set has 3 uniform blocks and the
+	// material sets up to 6 textures
+	VkDescriptorPool createPool() {
+		std::array<VkDescriptorPoolSize, 3> poolSizes = {{
+			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4 * nextPoolSets},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 * nextPoolSets},
+			{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * nextPoolSets},
+		}};
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		poolInfo.pPoolSizes = poolSizes.data();
+		poolInfo.maxSets = nextPoolSets;
+
+		VkDescriptorPool pool;
+		VkResult result = vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to create descriptor pool!");
+		}
+		nextPoolSets = std::min(nextPoolSets * 2, MAX_POOL_SETS);
+		return pool;
+	}
+};
+
+// Chooses the fraction of the swap chain extent the scene is rendered at,
+// so that the measured GPU frame time stays close to targetFrameTime.
+struct DynamicResolution {
+	bool enabled = true;
+	float targetFrameTime = 1.0f / 60.0f;
+	float minScale = 0.5f;
+	float maxScale = 1.0f;
+	// scales are multiples of step: every change re-records the command buffers
+	float step = 0.05f;
+	// weight of the newest sample in smoothedFrameTime
+	float smoothing = 0.1f;
+	// the scale only drops once the smoothed time is this much over the target
+	float tolerance = 0.1f;
+	// frames to wait after a change, the next measurements still come from the old scale
+	int cooldownFrames = 8;
+
+	float scale = 1.0f;
+	float smoothedFrameTime = 0.0f;
+	// also skips the first frames, which are slowed down by pipeline and texture warm up
+	int cooldown = cooldownFrames;
+
+	// Feeds one GPU frame time in seconds, returns true when the scale changed
+	bool update(float gpuFrameTime) {
+		if (!enabled) {
+			return false;
+		}
+		smoothedFrameTime = smoothedFrameTime == 0.0f ? gpuFrameTime :
+			smoothedFrameTime + smoothing * (gpuFrameTime - smoothedFrameTime);
+		if (cooldown > 0) {
+			cooldown--;
+			return false;
+		}
 
-struct PoolSizes {
-	int uniformBlocksInPool = 0;
-	int texturesInPool = 0;
-	int setsInPool = 0;
+		// the cost of a frame is roughly proportional to its pixels, i.e. to scale^2
+		float newScale = scale;
+		if (smoothedFrameTime > targetFrameTime * (1.0f + tolerance)) {
+			// drop straight to the predicted scale, at least one step
+			float predicted = scale * std::sqrt(targetFrameTime / smoothedFrameTime);
+			newScale = std::min(std::floor(predicted / step) * step, scale - step);
+		} else {
+			// grow one step at a time, and only if the bigger frame is predicted to fit,
+			// otherwise the scale would bounce between two steps
+			float next = scale + step;
+			if (smoothedFrameTime * (next * next) / (scale * scale) < targetFrameTime) {
+				newScale = next;
+			}
+		}
+		newScale = std::clamp(newScale, minScale, maxScale);
+		if (std::abs(newScale - scale) < step * 0.5f) {
+			return false;
+		}
+
+		smoothedFrameTime *= (newScale * newScale) / (scale * scale);
+		scale = newScale;
+		cooldown = cooldownFrames;
+		return true;
+	}
+};
+
+// GPU time of named sections of the command buffers, e.g. one per render system.
+// Each swap chain image has its own block of maxScopes timestamp pairs and its own scope names,
+// since the buffers are re-recorded independently. Results are read when the image comes back,
+// a few frames after submission, and averaged over windows of windowFrames frames.
+// Off until turned on with BaseProject::setGpuProfiling, it adds two timestamps per scope.
+struct GpuProfiler {
+	// grown by BaseProject::growGpuProfiler when a recording has more scopes
+	uint32_t maxScopes = 64;
+	// scopes left out of the results since the start, for want of timestamps
+	uint32_t droppedScopes = 0;
+
+	struct Result {
+		std::string name;
+		// seconds per frame, over the frames that recorded the scope
+		double average = 0.0;
+		double max = 0.0;
+	};
+
+	bool enabled = false;
+	uint32_t windowFrames = 60;
+	// in recording order, replaced at the end of each window
+	std::vector<Result> results;
+
+	void resize(size_t imageCount) {
+		images.assign(imageCount, {});
+	}
+
+	// Called when the image's command buffer starts recording
+	void beginRecording(uint32_t image) {
+		images[image].names.clear();
+		images[image].open.clear();
+		images[image].dropped = 0;
+	}
+
+	// Query index of the scope's start, relative to the image block, or -1 once maxScopes is reached.
+	// Scopes may nest.
+	int beginScope(uint32_t image, const std::string &name) {
+		ImageScopes &scopes = images[image];
+		if (scopes.names.size() >= maxScopes) {
+			scopes.open.push_back(-1);
+			scopes.dropped++;
+			droppedScopes++;
+			return -1;
+		}
+		int scope = (int) scopes.names.size();
+		scopes.names.push_back(name);
+		scopes.open.push_back(scope);
+		return 2 * scope;
+	}
+
+	// Query index of the innermost open scope's end, or -1
+	int endScope(uint32_t image) {
+		ImageScopes &scopes = images[image];
+		if (scopes.open.empty()) {
+			throw std::runtime_error("GpuProfiler: endScope without beginScope");
+		}
+		int scope = scopes.open.back();
+		scopes.open.pop_back();
+		return scope < 0 ? -1 : 2 * scope + 1;
+	}
+
+	uint32_t queryCount(uint32_t image) const {
+		return 2 * (uint32_t) images[image].names.size();
+	}
+
+	// Scopes past maxScopes in the image's last recording
+	uint32_t getDropped(uint32_t image) const {
+		return images[image].dropped;
+	}
+
+	// Feeds the timestamps of the image's last frame, queryCount(image) of them
+	void addFrame(uint32_t image, const uint64_t *timestamps, double secondsPerTick, uint64_t mask) {
+		const std::vector<std::string> &names = images[image].names;
+		// a name recorded twice in a frame (e.g. two draws of one system) adds up
+		std::vector<std::pair<size_t, double>> frameTimes;
+		for (size_t i = 0; i < names.size(); i++) {
+			uint64_t ticks = ((timestamps[2 * i + 1] & mask) - (timestamps[2 * i] & mask)) & mask;
+			size_t slot = getSlot(names[i]);
+			auto it = std::find_if(frameTimes.begin(), frameTimes.end(),
+								   [slot](const auto &entry) { return entry.first == slot; });
+			if (it == frameTimes.end()) {
+				frameTimes.emplace_back(slot, ticks * secondsPerTick);
+			} else {
+				it->second += ticks * secondsPerTick;
+			}
+		}
+		for (const auto &[slot, time]: frameTimes) {
+			windowStats[slot].total += time;
+			windowStats[slot].max = std::max(windowStats[slot].max, time);
+			windowStats[slot].frames++;
+		}
+
+		if (++frames < windowFrames) {
+			return;
+		}
+		results.clear();
+		for (size_t slot = 0; slot < windowStats.size(); slot++) {
+			if (windowStats[slot].frames > 0) {
+				results.push_back({slotNames[slot], windowStats[slot].total / windowStats[slot].frames,
+								   windowStats[slot].max});
+			}
+		}
+		// scopes that were not recorded in this window are forgotten
+		slotNames.clear();
+		windowStats.clear();
+		frames = 0;
+	}
+
+	// Average seconds of the named scope in the last window, 0 if it was not recorded
+	double get(const std::string &name) const {
+		for (const auto &result: results) {
+			if (result.name == name) {
+				return result.average;
+			}
+		}
+		return 0.0;
+	}
+
+private:
+	struct ImageScopes {
+		// scope i uses the queries 2i and 2i + 1 of the image block
+		std::vector<std::string> names;
+		// scopes begun and not yet ended, -1 for the ones past maxScopes
+		std::vector<int> open;
+		uint32_t dropped = 0;
+	};
+	struct WindowStats {
+		double total = 0.0;
+		double max = 0.0;
+		uint32_t frames = 0;
+	};
+
+	std::vector<ImageScopes> images;
+	// first seen order of the names in the current window
+	std::vector<std::string> slotNames;
+	std::vector<WindowStats> windowStats;
+	uint32_t frames = 0;
+
+	size_t getSlot(const std::string &name) {
+		auto it = std::find(slotNames.begin(), slotNames.end(), name);
+		if (it != slotNames.end()) {
+			return it - slotNames.begin();
+		}
+		slotNames.push_back(name);
+		windowStats.emplace_back();
+		return slotNames.size() - 1;
+	}
 };
 
 // MAIN !
@@ -353,6 +1171,7 @@ class BaseProject {
 	friend class Model;
 	friend class Texture;
 	friend class Pipeline;
+	friend class ComputePipeline;
 	friend class DescriptorSetLayout;
 	friend class DescriptorSet;
 public:
@@ -361,14 +1180,14 @@ public:
     	windowResizable = GLFW_FALSE;
 
     	setWindowParameters();
-        initWindow();
+    	if (!headless) {
+        	initWindow();
+    	}
         initVulkan();
         mainLoop();
         cleanup();
     }
 
-	PoolSizes DPSZs;
-
 
 	uint32_t windowWidth;
 	uint32_t windowHeight;
@@ -376,26 +1195,64 @@ public:
 	std::string windowTitle;
 	VkClearColorValue initialBackgroundColor;
 
-    GLFWwindow* window;
+    GLFWwindow* window = nullptr;
     VkInstance instance;
 
-	VkSurfaceKHR surface;
+	// No window, surface or swap chain: frames are rendered into offscreen images of
+	// windowWidth x windowHeight that stand in for the swap chain images and are never presented
+	bool headless = false;
+	// the physical device whose name contains this is preferred, e.g. "llvmpipe"
+	std::string preferredDevice;
+	// cleared to leave mainLoop
+	bool running = true;
+	// headless runs that only advance the simulation: simulateFrame replaces drawFrame
+	bool simulationOnly = false;
+	// validation layers and the debug messenger, optional in headless runs
+	bool validationEnabled = true;
+	bool debugUtilsEnabled = true;
+
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice device;
     VkQueue graphicsQueue;
     VkQueue presentQueue;
 	VkCommandPool commandPool;
 	std::vector<VkCommandBuffer> commandBuffers;
-
-    VkSwapchainKHR swapChain;
+	std::vector<bool> commandBufferDirty;
+
+	// open upload batch, see beginUploads
+	VkCommandBuffer uploadCommandBuffer = VK_NULL_HANDLE;
+	VkFence uploadFence = VK_NULL_HANDLE;
+	struct StagingChunk {
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		void *data;
+		VkDeviceSize size;
+	};
+	// chunks double in size within a batch, starting small so that the few mips streamed at
+	// run time do not allocate the size of a whole scene load
+	static constexpr VkDeviceSize FIRST_STAGING_CHUNK_SIZE = 4 * 1024 * 1024;
+	static constexpr VkDeviceSize STAGING_CHUNK_SIZE = 64 * 1024 * 1024;
+	std::vector<StagingChunk> stagingChunks;
+	VkDeviceSize stagingOffset = 0;
+
+    VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     std::vector<VkImage> swapChainImages;
+	// only used headless, see createHeadlessImages
+	std::vector<VkDeviceMemory> headlessImagesMemory;
+	uint32_t nextHeadlessImage = 0;
+	// layout of the swap chain images once a frame is done with them
+	VkImageLayout swapChainImageLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// image of the last submitted frame
+	uint32_t lastImageIndex = 0;
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
 	std::vector<VkImageView> swapChainImageViews;
 
 	VkRenderPass renderPass;
 
- 	VkDescriptorPool descriptorPool;
+	// sets that live until the swap chain is recreated, the pools are reset then
+	DescriptorAllocator descriptorAllocator;
 
 	VkDebugUtilsMessengerEXT debugMessenger;
 
@@ -404,15 +1261,93 @@ public:
 	VkImageView depthImageView;
 
 	VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	QualitySettings quality;
+	float maxSamplerAnisotropy = 1.0f;
+	// textures with a sampler, updated when the quality changes
+	std::vector<Texture *> textures;
 	VkImage colorImage;
 	VkDeviceMemory colorImageMemory;
 	VkImageView colorImageView;
 
+	// The scene is rendered into renderExtent (dynamicResolution.scale times the swap chain extent)
+	// of an offscreen image per swap chain image, then blitted to the swap chain image.
+	// The offscreen images are allocated for maxScale, so scale changes only re-record.
+	DynamicResolution dynamicResolution;
+	VkExtent2D renderExtent;
+	VkExtent2D sceneImageExtent;
+	std::vector<VkImage> sceneImages;
+	std::vector<VkDeviceMemory> sceneImagesMemory;
+	std::vector<VkImageView> sceneImageViews;
+	VkFilter sceneBlitFilter = VK_FILTER_LINEAR;
+
+	// Per swap chain image: two timestamps around the scene rendering, then the pairs of the
+	// profiler scopes. Read back once the image's previous submission has completed.
+	VkQueryPool timestampQueryPool = VK_NULL_HANDLE;
+	// follows gpuProfiler.maxScopes when the pool is created
+	uint32_t timestampsPerImage = 0;
+	// nanoseconds per timestamp tick
+	float timestampPeriod = 0.0f;
+	uint64_t timestampMask = ~0ull;
+	std::vector<bool> timestampsPending;
+	float gpuFrameTime = 0.0f;
+	GpuProfiler gpuProfiler;
+
+	// Per swap chain image: one pipeline statistics query counting the fragment shader invocations
+	// of the render pass, VK_NULL_HANDLE when the device has no pipelineStatisticsQuery
+	VkQueryPool statisticsQueryPool = VK_NULL_HANDLE;
+	bool pipelineStatisticsSupported = false;
+	std::vector<bool> statisticsPending;
+	// pixels of the render area each command buffer was recorded with
+	std::vector<uint64_t> statisticsPixels;
+	OverdrawStats overdrawStats;
+	// samplers, layouts, shader modules and pipelines, shared by every user with the same create info
+	ObjectCache objectCache;
+	// sampled image descriptors can be rewritten while bound in a recorded command buffer,
+	// see TextureTable::update
+	bool descriptorUpdateAfterBindSupported = false;
+	// vkCmdDrawIndexedIndirectCount can be used, see GpuCulling::draw
+	bool drawIndirectCountSupported = false;
+
 	std::vector<VkFramebuffer> swapChainFramebuffers;
 	size_t currentFrame = 0;
     float frameTime = 0.0f;
+	// measured duration of the last frame, equal to frameTime unless fixedFrameTime is set
+	float frameWallTime = 0.0f;
+	// > 0: animations advance by this much every frame, e.g. for reproducible benchmarks
+	float fixedFrameTime = 0.0f;
     uint32_t frameCounter = 0;
 	bool framebufferResized = false;
+	// used when the surface supports it, FIFO otherwise
+	VkPresentModeKHR preferredPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+	VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	FramePacing framePacing;
+
+	// Low latency mode: at most one frame is queued, and the CPU sleeps until just before the
+	// GPU is predicted to finish it, so input is sampled and simulated as late as possible
+	bool lowLatencyMode = false;
+	// how much earlier than predicted the CPU wakes up, covers prediction errors
+	double lowLatencyMargin = 0.001;
+	LatencyStats latency;
+	// set by sampleInput
+	std::chrono::steady_clock::time_point inputSampleTime;
+	// sample time of the input the frame being drawn shows, the latency stats start there. Set
+	// to inputSampleTime by sampleInput, updateUniformBuffer moves it back when it draws a state
+	// simulated from older input.
+	std::chrono::steady_clock::time_point drawnInputTime;
+	// pushed by the GLFW input callbacks on the main thread, emptied by drainInput on the thread
+	// that runs the simulation
+	SpscQueue<InputEvent, 1024> inputEvents;
+	// input as of the last drainInput
+	InputState input;
+	// gamepads among GLFW_JOYSTICK_1 to 4, polled by sampleInput
+	std::bitset<InputState::GAMEPAD_COUNT> connectedGamepads;
+	// GLFW joystick callbacks do not carry a window
+	inline static BaseProject *joystickListener = nullptr;
+	std::chrono::steady_clock::time_point lastSubmitTime;
+	// input time of the frame each in-flight fence guards, cleared once the fence is seen signaled
+	std::vector<std::chrono::steady_clock::time_point> frameInputTimes;
+	bool qualityChangePending = false;
+	QualitySettings pendingQuality;
 
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
@@ -429,6 +1364,19 @@ public:
 
         glfwSetWindowUserPointer(window, this);
         glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+        glfwSetKeyCallback(window, keyCallback);
+        glfwSetMouseButtonCallback(window, mouseButtonCallback);
+        glfwSetCursorPosCallback(window, cursorPosCallback);
+        joystickListener = this;
+        glfwSetJoystickCallback(joystickCallback);
+        for (int id = 0; id < InputState::GAMEPAD_COUNT; id++) {
+            connectedGamepads[id] = glfwJoystickIsGamepad(GLFW_JOYSTICK_1 + id);
+        }
+
+        const GLFWvidmode *mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+        if (mode != nullptr && mode->refreshRate > 0) {
+            framePacing.refreshRate = (float) mode->refreshRate;
+        }
 
     }
 
@@ -441,6 +1389,41 @@ public:
 		app->onWindowResize(width, height);
 	}
 
+	// Events that do not fit in the queue are dropped, it holds many frames of input
+	static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+		if (action == GLFW_REPEAT) {
+			return;
+		}
+		auto app = reinterpret_cast<BaseProject*>(glfwGetWindowUserPointer(window));
+		InputEvent event{INPUT_KEY, key, action};
+		app->inputEvents.push(event);
+	}
+
+	static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+		auto app = reinterpret_cast<BaseProject*>(glfwGetWindowUserPointer(window));
+		InputEvent event{INPUT_MOUSE_BUTTON, button, action};
+		app->inputEvents.push(event);
+	}
+
+	static void cursorPosCallback(GLFWwindow* window, double x, double y) {
+		auto app = reinterpret_cast<BaseProject*>(glfwGetWindowUserPointer(window));
+		InputEvent event{INPUT_CURSOR, 0, 0, glm::dvec2(x, y)};
+		app->inputEvents.push(event);
+	}
+
+	static void joystickCallback(int id, int connectionEvent) {
+		int gamepad = id - GLFW_JOYSTICK_1;
+		if (joystickListener == nullptr || gamepad < 0 || gamepad >= InputState::GAMEPAD_COUNT) {
+			return;
+		}
+		bool connected = connectionEvent == GLFW_CONNECTED && glfwJoystickIsGamepad(id);
+		joystickListener->connectedGamepads[gamepad] = connected;
+		if (!connected) {
+			InputEvent event{INPUT_GAMEPAD, gamepad, GLFW_DISCONNECTED};
+			joystickListener->inputEvents.push(event);
+		}
+	}
+
 
 	virtual void localInit() = 0;
 	virtual void pipelinesAndDescriptorSetsInit() = 0;
@@ -448,19 +1431,23 @@ public:
     void initVulkan() {
 		createInstance();
 		setupDebugMessenger();
-		createSurface();
+		if (!headless) {
+			createSurface();
+		}
 		pickPhysicalDevice();
 		createLogicalDevice();
 		createSwapChain();
 		createImageViews();
 		createRenderPass();
 		createCommandPool();
+		createSceneResources();
 		createColorResources();
 		createDepthResources();
 		createFramebuffers();
+		createTimestampQueryPool();
+		createStatisticsQueryPool();
 		localInit();
 
-		createDescriptorPool();
 		pipelinesAndDescriptorSetsInit();
 
 		createCommandBuffers();
@@ -475,21 +1462,25 @@ std::cout << "Starting createInstance()\n"  << std::flush;
     	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     	appInfo.pEngineName = "No Engine";
     	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		// 1.2 for descriptor indexing (bindless texture table)
+		appInfo.apiVersion = VK_API_VERSION_1_2;
 
 		VkInstanceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 		createInfo.pApplicationInfo = &appInfo;
 
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-//		createInfo.enabledExtensionCount = glfwExtensionCount;
-//		createInfo.ppEnabledExtensionNames = glfwExtensions;
-
 		createInfo.enabledLayerCount = 0;
 
+		validationEnabled = checkValidationLayerSupport();
+		if (!validationEnabled) {
+			// benchmark machines often only have the driver, e.g. a software ICD
+			if (!headless) {
+				throw std::runtime_error("validation layers requested, but not available!");
+			}
+			std::cout << "Validation layers not available, running without them\n";
+		}
+		debugUtilsEnabled = !headless || checkIfItHasExtension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+
 		auto extensions = getRequiredExtensions();
 		createInfo.enabledExtensionCount =
 			static_cast<uint32_t>(extensions.size());
@@ -497,18 +1488,17 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 
 		createInfo.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
 
-		if (!checkValidationLayerSupport()) {
-			throw std::runtime_error("validation layers requested, but not available!");
-		}
-
 		VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo;
+		if (validationEnabled) {
 			createInfo.enabledLayerCount =
 				static_cast<uint32_t>(validationLayers.size());
 			createInfo.ppEnabledLayerNames = validationLayers.data();
-
+		}
+		if (debugUtilsEnabled) {
 			populateDebugMessengerCreateInfo(debugCreateInfo);
 			createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)
 									&debugCreateInfo;
+		}
 
 		VkResult result = vkCreateInstance(&createInfo, nullptr, &instance);
 
@@ -519,15 +1509,19 @@ std::cout << "Starting createInstance()\n"  << std::flush;
     }
 
     std::vector<const char*> getRequiredExtensions() {
-		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions =
-			glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-		std::vector<const char*> extensions(glfwExtensions,
-			glfwExtensions + glfwExtensionCount);
+		std::vector<const char*> extensions;
+		// the surface extensions
+		if (!headless) {
+			uint32_t glfwExtensionCount = 0;
+			const char** glfwExtensions;
+			glfwExtensions =
+				glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 
-		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		if (debugUtilsEnabled) {
+			extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+		}
 
 		if(checkIfItHasExtension(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME)) {
 			extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
@@ -654,6 +1648,9 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	}
 
 	void setupDebugMessenger() {
+		if (!debugUtilsEnabled) {
+			return;
+		}
 
 		VkDebugUtilsMessengerCreateInfoEXT createInfo{};
 		populateDebugMessengerCreateInfo(createInfo);
@@ -678,6 +1675,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			bool swapChainPresentModeSupport;
 			bool completeQueueFamily;
 			bool anisotropySupport;
+			bool descriptorIndexingSupport;
 			bool extensionsSupported;
 			std::set<std::string> requiredExtensions;
 
@@ -687,6 +1685,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 				std::cout << "swapChainPresentModeSupport: " << swapChainPresentModeSupport <<"\n";
 				std::cout << "completeQueueFamily: " << completeQueueFamily <<"\n";
 				std::cout << "anisotropySupport: " << anisotropySupport <<"\n";
+				std::cout << "descriptorIndexingSupport: " << descriptorIndexingSupport <<"\n";
 				std::cout << "extensionsSupported: " << extensionsSupported <<"\n";
 
 				for (const auto& ext : requiredExtensions) {
@@ -709,6 +1708,19 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 
 		std::cout << "Physical devices found: " << deviceCount << "\n";
 
+		if (headless) {
+			deviceExtensions.erase(std::remove_if(deviceExtensions.begin(), deviceExtensions.end(),
+					[](const char *ext) { return strcmp(ext, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; }),
+					deviceExtensions.end());
+		}
+		if (!preferredDevice.empty()) {
+			std::stable_partition(devices.begin(), devices.end(), [this](VkPhysicalDevice device) {
+				VkPhysicalDeviceProperties properties;
+				vkGetPhysicalDeviceProperties(device, &properties);
+				return std::string(properties.deviceName).find(preferredDevice) != std::string::npos;
+			});
+		}
+
 		for (const auto& device : devices) {
 			if(checkIfItHasDeviceExtension(device, "VK_KHR_portability_subset")) {
 				deviceExtensions.push_back("VK_KHR_portability_subset");
@@ -717,8 +1729,13 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			bool suitable = isDeviceSuitable(device, devRep);
 			if (suitable) {
 				physicalDevice = device;
-				msaaSamples = getMaxUsableSampleCount();
-				std::cout << "\n\nMaximum samples for anti-aliasing: " << msaaSamples << "\n\n\n";
+				msaaSamples = getUsableSampleCount(quality.msaaSamples);
+				VkPhysicalDeviceProperties properties;
+				vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+				maxSamplerAnisotropy = properties.limits.maxSamplerAnisotropy;
+				std::cout << "Using " << properties.deviceName << "\n";
+				std::cout << "\n\nMaximum samples for anti-aliasing: " << getMaxUsableSampleCount() <<
+						  ", quality " << quality.name << " uses " << msaaSamples << "\n\n\n";
 				break;
 			} else {
 				std::cout << "Device " << device << " is not suitable\n";
@@ -736,8 +1753,9 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 
 		devRep.extensionsSupported = checkDeviceExtensionSupport(device, devRep);
 
-		devRep.swapChainAdequate = false;
-		if (devRep.extensionsSupported) {
+		// headless runs have no surface to present to
+		devRep.swapChainAdequate = headless;
+		if (devRep.extensionsSupported && !headless) {
 			SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 			devRep.swapChainFormatSupport = swapChainSupport.formats.empty();
 			devRep.swapChainPresentModeSupport = swapChainSupport.presentModes.empty();
@@ -750,9 +1768,30 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 
 		devRep.completeQueueFamily = indices.isComplete();
 		devRep.anisotropySupport = supportedFeatures.samplerAnisotropy;
+		devRep.descriptorIndexingSupport = checkDescriptorIndexingSupport(device);
 
 		return devRep.completeQueueFamily && devRep.extensionsSupported && devRep.swapChainAdequate &&
-						devRep.anisotropySupport;
+						devRep.anisotropySupport && devRep.descriptorIndexingSupport;
+	}
+
+	// Features used by the bindless texture table: an unsized sampler array indexed with
+	// push constants, with unused slots left unwritten
+	bool checkDescriptorIndexingSupport(VkPhysicalDevice device) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(device, &properties);
+		if (properties.apiVersion < VK_API_VERSION_1_2) {
+			return false;
+		}
+
+		VkPhysicalDeviceVulkan12Features features12{};
+		features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		VkPhysicalDeviceFeatures2 features{};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &features12;
+		vkGetPhysicalDeviceFeatures2(device, &features);
+
+		return features.features.shaderSampledImageArrayDynamicIndexing &&
+			   features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound;
 	}
 
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device) {
@@ -772,9 +1811,11 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 				indices.graphicsFamily = i;
 			}
 
-			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
-												 &presentSupport);
+			VkBool32 presentSupport = headless && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT);
+			if (!headless) {
+				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface,
+													 &presentSupport);
+			}
 			if (presentSupport) {
 			 	indices.presentFamily = i;
 			}
@@ -855,6 +1896,23 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		return VK_SAMPLE_COUNT_1_BIT;
 	}
 
+	// Highest supported sample count that does not exceed the requested one
+	VkSampleCountFlagBits getUsableSampleCount(VkSampleCountFlagBits requested) {
+		VkPhysicalDeviceProperties physicalDeviceProperties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+		VkSampleCountFlags counts =
+				physicalDeviceProperties.limits.framebufferColorSampleCounts &
+				physicalDeviceProperties.limits.framebufferDepthSampleCounts;
+
+		for (uint32_t samples = requested; samples > VK_SAMPLE_COUNT_1_BIT; samples >>= 1) {
+			if (counts & samples) {
+				return static_cast<VkSampleCountFlagBits>(samples);
+			}
+		}
+		return VK_SAMPLE_COUNT_1_BIT;
+	}
+
 	void createLogicalDevice() {
 		QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
@@ -872,13 +1930,36 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
+		VkPhysicalDeviceFeatures supportedFeatures;
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+		pipelineStatisticsSupported = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+
 		VkPhysicalDeviceFeatures deviceFeatures{};
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
+		deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
 		deviceFeatures.sampleRateShading = VK_TRUE;
 		deviceFeatures.fillModeNonSolid  = VK_TRUE;
+		deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+
+		VkPhysicalDeviceVulkan12Features supportedFeatures12{};
+		supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		VkPhysicalDeviceFeatures2 supportedFeatures2{};
+		supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supportedFeatures2.pNext = &supportedFeatures12;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &supportedFeatures2);
+		descriptorUpdateAfterBindSupported = supportedFeatures12.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE;
+		drawIndirectCountSupported = supportedFeatures12.drawIndirectCount == VK_TRUE;
+
+		VkPhysicalDeviceVulkan12Features features12{};
+		features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		features12.runtimeDescriptorArray = VK_TRUE;
+		features12.descriptorBindingPartiallyBound = VK_TRUE;
+		features12.descriptorBindingSampledImageUpdateAfterBind = supportedFeatures12.descriptorBindingSampledImageUpdateAfterBind;
+		features12.drawIndirectCount = supportedFeatures12.drawIndirectCount;
 
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		createInfo.pNext = &features12;
 
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.queueCreateInfoCount =
@@ -889,9 +1970,11 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 				static_cast<uint32_t>(deviceExtensions.size());
 		createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
+		if (validationEnabled) {
 			createInfo.enabledLayerCount =
 					static_cast<uint32_t>(validationLayers.size());
 			createInfo.ppEnabledLayerNames = validationLayers.data();
+		}
 
 		VkResult result = vkCreateDevice(physicalDevice, &createInfo, nullptr, &device);
 
@@ -902,15 +1985,21 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 
 		vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+		objectCache.init(device);
+		descriptorAllocator.init(device);
 	}
 
 	void createSwapChain() {
+		if (headless) {
+			createHeadlessImages();
+			return;
+		}
+		swapChainImageLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 		SwapChainSupportDetails swapChainSupport =
 				querySwapChainSupport(physicalDevice);
 		VkSurfaceFormatKHR surfaceFormat =
 				chooseSwapSurfaceFormat(swapChainSupport.formats);
-		VkPresentModeKHR presentMode =
-				chooseSwapPresentMode(swapChainSupport.presentModes);
+		presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
 		VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
 		uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
@@ -928,8 +2017,10 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		createInfo.imageColorSpace = surfaceFormat.colorSpace;
 		createInfo.imageExtent = extent;
 		createInfo.imageArrayLayers = 1;
+		// the scene is blitted in, see blitToSwapChain
 		createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
-							    VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+							    VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+							    VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
 		QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 		uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(),
@@ -965,6 +2056,31 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		swapChainExtent = extent;
 	}
 
+	// Stand-ins for the swap chain images, left in TRANSFER_SRC layout to be read back
+	void createHeadlessImages() {
+		swapChainImageFormat = findSupportedFormat({VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB},
+									VK_IMAGE_TILING_OPTIMAL,
+									VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT |
+									VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT);
+		swapChainExtent = {windowWidth, windowHeight};
+		swapChainImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+
+		// as many as a swap chain would have, so frames in flight never share an image
+		swapChainImages.resize(MAX_FRAMES_IN_FLIGHT + 1);
+		headlessImagesMemory.resize(swapChainImages.size());
+		for (size_t i = 0; i < swapChainImages.size(); i++) {
+			createImage(swapChainExtent.width, swapChainExtent.height, 1, 1,
+						VK_SAMPLE_COUNT_1_BIT, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+						VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+						VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+						VK_IMAGE_USAGE_TRANSFER_DST_BIT, 0,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						swapChainImages[i], headlessImagesMemory[i]);
+		}
+		nextHeadlessImage = 0;
+	}
+
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(
 				const std::vector<VkSurfaceFormatKHR>& availableFormats)
 	{
@@ -981,13 +2097,20 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	VkPresentModeKHR chooseSwapPresentMode(
 			const std::vector<VkPresentModeKHR>& availablePresentModes) {
 		for (const auto& availablePresentMode : availablePresentModes) {
-			if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+			if (availablePresentMode == preferredPresentMode) {
 				return availablePresentMode;
 			}
 		}
+		// the only mode every surface supports
 		return VK_PRESENT_MODE_FIFO_KHR;
 	}
 
+	// Takes effect with the next swap chain rebuild
+	void setPresentMode(VkPresentModeKHR mode) {
+		preferredPresentMode = mode;
+		framebufferResized = true;
+	}
+
 	VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
 		if (capabilities.currentExtent.width != UINT32_MAX) {
 			return capabilities.currentExtent;
@@ -1052,7 +2175,8 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		// resolved into the offscreen scene image, which is then blitted to the swap chain
+		colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
 		VkAttachmentReference colorAttachmentResolveRef{};
 		colorAttachmentResolveRef.attachment = 2;
@@ -1097,13 +2221,26 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		subpass.pDepthStencilAttachment = &depthAttachmentRef;
 		subpass.pResolveAttachments = &colorAttachmentResolveRef;
 
-		VkSubpassDependency dependency{};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.dstSubpass = 0;
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.srcAccessMask = 0;
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		// The color and depth attachments are shared by the frames in flight and no longer
+		// wait for the swap chain image, so the previous frame's writes must complete first
+		std::array<VkSubpassDependency, 2> dependencies{};
+		dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[0].dstSubpass = 0;
+		dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+									   VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+										VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+									   VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+										VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		dependencies[1].srcSubpass = 0;
+		dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+		dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
 
 		std::array<VkAttachmentDescription, 3> attachments =
 								{colorAttachment, depthAttachment,
@@ -1115,8 +2252,8 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		renderPassInfo.pAttachments = attachments.data();
 		renderPassInfo.subpassCount = 1;
 		renderPassInfo.pSubpasses = &subpass;
-		renderPassInfo.dependencyCount = 1;
-		renderPassInfo.pDependencies = &dependency;
+		renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+		renderPassInfo.pDependencies = dependencies.data();
 
 		VkResult result = vkCreateRenderPass(device, &renderPassInfo, nullptr,
 					&renderPass);
@@ -1132,7 +2269,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			std::array<VkImageView, 3> attachments = {
 				colorImageView,
 				depthImageView,
-				swapChainImageViews[i]
+				sceneImageViews[i]
 			};
 
 			VkFramebufferCreateInfo framebufferInfo{};
@@ -1142,8 +2279,8 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			framebufferInfo.attachmentCount =
 							static_cast<uint32_t>(attachments.size());;
 			framebufferInfo.pAttachments = attachments.data();
-			framebufferInfo.width = swapChainExtent.width;
-			framebufferInfo.height = swapChainExtent.height;
+			framebufferInfo.width = sceneImageExtent.width;
+			framebufferInfo.height = sceneImageExtent.height;
 			framebufferInfo.layers = 1;
 
 			VkResult result = vkCreateFramebuffer(device, &framebufferInfo, nullptr,
@@ -1162,7 +2299,8 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		VkCommandPoolCreateInfo poolInfo{};
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-		poolInfo.flags = 0; // Optional
+		// Command buffers are re-recorded in place when the drawn content changes
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 		VkResult result = vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
 		if (result != VK_SUCCESS) {
@@ -1173,7 +2311,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 
 	void createColorResources() {
 		VkFormat colorFormat = swapChainImageFormat;
-		createImage(swapChainExtent.width, swapChainExtent.height, 1, 1,
+		createImage(sceneImageExtent.width, sceneImageExtent.height, 1, 1,
 					msaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL,
 					VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
 					VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, 0,
@@ -1187,7 +2325,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	void createDepthResources() {
 		VkFormat depthFormat = findDepthFormat();
 
-		createImage(swapChainExtent.width, swapChainExtent.height, 1, 1,
+		createImage(sceneImageExtent.width, sceneImageExtent.height, 1, 1,
 					msaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL,
 					VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 0,
 					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
@@ -1196,8 +2334,183 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 										 VK_IMAGE_ASPECT_DEPTH_BIT, 1,
 										 VK_IMAGE_VIEW_TYPE_2D, 1);
 
-		transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED,
-							  VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1, 1);
+		transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED,
+							  VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1, 1);
+	}
+
+	// Offscreen single sampled targets the scene is resolved into, one per swap chain image
+	void createSceneResources() {
+		sceneImageExtent = {
+			std::max(1u, static_cast<uint32_t>(std::ceil(swapChainExtent.width * dynamicResolution.maxScale))),
+			std::max(1u, static_cast<uint32_t>(std::ceil(swapChainExtent.height * dynamicResolution.maxScale)))
+		};
+		updateRenderExtent();
+
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, swapChainImageFormat, &formatProperties);
+		sceneBlitFilter = (formatProperties.optimalTilingFeatures &
+						   VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ?
+						  VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+
+		sceneImages.resize(swapChainImages.size());
+		sceneImagesMemory.resize(swapChainImages.size());
+		sceneImageViews.resize(swapChainImages.size());
+		for (size_t i = 0; i < swapChainImages.size(); i++) {
+			createImage(sceneImageExtent.width, sceneImageExtent.height, 1, 1,
+						VK_SAMPLE_COUNT_1_BIT, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+						VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+						VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 0,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+						sceneImages[i], sceneImagesMemory[i]);
+			sceneImageViews[i] = createImageView(sceneImages[i], swapChainImageFormat,
+										VK_IMAGE_ASPECT_COLOR_BIT, 1,
+										VK_IMAGE_VIEW_TYPE_2D, 1);
+		}
+	}
+
+	void updateRenderExtent() {
+		float scale = std::clamp(dynamicResolution.scale, dynamicResolution.minScale,
+								 dynamicResolution.maxScale);
+		renderExtent = {
+			std::clamp(static_cast<uint32_t>(std::round(swapChainExtent.width * scale)),
+					   1u, sceneImageExtent.width),
+			std::clamp(static_cast<uint32_t>(std::round(swapChainExtent.height * scale)),
+					   1u, sceneImageExtent.height)
+		};
+	}
+
+	// Without timestamp support the GPU time cannot be measured: the scale stays fixed and
+	// the profiler records nothing. Software drivers like lavapipe report CPU time instead.
+	void createTimestampQueryPool() {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+		uint32_t validBits = queueFamilies[findQueueFamilies(physicalDevice).graphicsFamily.value()].timestampValidBits;
+
+		timestampQueryPool = VK_NULL_HANDLE;
+		timestampsPending.assign(swapChainImages.size(), false);
+		gpuProfiler.resize(swapChainImages.size());
+		if (!properties.limits.timestampComputeAndGraphics || validBits == 0) {
+			std::cout << "GPU timestamps not supported, dynamic resolution and profiling disabled\n";
+			dynamicResolution.enabled = false;
+			gpuProfiler.enabled = false;
+			return;
+		}
+		timestampPeriod = properties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+		timestampsPerImage = 2 + 2 * gpuProfiler.maxScopes;
+
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryPoolInfo.queryCount = static_cast<uint32_t>(timestampsPerImage * swapChainImages.size());
+
+		VkResult result = vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampQueryPool);
+		if (result != VK_SUCCESS) {
+		 	PrintVkError(result);
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+	}
+
+	// Reads the GPU time of the image's last frame and lets dynamicResolution react to it.
+	// The image's previous submission must have completed.
+	void readFrameTimestamps(uint32_t imageIndex) {
+		if (timestampQueryPool == VK_NULL_HANDLE || !timestampsPending[imageIndex]) {
+			return;
+		}
+		// no wait flag: the results are complete after the fence, and never stall the frame otherwise
+		uint32_t queryCount = 2 + gpuProfiler.queryCount(imageIndex);
+		std::vector<uint64_t> timestamps(queryCount);
+		VkResult result = vkGetQueryPoolResults(device, timestampQueryPool, timestampsPerImage * imageIndex,
+							queryCount, queryCount * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t),
+							VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			return;
+		}
+		timestampsPending[imageIndex] = false;
+
+		uint64_t ticks = ((timestamps[1] & timestampMask) - (timestamps[0] & timestampMask)) & timestampMask;
+		gpuFrameTime = (float) (ticks * (double) timestampPeriod * 1e-9);
+		gpuProfiler.addFrame(imageIndex, &timestamps[2], timestampPeriod * 1e-9, timestampMask);
+		if (dynamicResolution.update(gpuFrameTime)) {
+			updateRenderExtent();
+			invalidateCommandBuffers();
+		}
+	}
+
+	void createStatisticsQueryPool() {
+		statisticsQueryPool = VK_NULL_HANDLE;
+		statisticsPending.assign(swapChainImages.size(), false);
+		statisticsPixels.assign(swapChainImages.size(), 0);
+		overdrawStats.reset();
+		if (!pipelineStatisticsSupported) {
+			return;
+		}
+
+		VkQueryPoolCreateInfo queryPoolInfo{};
+		queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		queryPoolInfo.queryCount = static_cast<uint32_t>(swapChainImages.size());
+		queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+		VkResult result = vkCreateQueryPool(device, &queryPoolInfo, nullptr, &statisticsQueryPool);
+		if (result != VK_SUCCESS) {
+		 	PrintVkError(result);
+			throw std::runtime_error("failed to create pipeline statistics query pool!");
+		}
+	}
+
+	// Like readFrameTimestamps, the image's previous submission must have completed
+	void readFrameStatistics(uint32_t imageIndex) {
+		if (statisticsQueryPool == VK_NULL_HANDLE || !statisticsPending[imageIndex]) {
+			return;
+		}
+		uint64_t invocations = 0;
+		VkResult result = vkGetQueryPoolResults(device, statisticsQueryPool, imageIndex, 1, sizeof(invocations),
+							&invocations, sizeof(invocations), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			return;
+		}
+		statisticsPending[imageIndex] = false;
+		overdrawStats.add(invocations, statisticsPixels[imageIndex]);
+	}
+
+	// Scales the rendered part of the scene image up to the whole swap chain image
+	void blitToSwapChain(VkCommandBuffer commandBuffer, uint32_t i) {
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = swapChainImages[i];
+		barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		// the transfer stage waits for the image to be acquired, see drawFrame
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkImageBlit blit{};
+		blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+		blit.srcOffsets[1] = {(int32_t) renderExtent.width, (int32_t) renderExtent.height, 1};
+		blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+		blit.dstOffsets[1] = {(int32_t) swapChainExtent.width, (int32_t) swapChainExtent.height, 1};
+		vkCmdBlitImage(commandBuffer,
+					   sceneImages[i], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					   swapChainImages[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+					   1, &blit, sceneBlitFilter);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = swapChainImageLayout;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = 0;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 	}
 
 	VkFormat findDepthFormat() {
@@ -1289,7 +2602,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			throw std::runtime_error("texture image format does not support linear blitting!");
 		}
 
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		VkCommandBuffer commandBuffer = beginUploadCommands();
 
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1362,13 +2675,13 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 							 0, nullptr, 0, nullptr,
 							 1, &barrier);
 
-		endSingleTimeCommands(commandBuffer);
+		endUploadCommands(commandBuffer);
 	}
 
 	void transitionImageLayout(VkImage image, VkFormat format,
 					VkImageLayout oldLayout, VkImageLayout newLayout,
 					uint32_t mipLevels, int layersCount) {
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		VkCommandBuffer commandBuffer = beginUploadCommands();
 
 		VkImageMemoryBarrier barrier{};
 		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1422,15 +2735,16 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 								sourceStage, destinationStage, 0,
 								0, nullptr, 0, nullptr, 1, &barrier);
 
-		endSingleTimeCommands(commandBuffer);
+		endUploadCommands(commandBuffer);
 	}
 
 	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t
-						   width, uint32_t height, int layerCount) {
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+						   width, uint32_t height, int layerCount,
+						   VkDeviceSize bufferOffset = 0) {
+		VkCommandBuffer commandBuffer = beginUploadCommands();
 
 		VkBufferImageCopy region{};
-		region.bufferOffset = 0;
+		region.bufferOffset = bufferOffset;
 		region.bufferRowLength = 0;
 		region.bufferImageHeight = 0;
 		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -1443,7 +2757,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		vkCmdCopyBufferToImage(commandBuffer, buffer, image,
 				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 
-		endSingleTimeCommands(commandBuffer);
+		endUploadCommands(commandBuffer);
 	}
 
 	VkCommandBuffer beginSingleTimeCommands() {
@@ -1478,6 +2792,143 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 	}
 
+	// Opens the upload batch: until flushUploads(), transitionImageLayout, copyBufferToImage,
+	// generateMipmaps and uploadToBuffer record into one command buffer instead of submitting
+	// and waiting each, with their staging memory taken from a linear arena.
+	// Returns false when a batch is open already, only the caller that opened it flushes it.
+	bool beginUploads() {
+		if (uploadCommandBuffer != VK_NULL_HANDLE) {
+			return false;
+		}
+		if (uploadFence == VK_NULL_HANDLE) {
+			VkFenceCreateInfo fenceInfo{};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			VkResult result = vkCreateFence(device, &fenceInfo, nullptr, &uploadFence);
+			if (result != VK_SUCCESS) {
+				PrintVkError(result);
+				throw std::runtime_error("failed to create upload fence!");
+			}
+		}
+		uploadCommandBuffer = beginSingleTimeCommands();
+		return true;
+	}
+
+	bool uploadsOpen() const {
+		return uploadCommandBuffer != VK_NULL_HANDLE;
+	}
+
+	// Submits the upload batch and waits for its fence only, frames in flight keep running
+	void flushUploads() {
+		if (uploadCommandBuffer == VK_NULL_HANDLE) {
+			return;
+		}
+		vkEndCommandBuffer(uploadCommandBuffer);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &uploadCommandBuffer;
+		VkResult result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, uploadFence);
+		if (result != VK_SUCCESS) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to submit upload batch!");
+		}
+		vkWaitForFences(device, 1, &uploadFence, VK_TRUE, UINT64_MAX);
+		vkResetFences(device, 1, &uploadFence);
+
+		vkFreeCommandBuffers(device, commandPool, 1, &uploadCommandBuffer);
+		uploadCommandBuffer = VK_NULL_HANDLE;
+
+		// the copies are done, no staging memory outlives its batch
+		for (auto &chunk: stagingChunks) {
+			destroyStagingChunk(chunk);
+		}
+		stagingChunks.clear();
+		stagingOffset = 0;
+	}
+
+	// Mapped staging memory for size bytes, valid until the open batch is flushed
+	void *stageUpload(VkDeviceSize size, VkBuffer &buffer, VkDeviceSize &offset) {
+		if (!uploadsOpen()) {
+			throw std::runtime_error("stageUpload called outside of an upload batch!");
+		}
+		// copies need offsets aligned to the texel size, 16 covers every format used here
+		VkDeviceSize alignedOffset = (stagingOffset + 15) & ~(VkDeviceSize) 15;
+		if (stagingChunks.empty() || alignedOffset + size > stagingChunks.back().size) {
+			VkDeviceSize chunkSize = stagingChunks.empty() ? FIRST_STAGING_CHUNK_SIZE
+								   : std::min(2 * stagingChunks.back().size, STAGING_CHUNK_SIZE);
+			stagingChunks.push_back(createStagingChunk(std::max(chunkSize, size)));
+			alignedOffset = 0;
+		}
+		StagingChunk &chunk = stagingChunks.back();
+		buffer = chunk.buffer;
+		offset = alignedOffset;
+		stagingOffset = alignedOffset + size;
+		return static_cast<char *>(chunk.data) + alignedOffset;
+	}
+
+	// Copies data into a device local buffer through the staging arena
+	void uploadToBuffer(VkBuffer dstBuffer, const void *data, VkDeviceSize size,
+						VkDeviceSize dstOffset = 0) {
+		bool ownsUploads = beginUploads();
+		VkBuffer stagingBuffer;
+		VkDeviceSize stagingBufferOffset;
+		memcpy(stageUpload(size, stagingBuffer, stagingBufferOffset), data, static_cast<size_t>(size));
+
+		VkBufferCopy region{};
+		region.srcOffset = stagingBufferOffset;
+		region.dstOffset = dstOffset;
+		region.size = size;
+		vkCmdCopyBuffer(uploadCommandBuffer, stagingBuffer, dstBuffer, 1, &region);
+
+		// vertex, index and storage reads of later frames and compute passes
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+								VK_ACCESS_SHADER_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = dstBuffer;
+		barrier.offset = dstOffset;
+		barrier.size = size;
+		vkCmdPipelineBarrier(uploadCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+							 VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+							 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+							 0, nullptr, 1, &barrier, 0, nullptr);
+
+		if (ownsUploads) {
+			flushUploads();
+		}
+	}
+
+	// The batch's command buffer when one is open, else a single time one
+	VkCommandBuffer beginUploadCommands() {
+		return uploadsOpen() ? uploadCommandBuffer : beginSingleTimeCommands();
+	}
+
+	void endUploadCommands(VkCommandBuffer commandBuffer) {
+		if (commandBuffer != uploadCommandBuffer) {
+			endSingleTimeCommands(commandBuffer);
+		}
+	}
+
+	StagingChunk createStagingChunk(VkDeviceSize size) {
+		StagingChunk chunk{};
+		chunk.size = size;
+		createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					 chunk.buffer, chunk.memory);
+		vkMapMemory(device, chunk.memory, 0, size, 0, &chunk.data);
+		return chunk;
+	}
+
+	void destroyStagingChunk(StagingChunk &chunk) {
+		vkUnmapMemory(device, chunk.memory);
+		vkDestroyBuffer(device, chunk.buffer, nullptr);
+		vkFreeMemory(device, chunk.memory, nullptr);
+	}
+
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 					  VkMemoryPropertyFlags properties,
 					  VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
@@ -1513,6 +2964,17 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		vkBindBufferMemory(device, buffer, bufferMemory, 0);
 	}
 
+	// Global memory barrier between two stages, e.g. compute writes read by a later draw
+	void memoryBarrier(VkCommandBuffer commandBuffer,
+					   VkPipelineStageFlags srcStage, VkAccessFlags srcAccess,
+					   VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
 	uint32_t findMemoryType(uint32_t typeFilter,
 							VkMemoryPropertyFlags properties) {
 		 VkPhysicalDeviceMemoryProperties memProperties;
@@ -1529,29 +2991,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		throw std::runtime_error("failed to find suitable memory type!");
 	}
 
-	void createDescriptorPool() {
-		std::array<VkDescriptorPoolSize, 2> poolSizes{};
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(DPSZs.uniformBlocksInPool *
-															 swapChainImages.size());
-		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(DPSZs.texturesInPool *
-															 swapChainImages.size());
-
-		VkDescriptorPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());;
-		poolInfo.pPoolSizes = poolSizes.data();
-		poolInfo.maxSets = static_cast<uint32_t>(DPSZs.setsInPool * swapChainImages.size());
-
-		VkResult result = vkCreateDescriptorPool(device, &poolInfo, nullptr,
-									&descriptorPool);
-		if (result != VK_SUCCESS) {
-		 	PrintVkError(result);
-			throw std::runtime_error("failed to create descriptor pool!");
-		}
-	}
-
+	virtual void populateComputeCommandBuffer(VkCommandBuffer commandBuffer, int i) = 0;
 	virtual void populateCommandBuffer(VkCommandBuffer commandBuffer, int i) = 0;
 
     void createCommandBuffers() {
@@ -1570,48 +3010,149 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			throw std::runtime_error("failed to allocate command buffers!");
 		}
 
+		commandBufferDirty.assign(commandBuffers.size(), false);
 		for (size_t i = 0; i < commandBuffers.size(); i++) {
-			VkCommandBufferBeginInfo beginInfo{};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			beginInfo.flags = 0; // Optional
-			beginInfo.pInheritanceInfo = nullptr; // Optional
+			recordCommandBuffer(i);
+		}
+	}
 
-			if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) !=
-						VK_SUCCESS) {
-				throw std::runtime_error("failed to begin recording command buffer!");
-			}
+	void recordCommandBuffer(uint32_t i) {
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = 0; // Optional
+		beginInfo.pInheritanceInfo = nullptr; // Optional
 
-			VkRenderPassBeginInfo renderPassInfo{};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = renderPass;
-			renderPassInfo.framebuffer = swapChainFramebuffers[i];
-			renderPassInfo.renderArea.offset = {0, 0};
-			renderPassInfo.renderArea.extent = swapChainExtent;
+		// vkBeginCommandBuffer implicitly resets the buffer (the pool allows it)
+		if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) !=
+					VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer!");
+		}
 
-			std::array<VkClearValue, 2> clearValues{};
-			clearValues[0].color = initialBackgroundColor;
-			clearValues[1].depthStencil = {1.0f, 0};
+		gpuProfiler.beginRecording(i);
+		if (timestampQueryPool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(commandBuffers[i], timestampQueryPool, timestampsPerImage * i, timestampsPerImage);
+			vkCmdWriteTimestamp(commandBuffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+								timestampQueryPool, timestampsPerImage * i);
+		}
 
-			renderPassInfo.clearValueCount =
-							static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
+		// work that must run outside of the render pass (e.g. compute culling)
+		populateComputeCommandBuffer(commandBuffers[i], i);
+
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = renderPass;
+		renderPassInfo.framebuffer = swapChainFramebuffers[i];
+		renderPassInfo.renderArea.offset = {0, 0};
+		renderPassInfo.renderArea.extent = renderExtent;
+
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = initialBackgroundColor;
+		clearValues[1].depthStencil = {1.0f, 0};
+
+		renderPassInfo.clearValueCount =
+						static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+
+		if (statisticsQueryPool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(commandBuffers[i], statisticsQueryPool, i, 1);
+			vkCmdBeginQuery(commandBuffers[i], statisticsQueryPool, i, 0);
+			statisticsPixels[i] = (uint64_t) renderExtent.width * renderExtent.height *
+								  (quality.sampleShading ? msaaSamples : 1);
+		}
 
-			vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo,
-					VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo,
+				VK_SUBPASS_CONTENTS_INLINE);
 
+		// every pipeline takes viewport and scissor from here
+		VkViewport viewport{0.0f, 0.0f, (float) renderExtent.width, (float) renderExtent.height, 0.0f, 1.0f};
+		VkRect2D scissor{{0, 0}, renderExtent};
+		vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
 
-			populateCommandBuffer(commandBuffers[i], i);
 
+		populateCommandBuffer(commandBuffers[i], i);
 
-			vkCmdEndRenderPass(commandBuffers[i]);
 
-			if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to record command buffer!");
-			}
+		vkCmdEndRenderPass(commandBuffers[i]);
+		if (statisticsQueryPool != VK_NULL_HANDLE) {
+			vkCmdEndQuery(commandBuffers[i], statisticsQueryPool, i);
+		}
+
+		// measures the scene only: the blit waits for the swap chain image
+		if (timestampQueryPool != VK_NULL_HANDLE) {
+			vkCmdWriteTimestamp(commandBuffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+								timestampQueryPool, timestampsPerImage * i + 1);
+		}
+		blitToSwapChain(commandBuffers[i], i);
+
+		if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
+		commandBufferDirty[i] = false;
+	}
+
+	// Marks every per-image command buffer for re-recording. Each one is
+	// recorded again right before its next submit, once the image's previous
+	// submission has completed, so no device wait or swapchain rebuild is needed.
+	void invalidateCommandBuffers() {
+		std::fill(commandBufferDirty.begin(), commandBufferDirty.end(), true);
+	}
+
+	void invalidateCommandBuffer(uint32_t i) {
+		commandBufferDirty[i] = true;
+	}
+
+	// Profiler scope around the commands recorded in between, see GpuProfiler. Both timestamps are
+	// taken once the preceding commands have finished, so consecutive scopes split the frame
+	// instead of overlapping.
+	void beginGpuScope(VkCommandBuffer commandBuffer, uint32_t i, const std::string &name) {
+		if (timestampQueryPool == VK_NULL_HANDLE || !gpuProfiler.enabled) {
+			return;
+		}
+		int query = gpuProfiler.beginScope(i, name);
+		if (query >= 0) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+								timestampQueryPool, timestampsPerImage * i + 2 + query);
+		}
+	}
+
+	void endGpuScope(VkCommandBuffer commandBuffer, uint32_t i) {
+		if (timestampQueryPool == VK_NULL_HANDLE || !gpuProfiler.enabled) {
+			return;
 		}
+		int query = gpuProfiler.endScope(i);
+		if (query >= 0) {
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+								timestampQueryPool, timestampsPerImage * i + 2 + query);
+		}
+	}
+
+	// Makes room for every scope of the image's last recording, which is recorded again. Waits
+	// for the device, so only done the first time a scene has more scopes than the pool.
+	void growGpuProfiler(uint32_t image) {
+		uint32_t needed = gpuProfiler.maxScopes + gpuProfiler.getDropped(image);
+		uint32_t maxScopes = gpuProfiler.maxScopes;
+		while (maxScopes < needed) {
+			maxScopes *= 2;
+		}
+		std::cout << "GPU profiler: " << gpuProfiler.getDropped(image) << " scopes dropped, room for "
+				  << maxScopes << " scopes from now on\n";
+		vkDeviceWaitIdle(device);
+		vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+		gpuProfiler.maxScopes = maxScopes;
+		createTimestampQueryPool();
+		invalidateCommandBuffers();
+		recordCommandBuffer(image);
+	}
+
+	void setGpuProfiling(bool enabled) {
+		gpuProfiler.enabled = enabled && timestampQueryPool != VK_NULL_HANDLE;
+		gpuProfiler.results.clear();
+		invalidateCommandBuffers();
 	}
 
     void createSyncObjects() {
+    	frameInputTimes.resize(MAX_FRAMES_IN_FLIGHT);
     	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
     	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
@@ -1643,28 +3184,95 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	}
 
     void mainLoop() {
-        while (!glfwWindowShouldClose(window)){
-            glfwPollEvents();
+        while (running && (headless || !glfwWindowShouldClose(window))) {
+            // frameTime covers the whole iteration, limiter wait included, it drives the simulation
             auto tStart = std::chrono::high_resolution_clock::now();
-            drawFrame();
+            if (!headless) {
+                glfwPollEvents();
+            }
+            if (qualityChangePending) {
+                applyQuality();
+            }
+            if (simulationOnly) {
+                simulateFrame();
+            } else {
+                framePacing.wait();
+                drawFrame();
+            }
             frameCounter++;
             auto tEnd = std::chrono::high_resolution_clock::now();
             auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-            frameTime = (float)tDiff / 1000.0f;
-
+            frameWallTime = (float)tDiff / 1000.0f;
+            frameTime = fixedFrameTime > 0.0f ? fixedFrameTime : frameWallTime;
+            onFrameEnd();
         }
 
         vkDeviceWaitIdle(device);
     }
 
+	// Called after every frame, with frameTime and frameWallTime of that frame
+	virtual void onFrameEnd() {}
+
+	// A frame of a simulationOnly run, nothing is recorded or submitted
+	virtual void simulateFrame() {}
+
+	void setLowLatencyMode(bool enabled) {
+		lowLatencyMode = enabled;
+		latency.reset();
+	}
+
+	// Sleeps until the GPU is predicted to finish the last submitted frame, minus the time
+	// from input sampling to submit, then waits for that frame to really finish
+	void lowLatencyWait() {
+		size_t previousFrame = (currentFrame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT;
+		if (lastSubmitTime != std::chrono::steady_clock::time_point() &&
+			frameInputTimes[previousFrame] != std::chrono::steady_clock::time_point()) {
+			// with one frame queued the GPU starts right at submit
+			double sleepTime = gpuFrameTime - latency.inputToSubmit - lowLatencyMargin;
+			auto wakeUp = lastSubmitTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+								std::chrono::duration<double>(sleepTime));
+			if (sleepTime > 0.0 && wakeUp > std::chrono::steady_clock::now()) {
+				std::this_thread::sleep_until(wakeUp);
+			}
+		}
+		vkWaitForFences(device, 1, &inFlightFences[previousFrame], VK_TRUE, UINT64_MAX);
+		pollFrameCompletion();
+		// the events polled before the wait are stale by now
+		if (!headless) {
+			glfwPollEvents();
+		}
+	}
+
+	void pollFrameCompletion() {
+		auto now = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < frameInputTimes.size(); i++) {
+			if (frameInputTimes[i] != std::chrono::steady_clock::time_point() &&
+				vkGetFenceStatus(device, inFlightFences[i]) == VK_SUCCESS) {
+				latency.add(latency.inputToGpuComplete,
+							std::chrono::duration<double>(now - frameInputTimes[i]).count());
+				frameInputTimes[i] = std::chrono::steady_clock::time_point();
+			}
+		}
+	}
+
     void drawFrame() {
+		if (lowLatencyMode) {
+			lowLatencyWait();
+		}
 		vkWaitForFences(device, 1, &inFlightFences[currentFrame],
 						VK_TRUE, UINT64_MAX);
+		pollFrameCompletion();
 
 		uint32_t imageIndex;
 
-		VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
-				imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		VkResult result = VK_SUCCESS;
+		if (headless) {
+			imageIndex = nextHeadlessImage;
+			nextHeadlessImage = (nextHeadlessImage + 1) % swapChainImages.size();
+		} else {
+			result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX,
+					imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		}
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 			recreateSwapChain();
@@ -1676,23 +3284,34 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
 			vkWaitForFences(device, 1, &imagesInFlight[imageIndex],
 							VK_TRUE, UINT64_MAX);
+			pollFrameCompletion();
 		}
 		imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+		readFrameTimestamps(imageIndex);
+		readFrameStatistics(imageIndex);
 //        updateUniformBuffer
 		updateUniformBuffer(imageIndex);
+		if (commandBufferDirty[imageIndex]) {
+			recordCommandBuffer(imageIndex);
+			if (gpuProfiler.getDropped(imageIndex) > 0) {
+				growGpuProfiler(imageIndex);
+			}
+		}
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
+		// only the final blit writes the swap chain image
 		VkPipelineStageFlags waitStages[] =
-			{VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-		submitInfo.waitSemaphoreCount = 1;
+			{VK_PIPELINE_STAGE_TRANSFER_BIT};
+		// headless images are only ordered by the fences
+		submitInfo.waitSemaphoreCount = headless ? 0 : 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
 		submitInfo.pWaitDstStageMask = waitStages;
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
 		VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.signalSemaphoreCount = headless ? 0 : 1;
 		submitInfo.pSignalSemaphores = signalSemaphores;
 
 		vkResetFences(device, 1, &inFlightFences[currentFrame]);
@@ -1701,6 +3320,26 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 				inFlightFences[currentFrame]) != VK_SUCCESS) {
 			throw std::runtime_error("failed to submit draw command buffer!");
 		}
+		if (timestampQueryPool != VK_NULL_HANDLE) {
+			timestampsPending[imageIndex] = true;
+		}
+		if (statisticsQueryPool != VK_NULL_HANDLE) {
+			statisticsPending[imageIndex] = true;
+		}
+		lastImageIndex = imageIndex;
+		lastSubmitTime = std::chrono::steady_clock::now();
+		if (drawnInputTime != std::chrono::steady_clock::time_point()) {
+			frameInputTimes[currentFrame] = drawnInputTime;
+			latency.add(latency.inputToSubmit,
+						std::chrono::duration<double>(lastSubmitTime - drawnInputTime).count());
+		}
+
+		if (headless) {
+			framePacing.presented();
+			pollFrameCompletion();
+			currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+			return;
+		}
 
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1714,6 +3353,8 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		presentInfo.pResults = nullptr; // Optional
 
 		result = vkQueuePresentKHR(presentQueue, &presentInfo);
+		framePacing.presented();
+		pollFrameCompletion();
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
 			framebufferResized) {
@@ -1731,26 +3372,54 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	virtual void pipelinesAndDescriptorSetsCleanup() = 0;
 	virtual void localCleanup() = 0;
 
+	// Applied between two frames: samplers are recreated, and the render pass, attachments
+	// and pipelines are rebuilt for the new sample count
+	void setQuality(const QualitySettings &settings) {
+		pendingQuality = settings;
+		qualityChangePending = true;
+	}
+
+	void applyQuality() {
+		qualityChangePending = false;
+		vkDeviceWaitIdle(device);
+
+		quality = pendingQuality;
+		msaaSamples = getUsableSampleCount(quality.msaaSamples);
+		for (auto texture: textures) {
+			texture->updateSampler();
+		}
+		// the measured frame time belongs to the old settings
+		dynamicResolution.smoothedFrameTime = 0.0f;
+		dynamicResolution.cooldown = dynamicResolution.cooldownFrames;
+
+		std::cout << "Quality: " << quality.name << ", " << msaaSamples << "x MSAA\n";
+		recreateSwapChain();
+	}
+
     void recreateSwapChain() {
+    	// wait until a minimized window is visible again
     	int width = 0, height = 0;
-		glfwGetFramebufferSize(window, &width, &height);
-
-		while (width == 0 || height == 0) {
+		while (!headless && (width == 0 || height == 0)) {
 			glfwGetFramebufferSize(window, &width, &height);
-			glfwWaitEvents();
+			if (width == 0 || height == 0) {
+				glfwWaitEvents();
+			}
 		}
 
 		vkDeviceWaitIdle(device);
+		framePacing.restart();
 
     	cleanupSwapChain();
 
 		createSwapChain();
 		createImageViews();
 		createRenderPass();
+		createSceneResources();
 		createColorResources();
 		createDepthResources();
 		createFramebuffers();
-		createDescriptorPool();
+		createTimestampQueryPool();
+		createStatisticsQueryPool();
 
 		pipelinesAndDescriptorSetsInit();
 
@@ -1766,6 +3435,18 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 		vkDestroyImage(device, depthImage, nullptr);
 		vkFreeMemory(device, depthImageMemory, nullptr);
 
+		for (size_t i = 0; i < sceneImages.size(); i++) {
+			vkDestroyImageView(device, sceneImageViews[i], nullptr);
+			vkDestroyImage(device, sceneImages[i], nullptr);
+			vkFreeMemory(device, sceneImagesMemory[i], nullptr);
+		}
+		if (timestampQueryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+		}
+		if (statisticsQueryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, statisticsQueryPool, nullptr);
+		}
+
 		for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 			vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
 		}
@@ -1781,9 +3462,16 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			vkDestroyImageView(device, swapChainImageViews[i], nullptr);
 		}
 
-		vkDestroySwapchainKHR(device, swapChain, nullptr);
+		if (headless) {
+			for (size_t i = 0; i < swapChainImages.size(); i++) {
+				vkDestroyImage(device, swapChainImages[i], nullptr);
+				vkFreeMemory(device, headlessImagesMemory[i], nullptr);
+			}
+		} else {
+			vkDestroySwapchainKHR(device, swapChain, nullptr);
+		}
 
-		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+		descriptorAllocator.reset();
 	}
 
     void cleanup() {
@@ -1797,18 +3485,31 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			vkDestroyFence(device, inFlightFences[i], nullptr);
     	}
 
+		for (auto &chunk: stagingChunks) {
+			destroyStagingChunk(chunk);
+		}
+		if (uploadFence != VK_NULL_HANDLE) {
+			vkDestroyFence(device, uploadFence, nullptr);
+		}
     	vkDestroyCommandPool(device, commandPool, nullptr);
 
+		descriptorAllocator.cleanup();
+		objectCache.cleanup();
  		vkDestroyDevice(device, nullptr);
 
-		DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+		if (debugUtilsEnabled) {
+			DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
+		}
 
-		vkDestroySurfaceKHR(instance, surface, nullptr);
+		if (!headless) {
+			vkDestroySurfaceKHR(instance, surface, nullptr);
+		}
     	vkDestroyInstance(instance, nullptr);
 
-        glfwDestroyWindow(window);
-
-        glfwTerminate();
+		if (!headless) {
+        	glfwDestroyWindow(window);
+        	glfwTerminate();
+		}
     }
 
 	void RebuildPipeline() {
@@ -1820,106 +3521,119 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 	void handleGamePad(int id,  glm::vec3 &m, glm::vec3 &r, bool &fire) {
 		const float deadZone = 0.1f;
 
-		if(glfwJoystickIsGamepad(id)) {
-			GLFWgamepadstate state;
-			if (glfwGetGamepadState(id, &state)) {
-				if(fabs(state.axes[GLFW_GAMEPAD_AXIS_LEFT_X]) > deadZone) {
-					m.x += state.axes[GLFW_GAMEPAD_AXIS_LEFT_X];
-				}
-				if(fabs(state.axes[GLFW_GAMEPAD_AXIS_LEFT_Y]) > deadZone) {
-					m.z += state.axes[GLFW_GAMEPAD_AXIS_LEFT_Y];
-				}
-				if(fabs(state.axes[GLFW_GAMEPAD_AXIS_LEFT_TRIGGER]) > deadZone) {
-					m.y -= state.axes[GLFW_GAMEPAD_AXIS_LEFT_TRIGGER];
-				}
-				if(fabs(state.axes[GLFW_GAMEPAD_AXIS_RIGHT_TRIGGER]) > deadZone) {
-					m.y += state.axes[GLFW_GAMEPAD_AXIS_RIGHT_TRIGGER];
-				}
+		const GLFWgamepadstate *gamepad = input.getGamepad(id);
+		if (gamepad != nullptr) {
+			const GLFWgamepadstate &state = *gamepad;
+			if(fabs(state.axes[GLFW_GAMEPAD_AXIS_LEFT_X]) > deadZone) {
+				m.x += state.axes[GLFW_GAMEPAD_AXIS_LEFT_X];
+			}
+			if(fabs(state.axes[GLFW_GAMEPAD_AXIS_LEFT_Y]) > deadZone) {
+				m.z += state.axes[GLFW_GAMEPAD_AXIS_LEFT_Y];
+			}
+			if(fabs(state.axes[GLFW_GAMEPAD_AXIS_LEFT_TRIGGER]) > deadZone) {
+				m.y -= state.axes[GLFW_GAMEPAD_AXIS_LEFT_TRIGGER];
+			}
+			if(fabs(state.axes[GLFW_GAMEPAD_AXIS_RIGHT_TRIGGER]) > deadZone) {
+				m.y += state.axes[GLFW_GAMEPAD_AXIS_RIGHT_TRIGGER];
+			}
 
-				if(fabs(state.axes[GLFW_GAMEPAD_AXIS_RIGHT_X]) > deadZone) {
-					r.y += state.axes[GLFW_GAMEPAD_AXIS_RIGHT_X];
-				}
-				if(fabs(state.axes[GLFW_GAMEPAD_AXIS_RIGHT_Y]) > deadZone) {
-					r.x += state.axes[GLFW_GAMEPAD_AXIS_RIGHT_Y];
-				}
-				r.z += state.buttons[GLFW_GAMEPAD_BUTTON_LEFT_BUMPER] ? 1.0f : 0.0f;
-				r.z -= state.buttons[GLFW_GAMEPAD_BUTTON_RIGHT_BUMPER] ? 1.0f : 0.0f;
-				fire = fire | (bool)state.buttons[GLFW_GAMEPAD_BUTTON_A] | (bool)state.buttons[GLFW_GAMEPAD_BUTTON_B];
+			if(fabs(state.axes[GLFW_GAMEPAD_AXIS_RIGHT_X]) > deadZone) {
+				r.y += state.axes[GLFW_GAMEPAD_AXIS_RIGHT_X];
 			}
+			if(fabs(state.axes[GLFW_GAMEPAD_AXIS_RIGHT_Y]) > deadZone) {
+				r.x += state.axes[GLFW_GAMEPAD_AXIS_RIGHT_Y];
+			}
+			r.z += state.buttons[GLFW_GAMEPAD_BUTTON_LEFT_BUMPER] ? 1.0f : 0.0f;
+			r.z -= state.buttons[GLFW_GAMEPAD_BUTTON_RIGHT_BUMPER] ? 1.0f : 0.0f;
+			fire = fire | (bool)state.buttons[GLFW_GAMEPAD_BUTTON_A] | (bool)state.buttons[GLFW_GAMEPAD_BUTTON_B];
 		}
 	}
 
-	void getSixAxis(float &deltaT,
-					glm::vec3 &m,
-					glm::vec3 &r,
-					bool &fire) {
-
+	// Main thread, after glfwPollEvents: returns the time since the last call and queues the state
+	// of the connected gamepads, which GLFW has no callbacks for
+	float sampleInput() {
 		static auto startTime = std::chrono::high_resolution_clock::now();
 		static float lastTime = 0.0f;
+		inputSampleTime = std::chrono::steady_clock::now();
+		drawnInputTime = inputSampleTime;
+		// no input devices without a window, animations follow frameTime
+		if (headless) {
+			return frameTime;
+		}
 
 		auto currentTime = std::chrono::high_resolution_clock::now();
 		float time = std::chrono::duration<float, std::chrono::seconds::period>
 					(currentTime - startTime).count();
-		deltaT = time - lastTime;
+		float deltaT = time - lastTime;
 		lastTime = time;
 
-		static double old_xpos = 0, old_ypos = 0;
-		double xpos, ypos;
-		glfwGetCursorPos(window, &xpos, &ypos);
-		double m_dx = xpos - old_xpos;
-		double m_dy = ypos - old_ypos;
-		old_xpos = xpos; old_ypos = ypos;
+		for (int id = 0; id < InputState::GAMEPAD_COUNT; id++) {
+			InputEvent event{INPUT_GAMEPAD, id, GLFW_CONNECTED};
+			if (connectedGamepads[id] && glfwGetGamepadState(GLFW_JOYSTICK_1 + id, &event.gamepad)) {
+				inputEvents.push(event);
+			}
+		}
+		return deltaT;
+	}
+
+	// Applies the queued events to input, on the thread that runs the simulation
+	void drainInput() {
+		input.drain(inputEvents);
+	}
 
+	// Movement and rotation axes of state, as drained from the input events
+	void getSixAxis(const InputState &state,
+					glm::vec3 &m,
+					glm::vec3 &r,
+					bool &fire) {
 		const float MOUSE_RES = 10.0f;
-		glfwSetInputMode(window, GLFW_STICKY_MOUSE_BUTTONS, GLFW_TRUE);
-		if(glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-			r.y = -m_dx / MOUSE_RES;
-			r.x = -m_dy / MOUSE_RES;
+		if(state.isMouseDown(GLFW_MOUSE_BUTTON_LEFT)) {
+			r.y = -state.cursorDelta.x / MOUSE_RES;
+			r.x = -state.cursorDelta.y / MOUSE_RES;
 		}
 
-		if(glfwGetKey(window, GLFW_KEY_LEFT)) {
+		if(state.isDown(GLFW_KEY_LEFT)) {
 			r.y = -1.0f;
 		}
-		if(glfwGetKey(window, GLFW_KEY_RIGHT)) {
+		if(state.isDown(GLFW_KEY_RIGHT)) {
 			r.y = 1.0f;
 		}
-		if(glfwGetKey(window, GLFW_KEY_UP)) {
+		if(state.isDown(GLFW_KEY_UP)) {
 			r.x = -1.0f;
 		}
-		if(glfwGetKey(window, GLFW_KEY_DOWN)) {
+		if(state.isDown(GLFW_KEY_DOWN)) {
 			r.x = 1.0f;
 		}
-		if(glfwGetKey(window, GLFW_KEY_Q)) {
+		if(state.isDown(GLFW_KEY_Q)) {
 			r.z = 1.0f;
 		}
-		if(glfwGetKey(window, GLFW_KEY_E)) {
+		if(state.isDown(GLFW_KEY_E)) {
 			r.z = -1.0f;
 		}
 
-		if(glfwGetKey(window, GLFW_KEY_A)) {
+		if(state.isDown(GLFW_KEY_A)) {
 			m.x = -1.0f;
 		}
-		if(glfwGetKey(window, GLFW_KEY_D)) {
+		if(state.isDown(GLFW_KEY_D)) {
 			m.x = 1.0f;
 		}
-		if(glfwGetKey(window, GLFW_KEY_S)) {
+		if(state.isDown(GLFW_KEY_S)) {
 			m.z = 1.0f;
 		}
-		if(glfwGetKey(window, GLFW_KEY_W)) {
+		if(state.isDown(GLFW_KEY_W)) {
 			m.z = -1.0f;
 		}
-		if(glfwGetKey(window, GLFW_KEY_R)) {
+		if(state.isDown(GLFW_KEY_R)) {
 			m.y = 1.0f;
 		}
-		if(glfwGetKey(window, GLFW_KEY_F)) {
+		if(state.isDown(GLFW_KEY_F)) {
 			m.y = -1.0f;
 		}
 
-		fire = glfwGetKey(window, GLFW_KEY_SPACE) | (glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS);
-		handleGamePad(GLFW_JOYSTICK_1,m,r,fire);
-		handleGamePad(GLFW_JOYSTICK_2,m,r,fire);
-		handleGamePad(GLFW_JOYSTICK_3,m,r,fire);
-		handleGamePad(GLFW_JOYSTICK_4,m,r,fire);
+		fire = state.isDown(GLFW_KEY_SPACE) || state.isMouseDown(GLFW_MOUSE_BUTTON_RIGHT);
+		for (int id = 0; id < InputState::GAMEPAD_COUNT; id++) {
+			handleGamePad(id, m, r, fire);
+		}
 	}
 
 	// Public part of the base class
@@ -2212,7 +3926,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			srcImage,
 			VK_ACCESS_MEMORY_READ_BIT,
 			VK_ACCESS_TRANSFER_READ_BIT,
-			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			swapChainImageLayout,
 			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
@@ -2283,7 +3997,7 @@ std::cout << "Starting createInstance()\n"  << std::flush;
 			VK_ACCESS_TRANSFER_READ_BIT,
 			VK_ACCESS_MEMORY_READ_BIT,
 			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			swapChainImageLayout,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VK_PIPELINE_STAGE_TRANSFER_BIT,
 			VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
@@ -2402,8 +4116,20 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 	Color.hasIt = false; Color.offset = 0;
 	Tangent.hasIt = false; Tangent.offset = 0;
 
-	if(B.size() == 1) {	// for now, read models only with every vertex information in a single binding
+	int vertexRateBindings = 0;
+	for(int i = 0; i < B.size(); i++) {
+		if(B[i].inputRate == VK_VERTEX_INPUT_RATE_VERTEX) {
+			vertexRateBindings++;
+		}
+	}
+
+	// for now, read models only with every vertex information in a single binding.
+	// Additional per-instance bindings are allowed, they are not filled from model files.
+	if(vertexRateBindings == 1 && B[0].inputRate == VK_VERTEX_INPUT_RATE_VERTEX) {
 		for(int i = 0; i < E.size(); i++) {
+			if(E[i].binding != B[0].binding) {
+				continue;
+			}
 			switch(E[i].usage) {
 			  case VertexDescriptorElementUsage::POSITION:
 			    if(E[i].format == VK_FORMAT_R32G32B32_SFLOAT) {
@@ -2823,29 +4549,23 @@ void Model::createVertexBuffer() {
 //	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 	VkDeviceSize bufferSize = vertices.size();
 
-	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+						VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 						vertexBuffer, vertexBufferMemory);
 
-	void* data;
-	vkMapMemory(BP->device, vertexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t) bufferSize);
-	vkUnmapMemory(BP->device, vertexBufferMemory);
+	BP->uploadToBuffer(vertexBuffer, vertices.data(), bufferSize);
 }
 
 void Model::createIndexBuffer() {
 	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
 
-	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-							 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+							 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+							 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 							 indexBuffer, indexBufferMemory);
 
-	void* data;
-	vkMapMemory(BP->device, indexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t) bufferSize);
-	vkUnmapMemory(BP->device, indexBufferMemory);
+	BP->uploadToBuffer(indexBuffer, indices.data(), bufferSize);
 }
 
 void Model::initMesh(BaseProject *bp, VertexDescriptor *vd) {
@@ -2928,21 +4648,15 @@ void Texture::createTextureImage(std::vector<std::string> files, VkFormat Fmt =
     mipLevels = static_cast<uint32_t>(std::floor(
                     std::log2(std::max(texWidth, texHeight)))) + 1;
 
+    // records into the scene's upload batch when one is open, else into its own
+    bool ownsUploads = BP->beginUploads();
     VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-
-    BP->createBuffer(totalImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                     stagingBuffer, stagingBufferMemory);
-    void *data;
-    vkMapMemory(BP->device, stagingBufferMemory, 0, totalImageSize, 0, &data);
+    VkDeviceSize stagingOffset;
+    void *data = BP->stageUpload(totalImageSize, stagingBuffer, stagingOffset);
     for (int i = 0; i < imgs; i++) {
         memcpy(static_cast<char *>(data) + imageSize * i, pixels[i], static_cast<size_t>(imageSize));
         stbi_image_free(pixels[i]);
     }
-    vkUnmapMemory(BP->device, stagingBufferMemory);
-
 
     BP->createImage(texWidth, texHeight, mipLevels, imgs, VK_SAMPLE_COUNT_1_BIT, Fmt,
                     VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
@@ -2954,13 +4668,14 @@ void Texture::createTextureImage(std::vector<std::string> files, VkFormat Fmt =
     BP->transitionImageLayout(textureImage, Fmt,
                               VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, imgs);
     BP->copyBufferToImage(stagingBuffer, textureImage,
-                          static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), imgs);
+                          static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), imgs, stagingOffset);
 
     BP->generateMipmaps(textureImage, Fmt,
                         texWidth, texHeight, mipLevels, imgs);
 
-    vkDestroyBuffer(BP->device, stagingBuffer, nullptr);
-    vkFreeMemory(BP->device, stagingBufferMemory, nullptr);
+    if (ownsUploads) {
+        BP->flushUploads();
+    }
 }
 
 void Texture::createTextureImageView(VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB) {
@@ -2982,30 +4697,62 @@ void Texture::createTextureSampler(
     float maxAnisotropy = 16,
     float maxLod = -1
 ) {
-    VkSamplerCreateInfo samplerInfo{};
-    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.magFilter = magFilter;
-    samplerInfo.minFilter = minFilter;
-    samplerInfo.addressModeU = addressModeU;
-    samplerInfo.addressModeV = addressModeV;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.anisotropyEnable = anisotropyEnable;
-    samplerInfo.maxAnisotropy = maxAnisotropy;
-    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-    samplerInfo.unnormalizedCoordinates = VK_FALSE;
-    samplerInfo.compareEnable = VK_FALSE;
-    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-    samplerInfo.mipmapMode = mipmapMode;
-    samplerInfo.mipLodBias = 0.0f;
-    samplerInfo.minLod = 0.0f;
-    samplerInfo.maxLod = ((maxLod == -1) ? static_cast<float>(mipLevels) : maxLod);
-
-    VkResult result = vkCreateSampler(BP->device, &samplerInfo, nullptr,
-                                      &textureSampler);
-    if (result != VK_SUCCESS) {
-        PrintVkError(result);
-        throw std::runtime_error("failed to create texture sampler!");
+    samplerSettings = {};
+    samplerSettings.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerSettings.magFilter = magFilter;
+    samplerSettings.minFilter = minFilter;
+    samplerSettings.addressModeU = addressModeU;
+    samplerSettings.addressModeV = addressModeV;
+    samplerSettings.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerSettings.anisotropyEnable = anisotropyEnable;
+    samplerSettings.maxAnisotropy = maxAnisotropy;
+    samplerSettings.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    samplerSettings.unnormalizedCoordinates = VK_FALSE;
+    samplerSettings.compareEnable = VK_FALSE;
+    samplerSettings.compareOp = VK_COMPARE_OP_ALWAYS;
+    samplerSettings.mipmapMode = mipmapMode;
+    samplerSettings.mipLodBias = 0.0f;
+    samplerSettings.minLod = 0.0f;
+    samplerSettings.maxLod = ((maxLod == -1) ? static_cast<float>(mipLevels) : maxLod);
+
+    createSampler();
+    if (!hasSampler) {
+        hasSampler = true;
+        BP->textures.push_back(this);
+    }
+}
+
+void Texture::createSampler() {
+    VkSamplerCreateInfo samplerInfo = samplerSettings;
+    const QualitySettings &quality = BP->quality;
+
+    samplerInfo.maxAnisotropy = std::min({samplerInfo.maxAnisotropy, quality.maxAnisotropy,
+                                          BP->maxSamplerAnisotropy});
+    if (samplerInfo.maxAnisotropy <= 1.0f) {
+        samplerInfo.anisotropyEnable = VK_FALSE;
+    }
+    samplerInfo.mipLodBias = quality.mipLodBias;
+
+    uint32_t maxSize = skyBox ? quality.maxSkyBoxSize : quality.maxTextureSize;
+    if (maxSize > 0) {
+        // mip 0 is about 2^(mipLevels - 1) texels wide, skip the mips above maxSize
+        float skippedMips = static_cast<float>(mipLevels - 1) - std::log2(static_cast<float>(maxSize));
+        samplerInfo.minLod = std::clamp(skippedMips, 0.0f, samplerInfo.maxLod);
+    }
+    // the image view already ends at the last mip, so textures of any size share the sampler
+    if (samplerInfo.maxLod >= static_cast<float>(mipLevels - 1)) {
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    }
+
+    textureSampler = BP->objectCache.getSampler(samplerInfo);
+}
+
+void Texture::updateSampler() {
+    if (!hasSampler) {
+        return;
     }
+    BP->objectCache.releaseSampler(textureSampler);
+    createSampler();
 }
 
 
@@ -3034,7 +4781,11 @@ void Texture::initCubic(BaseProject *bp, std::vector<std::string> files, VkForma
 
 
 void Texture::cleanup() {
-    vkDestroySampler(BP->device, textureSampler, nullptr);
+    if (hasSampler) {
+        BP->textures.erase(std::remove(BP->textures.begin(), BP->textures.end(), this), BP->textures.end());
+        hasSampler = false;
+    }
+    BP->objectCache.releaseSampler(textureSampler);
     vkDestroyImageView(BP->device, textureImageView, nullptr);
     vkDestroyImage(BP->device, textureImage, nullptr);
     vkFreeMemory(BP->device, textureImageMemory, nullptr);
@@ -3051,18 +4802,23 @@ void Pipeline::init(BaseProject *bp, VertexDescriptor *vd,
 	VD = vd;
 
 	auto vertShaderCode = readFile(VertShader);
-	auto fragShaderCode = readFile(FragShader);
 
 
 	vertShaderModule =
 			createShaderModule(vertShaderCode);
-	fragShaderModule =
-			createShaderModule(fragShaderCode);
+	// without a fragment shader the pipeline only writes depth
+	fragShaderModule = VK_NULL_HANDLE;
+	if (!FragShader.empty()) {
+		auto fragShaderCode = readFile(FragShader);
+		fragShaderModule =
+				createShaderModule(fragShaderCode);
+	}
 
  	compareOp = VK_COMPARE_OP_LESS;
  	polyModel = VK_POLYGON_MODE_FILL;
  	CM = VK_CULL_MODE_BACK_BIT;
  	transp = false;
+	depthWrite = true;
 
 	D = d;
 }
@@ -3077,6 +4833,11 @@ void Pipeline::setAdvancedFeatures(VkCompareOp _compareOp,
  	transp = _transp;
 }
 
+// Pipelines drawn after a depth pre-pass test against its depth without writing it
+void Pipeline::setDepthWrite(bool _depthWrite) {
+	depthWrite = _depthWrite;
+}
+
 
 void Pipeline::create() {
 	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
@@ -3152,7 +4913,7 @@ void Pipeline::create() {
 	VkPipelineMultisampleStateCreateInfo multisampling{};
 	multisampling.sType =
 			VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	multisampling.sampleShadingEnable = VK_TRUE;
+	multisampling.sampleShadingEnable = BP->quality.sampleShading ? VK_TRUE : VK_FALSE;
 	multisampling.rasterizationSamples = BP->msaaSamples;
 	multisampling.minSampleShading = 1.0f; // Optional
 	multisampling.pSampleMask = nullptr; // Optional
@@ -3160,7 +4921,7 @@ void Pipeline::create() {
 	multisampling.alphaToOneEnable = VK_FALSE; // Optional
 
 	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-	colorBlendAttachment.colorWriteMask =
+	colorBlendAttachment.colorWriteMask = fragShaderModule == VK_NULL_HANDLE ? 0 :
 			VK_COLOR_COMPONENT_R_BIT |
 			VK_COLOR_COMPONENT_G_BIT |
 			VK_COLOR_COMPONENT_B_BIT |
@@ -3196,26 +4957,13 @@ void Pipeline::create() {
 		DSL[i] = D[i]->descriptorSetLayout;
 	}
 
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-	pipelineLayoutInfo.sType =
-		VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = DSL.size();
-	pipelineLayoutInfo.pSetLayouts = DSL.data();
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-
-	VkResult result = vkCreatePipelineLayout(BP->device, &pipelineLayoutInfo, nullptr,
-				&pipelineLayout);
-	if (result != VK_SUCCESS) {
-	 	PrintVkError(result);
-		throw std::runtime_error("failed to create pipeline layout!");
-	}
+	pipelineLayout = BP->objectCache.getPipelineLayout(DSL, pushConstantRanges);
 
 	VkPipelineDepthStencilStateCreateInfo depthStencil{};
 	depthStencil.sType =
 			VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = depthWrite ? VK_TRUE : VK_FALSE;
 	depthStencil.depthCompareOp = compareOp;
 	depthStencil.depthBoundsTestEnable = VK_FALSE;
 	depthStencil.minDepthBounds = 0.0f; // Optional
@@ -3227,7 +4975,7 @@ void Pipeline::create() {
 	VkGraphicsPipelineCreateInfo pipelineInfo{};
 	pipelineInfo.sType =
 			VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
+	pipelineInfo.stageCount = fragShaderModule == VK_NULL_HANDLE ? 1 : 2;
 	pipelineInfo.pStages = shaderStages;
 	pipelineInfo.pVertexInputState = &vertexInputInfo;
 	pipelineInfo.pInputAssemblyState = &inputAssembly;
@@ -3236,25 +4984,35 @@ void Pipeline::create() {
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pDepthStencilState = &depthStencil;
 	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = nullptr; // Optional
+	// the render extent follows the dynamic resolution scale without rebuilding pipelines
+	std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = pipelineLayout;
 	pipelineInfo.renderPass = BP->renderPass;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1; // Optional
 
-	result = vkCreateGraphicsPipelines(BP->device, VK_NULL_HANDLE, 1,
-			&pipelineInfo, nullptr, &graphicsPipeline);
-	if (result != VK_SUCCESS) {
-	 	PrintVkError(result);
-		throw std::runtime_error("failed to create graphics pipeline!");
-	}
+	graphicsPipeline = BP->objectCache.getGraphicsPipeline(pipelineInfo);
+}
 
+void Pipeline::addPushConstants(VkShaderStageFlags stages, uint32_t offset, uint32_t size) {
+	VkPushConstantRange range{};
+	range.stageFlags = stages;
+	range.offset = offset;
+	range.size = size;
+	pushConstantRanges.push_back(range);
 }
 
 void Pipeline::destroy() {
-	vkDestroyShaderModule(BP->device, fragShaderModule, nullptr);
-	vkDestroyShaderModule(BP->device, vertShaderModule, nullptr);
+	if (fragShaderModule != VK_NULL_HANDLE) {
+		BP->objectCache.releaseShaderModule(fragShaderModule);
+	}
+	BP->objectCache.releaseShaderModule(vertShaderModule);
 }
 
 void Pipeline::bind(VkCommandBuffer commandBuffer) {
@@ -3264,27 +5022,80 @@ void Pipeline::bind(VkCommandBuffer commandBuffer) {
 
 }
 
+void Pipeline::bind(VkCommandBuffer commandBuffer, BindState &state) {
+	state.bindPipeline(commandBuffer, graphicsPipeline);
+}
+
 VkShaderModule Pipeline::createShaderModule(const std::vector<char>& code) {
-	VkShaderModuleCreateInfo createInfo{};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	return BP->objectCache.getShaderModule(code);
+}
+
+void Pipeline::cleanup() {
+		BP->objectCache.releasePipeline(graphicsPipeline);
+		BP->objectCache.releasePipelineLayout(pipelineLayout);
+}
+
+void ComputePipeline::init(BaseProject *bp, const std::string& CompShader,
+						   std::vector<DescriptorSetLayout *> d) {
+	BP = bp;
+
+	auto compShaderCode = readFile(CompShader);
+	compShaderModule = BP->objectCache.getShaderModule(compShaderCode);
+
+	D = d;
+}
+
+void ComputePipeline::addPushConstants(uint32_t offset, uint32_t size) {
+	VkPushConstantRange range{};
+	range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	range.offset = offset;
+	range.size = size;
+	pushConstantRanges.push_back(range);
+}
+
+void ComputePipeline::create() {
+	VkPipelineShaderStageCreateInfo compShaderStageInfo{};
+	compShaderStageInfo.sType =
+			VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	compShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	compShaderStageInfo.module = compShaderModule;
+	compShaderStageInfo.pName = "main";
+
+	std::vector<VkDescriptorSetLayout> DSL(D.size());
+	for(int i = 0; i < D.size(); i++) {
+		DSL[i] = D[i]->descriptorSetLayout;
+	}
+
+	pipelineLayout = BP->objectCache.getPipelineLayout(DSL, pushConstantRanges);
 
-	VkShaderModule shaderModule;
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = compShaderStageInfo;
+	pipelineInfo.layout = pipelineLayout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+	pipelineInfo.basePipelineIndex = -1; // Optional
 
-	VkResult result = vkCreateShaderModule(BP->device, &createInfo, nullptr,
-					&shaderModule);
+	VkResult result = vkCreateComputePipelines(BP->device, VK_NULL_HANDLE, 1,
+			&pipelineInfo, nullptr, &computePipeline);
 	if (result != VK_SUCCESS) {
 	 	PrintVkError(result);
-		throw std::runtime_error("failed to create shader module!");
+		throw std::runtime_error("failed to create compute pipeline!");
 	}
+}
 
-	return shaderModule;
+void ComputePipeline::destroy() {
+	BP->objectCache.releaseShaderModule(compShaderModule);
 }
 
-void Pipeline::cleanup() {
-		vkDestroyPipeline(BP->device, graphicsPipeline, nullptr);
-		vkDestroyPipelineLayout(BP->device, pipelineLayout, nullptr);
+void ComputePipeline::bind(VkCommandBuffer commandBuffer) {
+	vkCmdBindPipeline(commandBuffer,
+					  VK_PIPELINE_BIND_POINT_COMPUTE,
+					  computePipeline);
+}
+
+void ComputePipeline::cleanup() {
+		vkDestroyPipeline(BP->device, computePipeline, nullptr);
+		BP->objectCache.releasePipelineLayout(pipelineLayout);
 }
 
 void DescriptorSetLayout::init(BaseProject *bp, std::vector<DescriptorSetLayoutBinding> B) {
@@ -3305,21 +5116,50 @@ void DescriptorSetLayout::init(BaseProject *bp, std::vector<DescriptorSetLayoutB
 		}
 	}
 
-	VkDescriptorSetLayoutCreateInfo layoutInfo{};
-	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = static_cast<uint32_t>(binds.size());;
-	layoutInfo.pBindings = binds.data();
+	descriptorSetLayout = BP->objectCache.getDescriptorSetLayout(binds);
+
+	// DescriptorSet::init only fills uniform blocks and textures
+	std::vector<VkDescriptorUpdateTemplateEntry> entries;
+	templateSlots.assign(B.size(), 0);
+	templateSize = 0;
+	for(int i = 0; i < B.size(); i++) {
+		if((B[i].type != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) &&
+		   (B[i].type != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER)) {
+			continue;
+		}
+		VkDescriptorUpdateTemplateEntry entry{};
+		entry.dstBinding = B[i].binding;
+		entry.dstArrayElement = 0;
+		entry.descriptorCount = B[i].count;
+		entry.descriptorType = B[i].type;
+		entry.offset = templateSize * sizeof(DescriptorInfo);
+		entry.stride = sizeof(DescriptorInfo);
+		entries.push_back(entry);
+		templateSlots[i] = templateSize;
+		templateSize += B[i].count;
+	}
+	if(entries.empty()) {
+		return;
+	}
+
+	VkDescriptorUpdateTemplateCreateInfo templateInfo{};
+	templateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	templateInfo.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+	templateInfo.pDescriptorUpdateEntries = entries.data();
+	templateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+	templateInfo.descriptorSetLayout = descriptorSetLayout;
 
-	VkResult result = vkCreateDescriptorSetLayout(BP->device, &layoutInfo,
-								nullptr, &descriptorSetLayout);
+	VkResult result = vkCreateDescriptorUpdateTemplate(BP->device, &templateInfo, nullptr, &updateTemplate);
 	if (result != VK_SUCCESS) {
 		PrintVkError(result);
-		throw std::runtime_error("failed to create descriptor set layout!");
+		throw std::runtime_error("failed to create descriptor update template!");
 	}
 }
 
 void DescriptorSetLayout::cleanup() {
-    	vkDestroyDescriptorSetLayout(BP->device, descriptorSetLayout, nullptr);
+    	vkDestroyDescriptorUpdateTemplate(BP->device, updateTemplate, nullptr);
+    	updateTemplate = VK_NULL_HANDLE;
+    	BP->objectCache.releaseDescriptorSetLayout(descriptorSetLayout);
 }
 
 void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
@@ -3328,8 +5168,6 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
     Layout = DSL;
 
     int size = DSL->Bindings.size();
-    int imgInfoSize = DSL->imgInfoSize;
-    //std::cout << "imgInfoSize: " << imgInfoSize << "(" << size << ")\n";
 
     uniformBuffers.resize(size);
     uniformBuffersMemory.resize(size);
@@ -3357,60 +5195,31 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 
     std::vector<VkDescriptorSetLayout> layouts(BP->swapChainImages.size(),
                                                DSL->descriptorSetLayout);
-    VkDescriptorSetAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = BP->descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(BP->swapChainImages.size());
-    allocInfo.pSetLayouts = layouts.data();
-
     descriptorSets.resize(BP->swapChainImages.size());
-
-    VkResult result = vkAllocateDescriptorSets(BP->device, &allocInfo,
-                                               descriptorSets.data());
-    if (result != VK_SUCCESS) {
-        PrintVkError(result);
-        throw std::runtime_error("failed to allocate descriptor sets!");
+    BP->descriptorAllocator.allocate(layouts, descriptorSets.data());
+    if (DSL->updateTemplate == VK_NULL_HANDLE) {
+        return;
     }
 
+    // one template update per set instead of a write per binding
+    std::vector<DescriptorInfo> infos(DSL->templateSize);
     for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
-        std::vector<VkWriteDescriptorSet> descriptorWrites(size);
-        std::vector<VkDescriptorBufferInfo> bufferInfo(size);
-        std::vector<VkDescriptorImageInfo> imageInfo(imgInfoSize);
         for (int j = 0; j < size; j++) {
+            uint32_t slot = DSL->templateSlots[j];
             if (DSL->Bindings[j].type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
-                bufferInfo[j].buffer = uniformBuffers[j][i];
-                bufferInfo[j].offset = 0;
-                bufferInfo[j].range = DSL->Bindings[j].linkSize;
-
-                descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                descriptorWrites[j].dstSet = descriptorSets[i];
-                descriptorWrites[j].dstBinding = DSL->Bindings[j].binding;
-                descriptorWrites[j].dstArrayElement = 0;
-                descriptorWrites[j].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-                descriptorWrites[j].descriptorCount = DSL->Bindings[j].count;
-                descriptorWrites[j].pBufferInfo = &bufferInfo[j];
+                for (int k = 0; k < DSL->Bindings[j].count; k++) {
+                    infos[slot + k].buffer = {uniformBuffers[j][i], 0,
+                                              static_cast<VkDeviceSize>(DSL->Bindings[j].linkSize)};
+                }
             } else if (DSL->Bindings[j].type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
                 for (int k = 0; k < DSL->Bindings[j].count; k++) {
-                    int h = DSL->Bindings[j].linkSize + k;
-                    Texture *Tx = Txs[h];
-                    imageInfo[h].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-                    imageInfo[h].imageView = Tx->textureImageView;
-                    imageInfo[h].sampler = Tx->textureSampler;
+                    Texture *Tx = Txs[DSL->Bindings[j].linkSize + k];
+                    infos[slot + k].image = {Tx->textureSampler, Tx->textureImageView,
+                                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
                 }
-
-                descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                descriptorWrites[j].dstSet = descriptorSets[i];
-                descriptorWrites[j].dstBinding = DSL->Bindings[j].binding;
-                descriptorWrites[j].dstArrayElement = 0;
-                descriptorWrites[j].descriptorType =
-                        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-                descriptorWrites[j].descriptorCount = DSL->Bindings[j].count;
-                descriptorWrites[j].pImageInfo = &imageInfo[DSL->Bindings[j].linkSize];
             }
         }
-        vkUpdateDescriptorSets(BP->device,
-                               static_cast<uint32_t>(descriptorWrites.size()),
-                               descriptorWrites.data(), 0, nullptr);
+        vkUpdateDescriptorSetWithTemplate(BP->device, descriptorSets[i], DSL->updateTemplate, infos.data());
     }
 }
 
@@ -3434,6 +5243,11 @@ void DescriptorSet::bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId,
 					0, nullptr);
 }
 
+void DescriptorSet::bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId,
+						 int currentImage, BindState &state) {
+	state.bindDescriptorSet(commandBuffer, P.pipelineLayout, setId, descriptorSets[currentImage]);
+}
+
 void DescriptorSet::map(int currentImage, void *src, int slot) {
 	void* data;
 
@@ -58,9 +58,6 @@ struct TextMaker {
 		createTextDescriptorSetAndVertexLayout();
 		createTextPipeline();
 		createTextModelAndTexture();
-		
-		BP->DPSZs.texturesInPool += 1;
-		BP->DPSZs.setsInPool += 1;
 	}
 
 
@@ -3,16 +3,16 @@
 #include "render-system/render-system.hpp"
 #include "common.hpp"
 
-#define AnimatedSkin_MAX_JOINTS_COUNT 100
-
 struct AnimatedSkinUniformBufferObject {
     alignas(16) glm::mat4 model;
-    alignas(16) glm::mat4 jointTransformMatrices[AnimatedSkin_MAX_JOINTS_COUNT];
+    // first joint of the skin in the joint palettes
+    alignas(4) uint32_t jointOffset;
 };
 
 struct AnimatedSkinRenderSystemData {
     glm::mat4 model;
-    glm::mat4 jointTransformMatrices[AnimatedSkin_MAX_JOINTS_COUNT];
+    // the skin's joint matrices by palette index, see GltfSkinBase::getJointMatrices
+    const std::unordered_map<int, glm::mat4> *jointMatrices = nullptr;
 };
 
 struct AnimatedSkinSystemVertex {
@@ -55,56 +55,62 @@ struct AnimatedSkinSystemVertex {
 
 class AnimatedSkinRenderSystem : public RenderSystem<AnimatedSkinRenderSystemData, AnimatedSkinSystemVertex> {
 public:
-    AnimatedSkinRenderSystem(std::string pId) : RenderSystem(pId) {}
-
-    PoolSizes getPoolSizes() override {
-        PoolSizes poolSizes = {};
-        auto basePoolSizes = getBasePoolSizes();
-        poolSizes.uniformBlocksInPool = 1 + basePoolSizes.uniformBlocksInPool;
-        poolSizes.texturesInPool = 2 + basePoolSizes.texturesInPool;; // 1 for base texture
-        poolSizes.setsInPool = 1 + basePoolSizes.setsInPool;; // 1 for model, 1 for camera and light
-        return poolSizes;
+    AnimatedSkinRenderSystem(std::string pId) : RenderSystem(pId) {
+        skinningLayout = {sizeof(AnimatedSkinSystemVertex), offsetof(AnimatedSkinSystemVertex, pos), offsetof(AnimatedSkinSystemVertex, normal),
+                          offsetof(AnimatedSkinSystemVertex, uv), offsetof(AnimatedSkinSystemVertex, jointIndices),
+                          offsetof(AnimatedSkinSystemVertex, jointWeights), offsetof(AnimatedSkinSystemVertex, inTan)};
     }
 
     void pipelinesAndDescriptorSetsInit() override {
-        P.create();
+        createPipelines(P);
         DS.init(BP, &DSL, {&BaseTexture, &NormalTexture});
         GDS.init(BP, &GDSL, {});
     }
 
     void pipelinesAndDescriptorSetsCleanup() override {
-        P.cleanup();
+        cleanupPipelines(P);
         DS.cleanup();
         GDS.cleanup();
     }
 
 
-    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) override {
+    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, BindState &state) override {
 
-        P.bind(commandBuffer);
-        DS.bind(commandBuffer, P, SET_ID, currentImage);
+        P.bind(commandBuffer, state);
+        DS.bind(commandBuffer, P, SET_ID, currentImage, state);
 
-        GDS.bind(commandBuffer, P, GLOBAL_SET_ID, currentImage);
+        GDS.bind(commandBuffer, P, GLOBAL_SET_ID, currentImage, state);
+        if (gpuSkinning == nullptr) {
+            jointPalettes->bind(commandBuffer, P, JOINTS_SET_ID, currentImage, state);
+        }
 
+        bindVertexBuffers(commandBuffer, currentImage, state);
 
-        bindVertexBuffers(commandBuffer);
+    }
 
+    // the depth shader reads the model matrix from the system's own set
+    void populateDepthCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, BindState &state) override {
+        depthP.bind(commandBuffer, state);
+        DS.bind(commandBuffer, depthP, SET_ID, currentImage, state);
+        GDS.bind(commandBuffer, depthP, GLOBAL_SET_ID, currentImage, state);
+        bindDepthVertexBuffers(commandBuffer, currentImage, state);
     }
 
-    void updateUniformBuffers(uint32_t currentImage, AnimatedSkinRenderSystemData data) override {
+    void updateUniformBuffers(uint32_t currentImage, const AnimatedSkinRenderSystemData &data) override {
         AnimatedSkinUniformBufferObject ubo{};
         ubo.model = data.model;
-        for (int i = 0; i < AnimatedSkin_MAX_JOINTS_COUNT; i++) {
-            ubo.jointTransformMatrices[i] = data.jointTransformMatrices[i];
-        }
+        ubo.jointOffset = jointOffset;
 
         DS.map((int) currentImage, &ubo, MODEL_DATA_BINDING);
+        updateJoints(currentImage, data.model, *data.jointMatrices);
         updateGlobalBuffers(currentImage);
     }
 
 protected:
     std::string VERT_SHADER = "assets/shaders/bin/animated-skin.vert.spv";
     std::string FRAG_SHADER = "assets/shaders/bin/animated-skin.frag.spv";
+    // draws the output of the skinning pass
+    std::string STATIC_VERT_SHADER = "assets/shaders/bin/animated-skin-static.vert.spv";
 
     void localCleanup() override {
         P.destroy();
@@ -114,8 +120,12 @@ protected:
     }
 
     void localInit() override {
-        VD.init(BP, AnimatedSkinSystemVertex::getBindingDescription(),
-                AnimatedSkinSystemVertex::getDescriptorElements());
+        if (gpuSkinning != nullptr) {
+            VD.init(BP, SkinnedVertex::getBindingDescription(), SkinnedVertex::getDescriptorElements());
+        } else {
+            VD.init(BP, AnimatedSkinSystemVertex::getBindingDescription(),
+                    AnimatedSkinSystemVertex::getDescriptorElements());
+        }
         GDSL.init(BP, getGDSLBindings());
 
         DSL.init(BP, {
@@ -125,9 +135,19 @@ protected:
                 {NORMAL_TEXTURE_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 1,                                       1}
         });
 
-        P.init(BP, &VD, VERT_SHADER, FRAG_SHADER, {&GDSL, &DSL});
+        if (jointPalettes == nullptr) {
+            throw std::runtime_error("AnimatedSkinRenderSystem: joint palettes not set");
+        }
+        if (gpuSkinning != nullptr) {
+            P.init(BP, &VD, STATIC_VERT_SHADER, FRAG_SHADER, {&GDSL, &DSL});
+        } else {
+            // the vertex shader skins with the palette
+            P.init(BP, &VD, VERT_SHADER, FRAG_SHADER, {&GDSL, &DSL, &jointPalettes->DSL});
+        }
         P.setAdvancedFeatures(VK_COMPARE_OP_LESS_OR_EQUAL, VK_POLYGON_MODE_FILL,
                               cullMode, false);
+        // only with GPU skinning, the depth shader does not skin
+        initDepthPipeline({&GDSL, &DSL}, cullMode);
 
         initTextures();
         std::cout << "AnimatedSkinRenderSystem initialized" << std::endl;
@@ -143,6 +163,7 @@ private:
 
     int SET_ID = 1;
     int GLOBAL_SET_ID = 0;
+    int JOINTS_SET_ID = 2;
     uint32_t MODEL_DATA_BINDING = 0;
     uint32_t BASE_TEXTURE_BINDING = 1;
     uint32_t NORMAL_TEXTURE_BINDING = 2;
@@ -0,0 +1,387 @@
+#pragma once
+
+#include <functional>
+#include "modules/Starter.hpp"
+
+struct CullUniformBuffer {
+    alignas(16) glm::vec4 frustumPlanes[6];
+    // xyz: center in model space, w: radius
+    alignas(16) glm::vec4 boundingSphere;
+    alignas(4) uint32_t instanceCount;
+    // where the target's visible instances start in the shared instance buffer
+    alignas(4) uint32_t firstInstance;
+    // the target's command and draw count in the shared indirect buffers
+    alignas(4) uint32_t drawIndex;
+};
+
+// One instanced render system taking part in the culling pass, and where its geometry,
+// instances and draw command are in the shared buffers of the pass
+struct CulledInstances {
+    // the scene's instance group drawn by the system, see SceneBase::isVisible
+    std::string groupId;
+    uint32_t instanceCount;
+    uint32_t indexCount;
+    glm::vec4 boundingSphere;
+    uint32_t firstIndex = 0;
+    int32_t vertexOffset = 0;
+    uint32_t firstInstance = 0;
+    uint32_t drawIndex = 0;
+
+    // the system's model matrices, one per swap chain image
+    std::vector<VkBuffer> instanceBuffers;
+    // one of each per swap chain image
+    std::vector<VkBuffer> uniformBuffers;
+    std::vector<VkDeviceMemory> uniformBuffersMemory;
+    std::vector<void *> uniformBuffersMapped;
+    std::vector<VkDescriptorSet> descriptorSets;
+};
+
+/**
+ * Compute pre-pass that tests the bounding sphere of every instance against the camera frustum.
+ * The instanced render systems registered with addTarget share one vertex, position and index
+ * buffer, and per swap chain image one buffer of visible instances, one indirect buffer with a
+ * VkDrawIndexedIndirectCommand per system and one buffer with a draw count per system. Visible
+ * model matrices are compacted into the system's range of the instance buffer, the instance count
+ * of its command is incremented for each of them and its draw count set to 1 by the first one, so
+ * the render pass draws every system with one indirect call regardless of its instance count, and
+ * the systems with no visible instance draw nothing. Adjacent draws share the buffer binds.
+ */
+class GpuCulling {
+public:
+    std::string COMP_SHADER = "assets/shaders/bin/instance-cull.comp.spv";
+    const uint32_t WORKGROUP_SIZE = 64;
+
+    // targetCount: number of render systems that will be registered with addTarget
+    void init(BaseProject *bp, uint32_t targetCount) {
+        BP = bp;
+        imageCount = BP->swapChainImages.size();
+
+        DSL.init(BP, {
+                {CULL_DATA_BINDING,        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, sizeof(CullUniformBuffer), 1},
+                {INSTANCES_IN_BINDING,     VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0,                         1},
+                {INSTANCES_OUT_BINDING,    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0,                         1},
+                {DRAW_COMMAND_BINDING,     VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0,                         1},
+                {DRAW_COUNT_BINDING,       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0,                         1},
+        });
+        P.init(BP, COMP_SHADER, {&DSL});
+        P.create();
+
+        createDescriptorPool(targetCount);
+        initialized = true;
+    }
+
+    // Copies the system's geometry into the shared buffers, which are created by createBuffers
+    // once every target is added. The vertex offset indexes both the vertex and the position
+    // buffer, so a target's vertices start at a multiple of its vertex size.
+    template<typename TVertex>
+    CulledInstances *addTarget(const std::string &groupId, const std::vector<VkBuffer> &instanceBuffers,
+                               uint32_t instanceCount, glm::vec4 boundingSphere,
+                               const std::vector<TVertex> &vertices, const std::vector<uint32_t> &indices) {
+        auto target = new CulledInstances();
+        target->groupId = groupId;
+        target->instanceCount = instanceCount;
+        target->indexCount = static_cast<uint32_t>(indices.size());
+        target->boundingSphere = boundingSphere;
+        target->instanceBuffers = instanceBuffers;
+
+        size_t stride = sizeof(TVertex);
+        size_t vertexOffset = std::max((vertexData.size() + stride - 1) / stride, positionData.size());
+        vertexData.resize((vertexOffset + vertices.size()) * stride);
+        memcpy(vertexData.data() + vertexOffset * stride, vertices.data(), vertices.size() * stride);
+        positionData.resize(vertexOffset + vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            positionData[vertexOffset + i] = vertices[i].pos;
+        }
+        target->vertexOffset = static_cast<int32_t>(vertexOffset);
+        target->firstIndex = static_cast<uint32_t>(indexData.size());
+        indexData.insert(indexData.end(), indices.begin(), indices.end());
+
+        target->firstInstance = instanceTotal;
+        instanceTotal += instanceCount;
+        target->drawIndex = static_cast<uint32_t>(targets.size());
+        targets.push_back(target);
+        return target;
+    }
+
+    // Uploads the shared geometry and creates the per image buffers and sets, call after the last addTarget
+    void createBuffers() {
+        if (!initialized || targets.empty()) {
+            return;
+        }
+        createDeviceBuffer(vertexData.data(), vertexData.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                           vertexBuffer, vertexBufferMemory);
+        createDeviceBuffer(positionData.data(), sizeof(glm::vec3) * positionData.size(),
+                           VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, positionBuffer, positionBufferMemory);
+        createDeviceBuffer(indexData.data(), sizeof(uint32_t) * indexData.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                           indexBuffer, indexBufferMemory);
+        vertexData.clear();
+        vertexData.shrink_to_fit();
+        positionData.clear();
+        positionData.shrink_to_fit();
+        indexData.clear();
+        indexData.shrink_to_fit();
+
+        visibleBuffers.resize(imageCount);
+        visibleBuffersMemory.resize(imageCount);
+        indirectBuffers.resize(imageCount);
+        indirectBuffersMemory.resize(imageCount);
+        countBuffers.resize(imageCount);
+        countBuffersMemory.resize(imageCount);
+        for (size_t i = 0; i < imageCount; i++) {
+            BP->createBuffer(sizeof(glm::mat4) * instanceTotal,
+                             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             visibleBuffers[i], visibleBuffersMemory[i]);
+            BP->createBuffer(sizeof(VkDrawIndexedIndirectCommand) * targets.size(),
+                             VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             indirectBuffers[i], indirectBuffersMemory[i]);
+            BP->createBuffer(sizeof(uint32_t) * targets.size(),
+                             VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             countBuffers[i], countBuffersMemory[i]);
+        }
+
+        for (auto target: targets) {
+            target->uniformBuffers.resize(imageCount);
+            target->uniformBuffersMemory.resize(imageCount);
+            target->uniformBuffersMapped.resize(imageCount);
+            for (size_t i = 0; i < imageCount; i++) {
+                BP->createBuffer(sizeof(CullUniformBuffer), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 target->uniformBuffers[i], target->uniformBuffersMemory[i]);
+                vkMapMemory(BP->device, target->uniformBuffersMemory[i], 0, sizeof(CullUniformBuffer), 0,
+                            &target->uniformBuffersMapped[i]);
+            }
+            allocateDescriptorSets(target);
+        }
+    }
+
+    void update(uint32_t currentImage, const std::array<glm::vec4, 6> &frustumPlanes) {
+        if (!initialized) {
+            return;
+        }
+        CullUniformBuffer ubo{};
+        for (int p = 0; p < 6; p++) {
+            ubo.frustumPlanes[p] = frustumPlanes[p];
+        }
+        for (auto target: targets) {
+            ubo.boundingSphere = target->boundingSphere;
+            ubo.instanceCount = target->instanceCount;
+            ubo.firstInstance = target->firstInstance;
+            ubo.drawIndex = target->drawIndex;
+            memcpy(target->uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+        }
+    }
+
+    // Must be recorded outside of the render pass. The groups the scene does not draw, e.g. the
+    // ones its CPU culling found hidden, are not dispatched.
+    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage,
+                               const std::function<bool(const std::string &)> &isVisible) {
+        if (!initialized || targets.empty()) {
+            return;
+        }
+
+        std::vector<VkDrawIndexedIndirectCommand> commands(targets.size());
+        for (auto target: targets) {
+            VkDrawIndexedIndirectCommand &command = commands[target->drawIndex];
+            command.indexCount = target->indexCount;
+            command.instanceCount = 0;
+            command.firstIndex = target->firstIndex;
+            command.vertexOffset = target->vertexOffset;
+            command.firstInstance = target->firstInstance;
+        }
+        vkCmdUpdateBuffer(commandBuffer, indirectBuffers[currentImage], 0,
+                          sizeof(VkDrawIndexedIndirectCommand) * commands.size(), commands.data());
+        vkCmdFillBuffer(commandBuffer, countBuffers[currentImage], 0, VK_WHOLE_SIZE, 0);
+        BP->memoryBarrier(commandBuffer,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+        P.bind(commandBuffer);
+        for (auto target: targets) {
+            if (!isVisible(target->groupId)) {
+                continue;
+            }
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, P.pipelineLayout, 0, 1,
+                                    &target->descriptorSets[currentImage], 0, nullptr);
+            vkCmdDispatch(commandBuffer, (target->instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+        }
+
+        BP->memoryBarrier(commandBuffer,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                          VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+    }
+
+    // Draws the visible instances of a target, with only the positions for the depth pre-pass.
+    // vkCmdDrawIndexedIndirectCount skips the draw when none is visible, without it the command
+    // is drawn with an instance count of 0.
+    void draw(VkCommandBuffer commandBuffer, int currentImage, const CulledInstances *target, bool positionsOnly,
+              uint32_t instanceBinding, BindState &state) {
+        state.bindVertexBuffer(commandBuffer, 0, positionsOnly ? positionBuffer : vertexBuffer);
+        state.bindVertexBuffer(commandBuffer, instanceBinding, visibleBuffers[currentImage]);
+        state.bindIndexBuffer(commandBuffer, indexBuffer);
+
+        VkDeviceSize offset = sizeof(VkDrawIndexedIndirectCommand) * target->drawIndex;
+        if (BP->drawIndirectCountSupported) {
+            vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBuffers[currentImage], offset,
+                                          countBuffers[currentImage], sizeof(uint32_t) * target->drawIndex, 1,
+                                          sizeof(VkDrawIndexedIndirectCommand));
+        } else {
+            vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffers[currentImage], offset, 1,
+                                     sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+
+    void cleanup() {
+        if (!initialized) {
+            return;
+        }
+        for (auto target: targets) {
+            for (size_t i = 0; i < target->uniformBuffers.size(); i++) {
+                vkUnmapMemory(BP->device, target->uniformBuffersMemory[i]);
+                vkDestroyBuffer(BP->device, target->uniformBuffers[i], nullptr);
+                vkFreeMemory(BP->device, target->uniformBuffersMemory[i], nullptr);
+            }
+            delete target;
+        }
+        targets.clear();
+        for (size_t i = 0; i < visibleBuffers.size(); i++) {
+            vkDestroyBuffer(BP->device, visibleBuffers[i], nullptr);
+            vkFreeMemory(BP->device, visibleBuffersMemory[i], nullptr);
+            vkDestroyBuffer(BP->device, indirectBuffers[i], nullptr);
+            vkFreeMemory(BP->device, indirectBuffersMemory[i], nullptr);
+            vkDestroyBuffer(BP->device, countBuffers[i], nullptr);
+            vkFreeMemory(BP->device, countBuffersMemory[i], nullptr);
+        }
+        visibleBuffers.clear();
+        visibleBuffersMemory.clear();
+        indirectBuffers.clear();
+        indirectBuffersMemory.clear();
+        countBuffers.clear();
+        countBuffersMemory.clear();
+        vkDestroyBuffer(BP->device, vertexBuffer, nullptr);
+        vkFreeMemory(BP->device, vertexBufferMemory, nullptr);
+        vkDestroyBuffer(BP->device, positionBuffer, nullptr);
+        vkFreeMemory(BP->device, positionBufferMemory, nullptr);
+        vkDestroyBuffer(BP->device, indexBuffer, nullptr);
+        vkFreeMemory(BP->device, indexBufferMemory, nullptr);
+        vertexBuffer = positionBuffer = indexBuffer = VK_NULL_HANDLE;
+        vertexBufferMemory = positionBufferMemory = indexBufferMemory = VK_NULL_HANDLE;
+        instanceTotal = 0;
+
+        vkDestroyDescriptorPool(BP->device, descriptorPool, nullptr);
+        P.cleanup();
+        P.destroy();
+        DSL.cleanup();
+        initialized = false;
+    }
+
+private:
+    BaseProject *BP;
+    bool initialized = false;
+    size_t imageCount = 0;
+    ComputePipeline P;
+    DescriptorSetLayout DSL;
+    VkDescriptorPool descriptorPool{};
+    std::vector<CulledInstances *> targets;
+
+    // geometry of the targets added so far, uploaded by createBuffers
+    std::vector<char> vertexData;
+    std::vector<glm::vec3> positionData;
+    std::vector<uint32_t> indexData;
+    uint32_t instanceTotal = 0;
+
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory vertexBufferMemory = VK_NULL_HANDLE;
+    VkBuffer positionBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory positionBufferMemory = VK_NULL_HANDLE;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory indexBufferMemory = VK_NULL_HANDLE;
+    // one of each per swap chain image
+    std::vector<VkBuffer> visibleBuffers;
+    std::vector<VkDeviceMemory> visibleBuffersMemory;
+    std::vector<VkBuffer> indirectBuffers;
+    std::vector<VkDeviceMemory> indirectBuffersMemory;
+    std::vector<VkBuffer> countBuffers;
+    std::vector<VkDeviceMemory> countBuffersMemory;
+
+    const uint32_t CULL_DATA_BINDING = 0;
+    const uint32_t INSTANCES_IN_BINDING = 1;
+    const uint32_t INSTANCES_OUT_BINDING = 2;
+    const uint32_t DRAW_COMMAND_BINDING = 3;
+    const uint32_t DRAW_COUNT_BINDING = 4;
+
+    void createDeviceBuffer(const void *data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer &buffer,
+                            VkDeviceMemory &memory) {
+        BP->createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                         buffer, memory);
+        BP->uploadToBuffer(buffer, data, size);
+    }
+
+    // The culling sets do not depend on the swap chain, so they live in their own pool
+    // instead of the one recreated with it.
+    void createDescriptorPool(uint32_t targetCount) {
+        uint32_t setCount = std::max<uint32_t>(1, targetCount * imageCount);
+        std::array<VkDescriptorPoolSize, 2> poolSizes{};
+        poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        poolSizes[0].descriptorCount = setCount;
+        poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSizes[1].descriptorCount = 4 * setCount;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = setCount;
+
+        VkResult result = vkCreateDescriptorPool(BP->device, &poolInfo, nullptr, &descriptorPool);
+        if (result != VK_SUCCESS) {
+            PrintVkError(result);
+            throw std::runtime_error("failed to create culling descriptor pool!");
+        }
+    }
+
+    void allocateDescriptorSets(CulledInstances *target) {
+        std::vector<VkDescriptorSetLayout> layouts(imageCount, DSL.descriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(imageCount);
+        allocInfo.pSetLayouts = layouts.data();
+
+        target->descriptorSets.resize(imageCount);
+        VkResult result = vkAllocateDescriptorSets(BP->device, &allocInfo, target->descriptorSets.data());
+        if (result != VK_SUCCESS) {
+            PrintVkError(result);
+            throw std::runtime_error("failed to allocate culling descriptor sets!");
+        }
+
+        for (size_t i = 0; i < imageCount; i++) {
+            std::array<VkDescriptorBufferInfo, 5> bufferInfo{};
+            bufferInfo[0] = {target->uniformBuffers[i], 0, sizeof(CullUniformBuffer)};
+            bufferInfo[1] = {target->instanceBuffers[i], 0, VK_WHOLE_SIZE};
+            bufferInfo[2] = {visibleBuffers[i], 0, VK_WHOLE_SIZE};
+            bufferInfo[3] = {indirectBuffers[i], 0, VK_WHOLE_SIZE};
+            bufferInfo[4] = {countBuffers[i], 0, VK_WHOLE_SIZE};
+
+            std::array<VkWriteDescriptorSet, 5> descriptorWrites{};
+            for (uint32_t j = 0; j < descriptorWrites.size(); j++) {
+                descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[j].dstSet = target->descriptorSets[i];
+                descriptorWrites[j].dstBinding = j;
+                descriptorWrites[j].dstArrayElement = 0;
+                descriptorWrites[j].descriptorType = j == CULL_DATA_BINDING ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER
+                                                                           : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[j].descriptorCount = 1;
+                descriptorWrites[j].pBufferInfo = &bufferInfo[j];
+            }
+            vkUpdateDescriptorSets(BP->device, static_cast<uint32_t>(descriptorWrites.size()),
+                                   descriptorWrites.data(), 0, nullptr);
+        }
+    }
+};
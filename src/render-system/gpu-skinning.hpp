@@ -0,0 +1,294 @@
+#pragma once
+
+#include <cstring>
+#include "modules/Starter.hpp"
+#include "render-system/joint-palettes.hpp"
+
+// Byte offsets of the skinning inputs in a render system's vertex struct
+struct SkinningLayout {
+    uint32_t stride;
+    uint32_t pos;
+    uint32_t normal;
+    uint32_t uv;
+    uint32_t jointIndices;
+    uint32_t jointWeights;
+    uint32_t tangent;
+};
+
+// Vertex written by the skinning pass, in model space
+struct SkinnedVertex {
+    glm::vec4 pos;
+    glm::vec4 normal;
+    glm::vec4 uv;
+    glm::vec4 tangent;
+
+    static std::vector<VertexBindingDescriptorElement> getBindingDescription() {
+        return {
+                {0, sizeof(SkinnedVertex), VK_VERTEX_INPUT_RATE_VERTEX},
+        };
+    }
+
+    static std::vector<VertexDescriptorElement> getDescriptorElements() {
+        return {
+                {0, 0, VK_FORMAT_R32G32B32_SFLOAT,    static_cast<uint32_t>(offsetof(SkinnedVertex, pos)),     sizeof(glm::vec3), POSITION},
+                {0, 1, VK_FORMAT_R32G32B32_SFLOAT,    static_cast<uint32_t>(offsetof(SkinnedVertex, normal)),  sizeof(glm::vec3), NORMAL},
+                {0, 2, VK_FORMAT_R32G32_SFLOAT,       static_cast<uint32_t>(offsetof(SkinnedVertex, uv)),      sizeof(glm::vec2), UV},
+                {0, 3, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(offsetof(SkinnedVertex, tangent)), sizeof(glm::vec4), TANGENT},
+        };
+    }
+};
+
+// Matches the push constants of skinning.comp, offsets in 4-byte words
+struct SkinningPushConstants {
+    uint32_t vertexCount;
+    uint32_t stride;
+    uint32_t pos;
+    uint32_t normal;
+    uint32_t uv;
+    uint32_t jointIndices;
+    uint32_t jointWeights;
+    uint32_t tangent;
+    // first joint of the skin in the joint palettes
+    uint32_t jointOffset;
+};
+
+// GPU buffers and pose bookkeeping of one skinned render system
+struct SkinnedVertices {
+    SkinningPushConstants constants;
+    uint32_t jointCount;
+    VkBuffer sourceVertices;
+
+    // one of each per swap chain image
+    std::vector<VkBuffer> outputBuffers;
+    std::vector<VkDeviceMemory> outputBuffersMemory;
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    // incremented whenever the joint matrices change
+    uint64_t poseVersion = 0;
+    // pose held by each image's output buffer
+    std::vector<uint64_t> skinnedVersions;
+    // whether each image's command buffer was recorded with the dispatch
+    std::vector<bool> dispatches;
+    std::vector<glm::mat3x4> lastJoints;
+};
+
+/**
+ * Compute pre-pass that skins the vertices of each character once per frame into a device-local
+ * buffer, drawn afterwards with a static vertex pipeline. An image's output is only recomputed
+ * when the pose changed since that image was last skinned and the character is on screen;
+ * otherwise its dispatch is left out of the command buffer and the previous output is drawn.
+ */
+class GpuSkinning {
+public:
+    std::string COMP_SHADER = "assets/shaders/bin/skinning.comp.spv";
+    const uint32_t WORKGROUP_SIZE = 64;
+
+    // targetCount: number of render systems that will be registered with addTarget
+    void init(BaseProject *bp, uint32_t targetCount) {
+        BP = bp;
+        imageCount = BP->swapChainImages.size();
+
+        DSL.init(BP, {
+                {JOINTS_BINDING,       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0, 1},
+                {VERTICES_IN_BINDING,  VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0, 1},
+                {VERTICES_OUT_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0, 1},
+        });
+        P.init(BP, COMP_SHADER, {&DSL});
+        P.addPushConstants(0, sizeof(SkinningPushConstants));
+        P.create();
+
+        createDescriptorPool(targetCount);
+        initialized = true;
+    }
+
+    // sourceVertices must have been created with VK_BUFFER_USAGE_STORAGE_BUFFER_BIT. The pose is
+    // read from the skin's range of the palettes, [jointOffset, jointOffset + jointCount).
+    SkinnedVertices *addTarget(VkBuffer sourceVertices, uint32_t vertexCount, const SkinningLayout &layout,
+                               JointPalettes *palettes, uint32_t jointOffset, uint32_t jointCount) {
+        auto target = new SkinnedVertices();
+        target->constants = {vertexCount, layout.stride / 4, layout.pos / 4, layout.normal / 4, layout.uv / 4,
+                             layout.jointIndices / 4, layout.jointWeights / 4, layout.tangent / 4, jointOffset};
+        target->jointCount = jointCount;
+        target->sourceVertices = sourceVertices;
+        createOutputs(target, palettes);
+        targets.push_back(target);
+        return target;
+    }
+
+    // Follows a swap chain recreated with another number of images, call after palettes->resize()
+    void resize(JointPalettes *palettes) {
+        if (!initialized || BP->swapChainImages.size() == imageCount) {
+            return;
+        }
+        for (auto target: targets) {
+            destroyOutputs(target);
+        }
+        vkDestroyDescriptorPool(BP->device, descriptorPool, nullptr);
+        imageCount = BP->swapChainImages.size();
+        createDescriptorPool(static_cast<uint32_t>(targets.size()));
+        for (auto target: targets) {
+            createOutputs(target, palettes);
+        }
+    }
+
+    // Called every frame once the skin's palette of the image holds the current pose, joints
+    // points to it. Re-records the image's command buffer only when its dispatch has to be
+    // added or removed.
+    void update(SkinnedVertices *target, uint32_t currentImage, const glm::mat3x4 *joints, bool onScreen) {
+        if (target->lastJoints.empty() ||
+            std::memcmp(target->lastJoints.data(), joints, sizeof(glm::mat3x4) * target->jointCount) != 0) {
+            target->lastJoints.assign(joints, joints + target->jointCount);
+            target->poseVersion++;
+        }
+
+        bool dispatch = onScreen && target->skinnedVersions[currentImage] != target->poseVersion;
+        if (dispatch != target->dispatches[currentImage]) {
+            target->dispatches[currentImage] = dispatch;
+            BP->invalidateCommandBuffer(currentImage);
+        }
+        if (dispatch) {
+            target->skinnedVersions[currentImage] = target->poseVersion;
+        }
+    }
+
+    // Must be recorded outside of the render pass
+    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) {
+        if (!initialized) {
+            return;
+        }
+
+        bool recorded = false;
+        for (auto target: targets) {
+            if (!target->dispatches[currentImage]) {
+                continue;
+            }
+            if (!recorded) {
+                P.bind(commandBuffer);
+                recorded = true;
+            }
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, P.pipelineLayout, 0, 1,
+                                    &target->descriptorSets[currentImage], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, P.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                               sizeof(SkinningPushConstants), &target->constants);
+            vkCmdDispatch(commandBuffer, (target->constants.vertexCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+        }
+
+        if (recorded) {
+            BP->memoryBarrier(commandBuffer,
+                              VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+        }
+    }
+
+    void cleanup() {
+        if (!initialized) {
+            return;
+        }
+        for (auto target: targets) {
+            destroyOutputs(target);
+            delete target;
+        }
+        targets.clear();
+
+        vkDestroyDescriptorPool(BP->device, descriptorPool, nullptr);
+        P.cleanup();
+        P.destroy();
+        DSL.cleanup();
+        initialized = false;
+    }
+
+private:
+    BaseProject *BP;
+    bool initialized = false;
+    size_t imageCount = 0;
+    ComputePipeline P;
+    DescriptorSetLayout DSL;
+    VkDescriptorPool descriptorPool{};
+    std::vector<SkinnedVertices *> targets;
+
+    const uint32_t JOINTS_BINDING = 0;
+    const uint32_t VERTICES_IN_BINDING = 1;
+    const uint32_t VERTICES_OUT_BINDING = 2;
+
+    // Output buffers and descriptor sets of every image
+    void createOutputs(SkinnedVertices *target, JointPalettes *palettes) {
+        target->outputBuffers.resize(imageCount);
+        target->outputBuffersMemory.resize(imageCount);
+        // no image holds a skinned pose yet
+        target->skinnedVersions.assign(imageCount, UINT64_MAX);
+        target->dispatches.assign(imageCount, false);
+
+        for (size_t i = 0; i < imageCount; i++) {
+            BP->createBuffer(sizeof(SkinnedVertex) * target->constants.vertexCount,
+                             VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                             target->outputBuffers[i], target->outputBuffersMemory[i]);
+        }
+
+        allocateDescriptorSets(target, target->sourceVertices, palettes);
+    }
+
+    void destroyOutputs(SkinnedVertices *target) {
+        for (size_t i = 0; i < target->outputBuffers.size(); i++) {
+            vkDestroyBuffer(BP->device, target->outputBuffers[i], nullptr);
+            vkFreeMemory(BP->device, target->outputBuffersMemory[i], nullptr);
+        }
+        target->outputBuffers.clear();
+        target->outputBuffersMemory.clear();
+    }
+
+    void createDescriptorPool(uint32_t targetCount) {
+        uint32_t setCount = std::max<uint32_t>(1, targetCount * imageCount);
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = 3 * setCount;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = setCount;
+
+        VkResult result = vkCreateDescriptorPool(BP->device, &poolInfo, nullptr, &descriptorPool);
+        if (result != VK_SUCCESS) {
+            PrintVkError(result);
+            throw std::runtime_error("failed to create skinning descriptor pool!");
+        }
+    }
+
+    void allocateDescriptorSets(SkinnedVertices *target, VkBuffer sourceVertices, JointPalettes *palettes) {
+        std::vector<VkDescriptorSetLayout> layouts(imageCount, DSL.descriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(imageCount);
+        allocInfo.pSetLayouts = layouts.data();
+
+        target->descriptorSets.resize(imageCount);
+        VkResult result = vkAllocateDescriptorSets(BP->device, &allocInfo, target->descriptorSets.data());
+        if (result != VK_SUCCESS) {
+            PrintVkError(result);
+            throw std::runtime_error("failed to allocate skinning descriptor sets!");
+        }
+
+        for (size_t i = 0; i < imageCount; i++) {
+            std::array<VkDescriptorBufferInfo, 3> bufferInfo{};
+            bufferInfo[0] = {palettes->getBuffer(i), 0, VK_WHOLE_SIZE};
+            bufferInfo[1] = {sourceVertices, 0, VK_WHOLE_SIZE};
+            bufferInfo[2] = {target->outputBuffers[i], 0, VK_WHOLE_SIZE};
+
+            std::array<VkWriteDescriptorSet, 3> descriptorWrites{};
+            for (uint32_t j = 0; j < descriptorWrites.size(); j++) {
+                descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                descriptorWrites[j].dstSet = target->descriptorSets[i];
+                descriptorWrites[j].dstBinding = j;
+                descriptorWrites[j].dstArrayElement = 0;
+                descriptorWrites[j].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                descriptorWrites[j].descriptorCount = 1;
+                descriptorWrites[j].pBufferInfo = &bufferInfo[j];
+            }
+            vkUpdateDescriptorSets(BP->device, static_cast<uint32_t>(descriptorWrites.size()),
+                                   descriptorWrites.data(), 0, nullptr);
+        }
+    }
+};
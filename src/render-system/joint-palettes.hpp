@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstring>
+#include <unordered_map>
+#include "modules/Starter.hpp"
+
+/**
+ * Joint matrices of every skinned character of a scene, in one storage buffer per swap chain
+ * image bound as a set of its own. Each skin owns a range of jointCount entries starting at the
+ * offset returned by allocate(), so a pose uploads only the joints it has. Joint matrices are
+ * affine, so only their top three rows are stored: a mat3x4 in the shaders, applied as
+ * vec4(p, 1.0) * joint.
+ */
+class JointPalettes {
+public:
+    DescriptorSetLayout DSL;
+
+    // capacity: joints of all the skins that will call allocate
+    void init(BaseProject *bp, uint32_t capacity) {
+        BP = bp;
+        imageCount = BP->swapChainImages.size();
+        size = std::max<VkDeviceSize>(1, capacity) * sizeof(glm::mat3x4);
+        this->capacity = capacity;
+
+        createDescriptorSetLayout();
+        createBuffers();
+        createDescriptorSets();
+        initialized = true;
+    }
+
+    bool isInitialized() const {
+        return initialized;
+    }
+
+    // Follows a swap chain recreated with another number of images. The new buffers are empty
+    // until the next poses are written, returns false when nothing changed.
+    bool resize() {
+        if (!initialized || BP->swapChainImages.size() == imageCount) {
+            return false;
+        }
+        destroyBuffers();
+        vkDestroyDescriptorPool(BP->device, descriptorPool, nullptr);
+        imageCount = BP->swapChainImages.size();
+        createBuffers();
+        createDescriptorSets();
+        return true;
+    }
+
+    // Reserves the range of a skin, returns its first entry
+    uint32_t allocate(uint32_t jointCount) {
+        if (used + jointCount > capacity) {
+            throw std::runtime_error("JointPalettes: more than " + std::to_string(capacity) + " joints");
+        }
+        uint32_t offset = used;
+        used += jointCount;
+        return offset;
+    }
+
+    // Writes the pose of the skin owning [offset, offset + jointCount) into the image's buffer.
+    // Joints are keyed by their index in the palette, missing ones keep their previous value.
+    const glm::mat3x4 *write(uint32_t currentImage, uint32_t offset, uint32_t jointCount,
+                             const std::unordered_map<int, glm::mat4> &joints) {
+        glm::mat3x4 *palette = static_cast<glm::mat3x4 *>(buffersMapped[currentImage]) + offset;
+        for (const auto &[index, joint]: joints) {
+            if (index >= 0 && (uint32_t) index < jointCount) {
+                palette[index] = glm::mat3x4(glm::transpose(joint));
+            }
+        }
+        return palette;
+    }
+
+    VkBuffer getBuffer(uint32_t currentImage) const {
+        return buffers[currentImage];
+    }
+
+    void bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId, int currentImage, BindState &state) {
+        state.bindDescriptorSet(commandBuffer, P.pipelineLayout, setId, descriptorSets[currentImage]);
+    }
+
+    void cleanup() {
+        if (!initialized) {
+            return;
+        }
+        destroyBuffers();
+        vkDestroyDescriptorPool(BP->device, descriptorPool, nullptr);
+        DSL.cleanup();
+        used = 0;
+        initialized = false;
+    }
+
+private:
+    BaseProject *BP;
+    bool initialized = false;
+    size_t imageCount = 0;
+    uint32_t capacity = 0;
+    uint32_t used = 0;
+    VkDeviceSize size = 0;
+    std::vector<VkBuffer> buffers;
+    std::vector<VkDeviceMemory> buffersMemory;
+    std::vector<void *> buffersMapped;
+    VkDescriptorPool descriptorPool{};
+    std::vector<VkDescriptorSet> descriptorSets;
+
+    const uint32_t PALETTE_BINDING = 0;
+
+    void createDescriptorSetLayout() {
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = PALETTE_BINDING;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        binding.descriptorCount = 1;
+        binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        binding.pImmutableSamplers = nullptr;
+
+        DSL.descriptorSetLayout = BP->objectCache.getDescriptorSetLayout({binding});
+        DSL.BP = BP;
+        DSL.Bindings = {{PALETTE_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0, 1}};
+        DSL.imgInfoSize = 0;
+    }
+
+    void destroyBuffers() {
+        for (size_t i = 0; i < imageCount; i++) {
+            vkUnmapMemory(BP->device, buffersMemory[i]);
+            vkDestroyBuffer(BP->device, buffers[i], nullptr);
+            vkFreeMemory(BP->device, buffersMemory[i], nullptr);
+        }
+        buffers.clear();
+        buffersMemory.clear();
+        buffersMapped.clear();
+    }
+
+    void createBuffers() {
+        buffers.resize(imageCount);
+        buffersMemory.resize(imageCount);
+        buffersMapped.resize(imageCount);
+        for (size_t i = 0; i < imageCount; i++) {
+            // also read by the skinning pass
+            BP->createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             buffers[i], buffersMemory[i]);
+            vkMapMemory(BP->device, buffersMemory[i], 0, size, 0, &buffersMapped[i]);
+            memset(buffersMapped[i], 0, static_cast<size_t>(size));
+        }
+    }
+
+    // One set per swap chain image like the buffers, in a pool of their own so that they are
+    // only reallocated by resize, not every time the swap chain is recreated
+    void createDescriptorSets() {
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        poolSize.descriptorCount = static_cast<uint32_t>(imageCount);
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = static_cast<uint32_t>(imageCount);
+
+        VkResult result = vkCreateDescriptorPool(BP->device, &poolInfo, nullptr, &descriptorPool);
+        if (result != VK_SUCCESS) {
+            PrintVkError(result);
+            throw std::runtime_error("failed to create joint palette descriptor pool!");
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(imageCount, DSL.descriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = static_cast<uint32_t>(imageCount);
+        allocInfo.pSetLayouts = layouts.data();
+
+        descriptorSets.resize(imageCount);
+        result = vkAllocateDescriptorSets(BP->device, &allocInfo, descriptorSets.data());
+        if (result != VK_SUCCESS) {
+            PrintVkError(result);
+            throw std::runtime_error("failed to allocate joint palette descriptor sets!");
+        }
+
+        for (size_t i = 0; i < imageCount; i++) {
+            VkDescriptorBufferInfo bufferInfo{buffers[i], 0, VK_WHOLE_SIZE};
+            VkWriteDescriptorSet write{};
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = descriptorSets[i];
+            write.dstBinding = PALETTE_BINDING;
+            write.dstArrayElement = 0;
+            write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write.descriptorCount = 1;
+            write.pBufferInfo = &bufferInfo;
+            vkUpdateDescriptorSets(BP->device, 1, &write, 0, nullptr);
+        }
+    }
+};
@@ -3,16 +3,16 @@
 #include "render-system/render-system.hpp"
 #include "common.hpp"
 
-#define Pepsiman_MAX_JOINTS_COUNT 100
-
 struct PepsimanUniformBufferObject {
     alignas(16) glm::mat4 model;
-    alignas(16) glm::mat4 jointTransformMatrices[Pepsiman_MAX_JOINTS_COUNT];
+    // first joint of the skin in the joint palettes
+    alignas(4) uint32_t jointOffset;
 };
 
 struct PepsimanRenderSystemData {
     glm::mat4 model;
-    glm::mat4 jointTransformMatrices[Pepsiman_MAX_JOINTS_COUNT];
+    // the skin's joint matrices by palette index, see GltfSkinBase::getJointMatrices
+    const std::unordered_map<int, glm::mat4> *jointMatrices = nullptr;
 };
 
 struct PepsimanSystemVertex {
@@ -55,53 +55,60 @@ struct PepsimanSystemVertex {
 
 class PepsimanRenderSystem : public RenderSystem<PepsimanRenderSystemData, PepsimanSystemVertex> {
 public:
-    PepsimanRenderSystem(std::string pId) : RenderSystem(pId) {}
-
-    PoolSizes getPoolSizes() override {
-        PoolSizes poolSizes = {};
-        auto basePoolSizes = getBasePoolSizes();
-        poolSizes.uniformBlocksInPool = 1 + basePoolSizes.uniformBlocksInPool;
-        poolSizes.texturesInPool = 3 + basePoolSizes.texturesInPool;; // 1 for base texture
-        poolSizes.setsInPool = 1 + basePoolSizes.setsInPool;; // 1 for model, 1 for camera and light
-        return poolSizes;
+    PepsimanRenderSystem(std::string pId) : RenderSystem(pId) {
+        skinningLayout = {sizeof(PepsimanSystemVertex), offsetof(PepsimanSystemVertex, pos), offsetof(PepsimanSystemVertex, normal),
+                          offsetof(PepsimanSystemVertex, uv), offsetof(PepsimanSystemVertex, jointIndices),
+                          offsetof(PepsimanSystemVertex, jointWeights), offsetof(PepsimanSystemVertex, tangent)};
     }
 
     void pipelinesAndDescriptorSetsInit() override {
-        P.create();
+        createPipelines(P);
         DS.init(BP, &DSL, {&BaseTexture, &MetallicTexture, &NormalTexture});
         GDS.init(BP, &GDSL, {});
     }
 
     void pipelinesAndDescriptorSetsCleanup() override {
-        P.cleanup();
+        cleanupPipelines(P);
         DS.cleanup();
         GDS.cleanup();
     }
 
 
-    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) override {
-        P.bind(commandBuffer);
-        DS.bind(commandBuffer, P, SET_ID, currentImage);
-        GDS.bind(commandBuffer, P, GLOBAL_SET_ID, currentImage);
-        bindVertexBuffers(commandBuffer);
+    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, BindState &state) override {
+        P.bind(commandBuffer, state);
+        DS.bind(commandBuffer, P, SET_ID, currentImage, state);
+        GDS.bind(commandBuffer, P, GLOBAL_SET_ID, currentImage, state);
+        if (gpuSkinning == nullptr) {
+            jointPalettes->bind(commandBuffer, P, JOINTS_SET_ID, currentImage, state);
+        }
+        bindVertexBuffers(commandBuffer, currentImage, state);
 
 
     }
 
-    void updateUniformBuffers(uint32_t currentImage, PepsimanRenderSystemData data) override {
+    // the depth shader reads the model matrix from the system's own set
+    void populateDepthCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, BindState &state) override {
+        depthP.bind(commandBuffer, state);
+        DS.bind(commandBuffer, depthP, SET_ID, currentImage, state);
+        GDS.bind(commandBuffer, depthP, GLOBAL_SET_ID, currentImage, state);
+        bindDepthVertexBuffers(commandBuffer, currentImage, state);
+    }
+
+    void updateUniformBuffers(uint32_t currentImage, const PepsimanRenderSystemData &data) override {
         PepsimanUniformBufferObject ubo{};
         ubo.model = data.model;
-        for (int i = 0; i < Pepsiman_MAX_JOINTS_COUNT; i++) {
-            ubo.jointTransformMatrices[i] = data.jointTransformMatrices[i];
-        }
+        ubo.jointOffset = jointOffset;
 
         DS.map((int) currentImage, &ubo, MODEL_DATA_BINDING);
+        updateJoints(currentImage, data.model, *data.jointMatrices);
         updateGlobalBuffers(currentImage);
     }
 
 protected:
     std::string VERT_SHADER = "assets/shaders/bin/pepsiman.vert.spv";
     std::string FRAG_SHADER = "assets/shaders/bin/pepsiman.frag.spv";
+    // draws the output of the skinning pass
+    std::string STATIC_VERT_SHADER = "assets/shaders/bin/pepsiman-static.vert.spv";
 
     void localCleanup() override {
         P.destroy();
@@ -112,8 +119,12 @@ protected:
     }
 
     void localInit() override {
-        VD.init(BP, PepsimanSystemVertex::getBindingDescription(),
-                PepsimanSystemVertex::getDescriptorElements());
+        if (gpuSkinning != nullptr) {
+            VD.init(BP, SkinnedVertex::getBindingDescription(), SkinnedVertex::getDescriptorElements());
+        } else {
+            VD.init(BP, PepsimanSystemVertex::getBindingDescription(),
+                    PepsimanSystemVertex::getDescriptorElements());
+        }
         GDSL.init(BP, getGDSLBindings());
 
         DSL.init(BP, {
@@ -124,9 +135,19 @@ protected:
                 {NORMAL_TEXTURE_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2,                                       1},
         });
 
-        P.init(BP, &VD, VERT_SHADER, FRAG_SHADER, {&GDSL, &DSL});
+        if (jointPalettes == nullptr) {
+            throw std::runtime_error("PepsimanRenderSystem: joint palettes not set");
+        }
+        if (gpuSkinning != nullptr) {
+            P.init(BP, &VD, STATIC_VERT_SHADER, FRAG_SHADER, {&GDSL, &DSL});
+        } else {
+            // the vertex shader skins with the palette
+            P.init(BP, &VD, VERT_SHADER, FRAG_SHADER, {&GDSL, &DSL, &jointPalettes->DSL});
+        }
         P.setAdvancedFeatures(VK_COMPARE_OP_LESS_OR_EQUAL, VK_POLYGON_MODE_FILL,
                               cullMode, false);
+        // only with GPU skinning, the depth shader does not skin
+        initDepthPipeline({&GDSL, &DSL}, cullMode);
 
         initTextures();
         std::cout << "PepsimanRenderSystem initialized" << std::endl;
@@ -142,6 +163,7 @@ private:
 
     int SET_ID = 1;
     int GLOBAL_SET_ID = 0;
+    int JOINTS_SET_ID = 2;
     uint32_t MODEL_DATA_BINDING = 0;
     uint32_t BASE_TEXTURE_BINDING = 1;
     uint32_t METALLIC_TEXTURE_BINDING = 2;
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include "modules/Starter.hpp"
+
+// Passes are recorded in this order
+enum RenderPass {
+    // depth-only draws of the systems with a depth pre-pass, see RenderSystem::createPipelines
+    PASS_DEPTH = 0,
+    PASS_OPAQUE = 1,
+    PASS_SKYBOX = 2
+};
+
+struct DrawPacket {
+    uint64_t key;
+    // identifies the draw across frames, e.g. the render system that records it
+    const void *owner;
+    // GPU profiler scope of the draw
+    std::string name;
+    std::function<void(VkCommandBuffer, int, BindState &)> record;
+};
+
+/**
+ * Draws of a frame, recorded in the order of their 64-bit sort key:
+ *
+ *   | pass (4) | pipeline (12) | material (16) | depth (32) |
+ *
+ * so draws sharing a pipeline and then a material are adjacent, and opaque draws of the same
+ * material go roughly front to back. The depth is the exponent and top DEPTH_MANTISSA_BITS of a
+ * non-negative float distance, which sorts like the float itself: buckets a quarter of an octave
+ * wide, so the order, and with it the recorded command buffers, only changes when a draw moves
+ * noticeably closer or further. Draws in the same bucket keep the order they were pushed in.
+ */
+class RenderQueue {
+public:
+    static const uint32_t DEPTH_MANTISSA_BITS = 2;
+
+    static uint64_t makeKey(uint32_t pass, uint32_t pipeline, uint32_t material, float depth) {
+        uint32_t depthBits;
+        depth = std::max(depth, 0.0f);
+        std::memcpy(&depthBits, &depth, sizeof(depthBits));
+        depthBits >>= 23 - DEPTH_MANTISSA_BITS;
+        return (uint64_t(pass & 0xF) << 60) | (uint64_t(pipeline & 0xFFF) << 48) |
+               (uint64_t(material & 0xFFFF) << 32) | depthBits;
+    }
+
+    // Small stable id for a material key (e.g. the texture paths of a render system)
+    uint32_t getMaterialId(const std::string &materialKey) {
+        auto it = materialIds.find(materialKey);
+        if (it != materialIds.end()) {
+            return it->second;
+        }
+        uint32_t materialId = (uint32_t) materialIds.size();
+        materialIds[materialKey] = materialId;
+        return materialId;
+    }
+
+    void clear() {
+        packets.clear();
+    }
+
+    void push(uint64_t key, const void *owner, const std::string &name,
+              std::function<void(VkCommandBuffer, int, BindState &)> record) {
+        packets.push_back({key, owner, name, std::move(record)});
+    }
+
+    // LSD radix sort of the packets by key, 8 bits per pass. Passes where every key has the same
+    // digit are skipped. Returns true when the draw order differs from the previous sort, i.e.
+    // when recorded command buffers are out of date.
+    bool sort() {
+        size_t n = packets.size();
+        sorted.resize(n);
+        scratch.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            sorted[i] = {packets[i].key, (uint32_t) i};
+        }
+
+        for (int shift = 0; shift < 64 && n > 0; shift += 8) {
+            size_t counts[256] = {};
+            for (const auto &entry: sorted) {
+                counts[(entry.key >> shift) & 0xFF]++;
+            }
+            if (counts[(sorted[0].key >> shift) & 0xFF] == n) {
+                continue;
+            }
+            size_t offset = 0;
+            for (size_t &count: counts) {
+                size_t c = count;
+                count = offset;
+                offset += c;
+            }
+            for (const auto &entry: sorted) {
+                scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+            }
+            sorted.swap(scratch);
+        }
+
+        std::vector<const void *> owners(n);
+        for (size_t i = 0; i < n; i++) {
+            owners[i] = packets[sorted[i].index].owner;
+        }
+        bool changed = owners != sortedOwners;
+        sortedOwners.swap(owners);
+        return changed;
+    }
+
+    // Each draw is timed as its own GPU profiler scope. The draws share the bind state, so a draw
+    // skips the pipeline and sets the previous draws left bound, e.g. the table of its pipeline.
+    void record(VkCommandBuffer commandBuffer, int currentImage, BaseProject *BP) {
+        BindState state;
+        for (const auto &entry: sorted) {
+            const DrawPacket &packet = packets[entry.index];
+            BP->beginGpuScope(commandBuffer, currentImage, packet.name);
+            packet.record(commandBuffer, currentImage, state);
+            BP->endGpuScope(commandBuffer, currentImage);
+        }
+    }
+
+    size_t size() {
+        return packets.size();
+    }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<DrawPacket> packets;
+    std::vector<SortEntry> sorted;
+    std::vector<SortEntry> scratch;
+    std::vector<const void *> sortedOwners;
+    std::unordered_map<std::string, uint32_t> materialIds;
+};
@@ -4,6 +4,12 @@
 #include "camera.hpp"
 #include "light-object.hpp"
 #include "common.hpp"
+#include "render-system/gpu-culling.hpp"
+#include "render-system/texture-table.hpp"
+#include "render-system/gpu-skinning.hpp"
+#include "render-system/joint-palettes.hpp"
+#include "culling/frustum.hpp"
+#include <map>
 
 
 struct CameraUniformBuffer {
@@ -29,6 +35,26 @@ struct AmbientLightUniformBuffer {
     alignas(16) glm::vec3 czn = glm::vec3(1);
 };
 
+// Per-instance data, streamed through a VK_VERTEX_INPUT_RATE_INSTANCE binding
+struct InstanceData {
+    glm::mat4 model;
+
+    static VertexBindingDescriptorElement getBindingDescription(uint32_t binding) {
+        return {binding, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE};
+    }
+
+    // a mat4 attribute takes four consecutive locations, one per column
+    static std::vector<VertexDescriptorElement> getDescriptorElements(uint32_t binding, uint32_t firstLocation) {
+        std::vector<VertexDescriptorElement> elements;
+        for (uint32_t column = 0; column < 4; column++) {
+            elements.push_back({binding, firstLocation + column, VK_FORMAT_R32G32B32A32_SFLOAT,
+                                static_cast<uint32_t>(offsetof(InstanceData, model) + column * sizeof(glm::vec4)),
+                                sizeof(glm::vec4), OTHER});
+        }
+        return elements;
+    }
+};
+
 template<typename TRenderSystemData, typename TVertex>
 class RenderSystem {
 
@@ -36,14 +62,6 @@ public:
     RenderSystem(std::string pId) : id(pId) {
     }
 
-    PoolSizes getBasePoolSizes(){
-        PoolSizes poolSizes;
-        poolSizes.uniformBlocksInPool = 3;
-        poolSizes.texturesInPool = 0;
-        poolSizes.setsInPool = 1;
-
-        return poolSizes;
-    }
     void addVertices(std::vector<TVertex> verts, std::vector<uint32_t> inds) {
         vertices = verts;
         indices = inds;
@@ -57,21 +75,117 @@ public:
 
         localInit();
 
-        createVertexBuffer();
-        createIndexBuffer();
+        // culled systems draw from the shared buffers of the culling pass instead
+        if (gpuCulling == nullptr) {
+            createVertexBuffer();
+            createIndexBuffer();
+        }
+        if (!tableTextures.empty()) {
+            computeUvDensity();
+        }
+        if (depthPrePassSupported && gpuSkinning == nullptr && gpuCulling == nullptr) {
+            createPositionBuffer();
+        }
+        if (instanced) {
+            computeBoundingSphere();
+            createInstanceBuffers();
+        }
+        if (gpuCulling != nullptr) {
+            culledInstances = gpuCulling->addTarget(id, instanceBuffers, instanceCount, boundingSphere, vertices,
+                                                    indices);
+        }
+        if (gpuSkinning != nullptr) {
+            computeBoundingSphere();
+            skinnedVertices = gpuSkinning->addTarget(vertexBuffer, static_cast<uint32_t>(vertices.size()),
+                                                     skinningLayout, jointPalettes, jointOffset, jointCount);
+        }
+    }
+
+    // Instances are culled on the GPU and drawn indirectly from the culling output, with the mesh
+    // in the shared buffers of the pass. Only for instanced systems, must be set before init.
+    void setGpuCulling(GpuCulling *culling) {
+        if (instanced) {
+            gpuCulling = culling;
+        }
+    }
+
+    // Table the system registers its textures in, must be set before init by systems sampling it
+    void setTextureTable(TextureTable *table) {
+        textureTable = table;
+    }
+
+    // Reserves the system's range of the scene's joint palettes, sized to its skin.
+    // Required by the systems that fill skinningLayout, must be set before init.
+    void setJointPalettes(JointPalettes *palettes, uint32_t count) {
+        jointPalettes = palettes;
+        jointCount = count;
+        jointOffset = palettes->allocate(count);
+    }
+
+    // Skin the vertices in a compute pre-pass and draw them with a static vertex pipeline.
+    // Only for systems that fill skinningLayout, must be set before init, after setJointPalettes.
+    void setGpuSkinning(GpuSkinning *skinning) {
+        if (skinningLayout.stride == 0) {
+            throw std::runtime_error("RenderSystem " + id + ": vertex layout does not support GPU skinning");
+        }
+        if (jointPalettes == nullptr) {
+            throw std::runtime_error("RenderSystem " + id + ": GPU skinning needs the joint palettes");
+        }
+        gpuSkinning = skinning;
+    }
+
+    // Scene flag turning the depth pre-pass on, read whenever the pipelines are created, so a
+    // change takes effect with the next pipeline rebuild. Must be set before init.
+    void setDepthPrePass(bool *enabled) {
+        depthPrePass = enabled;
+    }
+
+    // Whether the current pipelines draw with the pre-pass, i.e. expect populateDepthCommandBuffer
+    // to be recorded before populateCommandBuffer
+    bool isDepthPrePassActive() {
+        return depthPrePassActive;
     }
 
-    virtual PoolSizes getPoolSizes() = 0;
+    // Asks the texture table for the mips of the system's textures when drawn at the given camera
+    // distance: the texels one pixel covers follow from the world size of a pixel at that distance
+    void requestTextureMips(float distance) {
+        if (tableTextures.empty() || uvDensity <= 0.0f) {
+            return;
+        }
+        float worldPerPixel = 2.0f * std::max(distance, camera->znear) * std::tan(camera->fov * 0.5f) /
+                              (float) BP->renderExtent.height;
+        float uvPerPixel = worldPerPixel * uvDensity / maxInstanceScale;
+        for (uint32_t index: tableTextures) {
+            textureTable->requestMip(index, uvPerPixel);
+        }
+    }
 
+    // Number of objects drawn with the shared vertex/index buffers, must be set before init
+    void setInstanceCount(uint32_t count) {
+        instanceCount = count;
+    }
+
+    uint32_t getInstanceCount() {
+        return instanceCount;
+    }
 
     virtual void pipelinesAndDescriptorSetsInit() = 0;
 
     virtual void pipelinesAndDescriptorSetsCleanup() = 0;
 
-    virtual void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) = 0;
+    // The state holds what the previous draws left bound, see RenderQueue::record
+    virtual void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, BindState &state) = 0;
+
+    // Depth-only draw of the pre-pass. Systems whose depth pipeline uses more than the global
+    // set override it.
+    virtual void populateDepthCommandBuffer(VkCommandBuffer commandBuffer, int currentImage, BindState &state) {
+        depthP.bind(commandBuffer, state);
+        GDS.bind(commandBuffer, depthP, 0, currentImage, state);
+        bindDepthVertexBuffers(commandBuffer, currentImage, state);
+    }
 
 
-    virtual void updateUniformBuffers(uint32_t currentImage, TRenderSystemData ubo) = 0;
+    virtual void updateUniformBuffers(uint32_t currentImage, const TRenderSystemData &ubo) = 0;
     void updateGlobalBuffers(uint32_t currentImage){
         CameraUniformBuffer ubo{};
         ubo.view = camera->matrices.view;
@@ -103,6 +217,24 @@ public:
         vkDestroyBuffer(BP->device, indexBuffer, nullptr);
         vkFreeMemory(BP->device, indexBufferMemory, nullptr);
 
+        if (positionBuffer != VK_NULL_HANDLE) {
+            vkDestroyBuffer(BP->device, positionBuffer, nullptr);
+            vkFreeMemory(BP->device, positionBufferMemory, nullptr);
+        }
+        if (depthPrePassSupported) {
+            depthP.destroy();
+            depthVD.cleanup();
+        }
+
+        for (size_t i = 0; i < instanceBuffers.size(); i++) {
+            vkUnmapMemory(BP->device, instanceBuffersMemory[i]);
+            vkDestroyBuffer(BP->device, instanceBuffers[i], nullptr);
+            vkFreeMemory(BP->device, instanceBuffersMemory[i], nullptr);
+        }
+        instanceBuffers.clear();
+        instanceBuffersMemory.clear();
+        instanceBuffersMapped.clear();
+
         VD.cleanup();
         GDSL.cleanup();
         localCleanup();
@@ -112,6 +244,19 @@ public:
         this->texturesInfo = texsInfo;
     }
 
+    // Systems with the same key bind the same textures
+    std::string getMaterialKey() {
+        std::map<std::string, std::string> paths;
+        for (const auto &[name, info]: texturesInfo) {
+            paths[name] = info.path;
+        }
+        std::string key;
+        for (const auto &[name, path]: paths) {
+            key += name + "=" + path + ";";
+        }
+        return key;
+    }
+
 protected:
 
     std::vector<DescriptorSetLayoutBinding> getGDSLBindings() {
@@ -145,6 +290,45 @@ protected:
     VkBuffer indexBuffer{};
     VkDeviceMemory indexBufferMemory{};
 
+    // set by subclasses whose vertex layout declares the InstanceData binding
+    bool instanced = false;
+    uint32_t instanceCount = 1;
+    const uint32_t INSTANCE_BINDING = 1;
+    // one buffer per swap chain image, like the uniform buffers of the descriptor sets
+    std::vector<VkBuffer> instanceBuffers;
+    std::vector<VkDeviceMemory> instanceBuffersMemory;
+    std::vector<void *> instanceBuffersMapped;
+    // model space bounding sphere of the mesh: xyz center, w radius
+    glm::vec4 boundingSphere = glm::vec4(0.0f);
+    GpuCulling *gpuCulling = nullptr;
+    CulledInstances *culledInstances = nullptr;
+    TextureTable *textureTable = nullptr;
+    // table indices of the system's textures, and the uv units per model space unit of the mesh
+    std::vector<uint32_t> tableTextures;
+    float uvDensity = 0.0f;
+    // largest axis scale of the instance transforms, model space units per world unit
+    float maxInstanceScale = 1.0f;
+    // set by subclasses whose vertices carry joint indices and weights
+    SkinningLayout skinningLayout{};
+    GpuSkinning *gpuSkinning = nullptr;
+    SkinnedVertices *skinnedVertices = nullptr;
+    // the skin's range of the palettes, see setJointPalettes
+    JointPalettes *jointPalettes = nullptr;
+    uint32_t jointOffset = 0;
+    uint32_t jointCount = 0;
+
+    // Depth pre-pass: instanced systems read a tightly packed copy of the positions, skinned ones
+    // the position of the skinning output
+    bool *depthPrePass = nullptr;
+    bool depthPrePassSupported = false;
+    bool depthPrePassActive = false;
+    Pipeline depthP;
+    VertexDescriptor depthVD;
+    VkBuffer positionBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory positionBufferMemory{};
+    std::string DEPTH_INSTANCED_VERT_SHADER = "assets/shaders/bin/depth-instanced.vert.spv";
+    std::string DEPTH_SKINNED_VERT_SHADER = "assets/shaders/bin/depth-skinned.vert.spv";
+
     std::string id;
     Camera *camera;
     BaseProject *BP;
@@ -167,46 +351,204 @@ protected:
 
         GDS.map(currentImage, &ubo, AMBIENT_DATA_BINDING);
     }
-    void bindVertexBuffers(VkCommandBuffer commandBuffer) {
-        VkBuffer vertexBuffers[] = {vertexBuffer};
-        // property .vertexBuffer of models, contains the VkBuffer handle to its vertex buffer
-        VkDeviceSize offsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-        // property .indexBuffer of models, contains the VkBuffer handle to its index buffer
-        vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0,
-                             VK_INDEX_TYPE_UINT32);
+    // Registers a texture sampled through the table, its mips are then streamed for the system's draws
+    uint32_t addTableTexture(const TextureInfo &info) {
+        uint32_t index = textureTable->addTexture(info);
+        tableTextures.push_back(index);
+        return index;
+    }
+
+    void computeUvDensity() {
+        double uvArea = 0.0, posArea = 0.0;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const TVertex &a = vertices[indices[i]], &b = vertices[indices[i + 1]], &c = vertices[indices[i + 2]];
+            posArea += glm::length(glm::cross(b.pos - a.pos, c.pos - a.pos));
+            glm::vec2 uvB = b.uv - a.uv, uvC = c.uv - a.uv;
+            uvArea += std::abs(uvB.x * uvC.y - uvB.y * uvC.x);
+        }
+        uvDensity = posArea > 0.0 ? (float) std::sqrt(uvArea / posArea) : 0.0f;
+    }
+
+    // Sets up the depth pipeline for systems that can draw a pre-pass: instanced and GPU skinned ones.
+    // Called from localInit with the descriptor set layouts of the main pipeline up to the set
+    // holding the model matrix, and the main pipeline's cull mode, so both passes cover the same pixels.
+    void initDepthPipeline(std::vector<DescriptorSetLayout *> layouts, VkCullModeFlagBits cullMode) {
+        if (gpuSkinning != nullptr) {
+            depthVD.init(BP, SkinnedVertex::getBindingDescription(), {SkinnedVertex::getDescriptorElements()[0]});
+            depthP.init(BP, &depthVD, DEPTH_SKINNED_VERT_SHADER, "", layouts);
+        } else if (instanced) {
+            std::vector<VertexDescriptorElement> elements = {
+                    {0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0, sizeof(glm::vec3), POSITION},
+            };
+            auto instanceElements = InstanceData::getDescriptorElements(INSTANCE_BINDING, 1);
+            elements.insert(elements.end(), instanceElements.begin(), instanceElements.end());
+            depthVD.init(BP, {{0, sizeof(glm::vec3), VK_VERTEX_INPUT_RATE_VERTEX},
+                              InstanceData::getBindingDescription(INSTANCE_BINDING)}, elements);
+            depthP.init(BP, &depthVD, DEPTH_INSTANCED_VERT_SHADER, "", layouts);
+        } else {
+            return;
+        }
+        depthP.setAdvancedFeatures(VK_COMPARE_OP_LESS_OR_EQUAL, VK_POLYGON_MODE_FILL, cullMode, false);
+        depthPrePassSupported = true;
+    }
+
+    // Creates the main pipeline, and the depth pipeline when the scene asks for the pre-pass.
+    // After a pre-pass the main pipeline only shades the fragments whose depth is equal to the
+    // stored one, and leaves the depth buffer as it is.
+    void createPipelines(Pipeline &P) {
+        depthPrePassActive = depthPrePassSupported && depthPrePass != nullptr && *depthPrePass;
+        P.compareOp = depthPrePassActive ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS_OR_EQUAL;
+        P.setDepthWrite(!depthPrePassActive);
+        P.create();
+        if (depthPrePassActive) {
+            depthP.create();
+        }
+    }
+
+    void cleanupPipelines(Pipeline &P) {
+        P.cleanup();
+        if (depthPrePassActive) {
+            depthP.cleanup();
+        }
+    }
+
+    void bindVertexBuffers(VkCommandBuffer commandBuffer, int currentImage, BindState &state) {
+        draw(commandBuffer, currentImage, skinnedVertices != nullptr ? skinnedVertices->outputBuffers[currentImage]
+                                                                     : vertexBuffer, false, state);
+    }
+
+    void bindDepthVertexBuffers(VkCommandBuffer commandBuffer, int currentImage, BindState &state) {
+        draw(commandBuffer, currentImage, skinnedVertices != nullptr ? skinnedVertices->outputBuffers[currentImage]
+                                                                     : positionBuffer, true, state);
+    }
+
+    void draw(VkCommandBuffer commandBuffer, int currentImage, VkBuffer buffer, bool positionsOnly,
+              BindState &state) {
+        if (culledInstances != nullptr) {
+            // only the instances that survived the culling pass, the counts are written by the GPU
+            gpuCulling->draw(commandBuffer, currentImage, culledInstances, positionsOnly, INSTANCE_BINDING, state);
+            return;
+        }
+        state.bindVertexBuffer(commandBuffer, 0, buffer);
+        state.bindIndexBuffer(commandBuffer, indexBuffer);
+        if (instanced) {
+            state.bindVertexBuffer(commandBuffer, INSTANCE_BINDING, instanceBuffers[currentImage]);
+        }
         vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+                         static_cast<uint32_t>(indices.size()), instanceCount, 0, 0, 0);
+    }
+
+    void computeBoundingSphere() {
+        if (vertices.empty()) {
+            return;
+        }
+        glm::vec3 min = vertices[0].pos;
+        glm::vec3 max = vertices[0].pos;
+        for (const auto &v: vertices) {
+            min = glm::min(min, v.pos);
+            max = glm::max(max, v.pos);
+        }
+        glm::vec3 center = (min + max) * 0.5f;
+        float radius = 0.0f;
+        for (const auto &v: vertices) {
+            radius = std::max(radius, glm::length(v.pos - center));
+        }
+        boundingSphere = glm::vec4(center, radius);
+    }
+
+    // Writes the pose into the system's range of the image's palette, then feeds it to the
+    // skinning pass when there is one
+    void updateJoints(uint32_t currentImage, const glm::mat4 &model,
+                      const std::unordered_map<int, glm::mat4> &joints) {
+        const glm::mat3x4 *palette = jointPalettes->write(currentImage, jointOffset, jointCount, joints);
+        if (skinnedVertices != nullptr) {
+            updateSkinning(currentImage, model, palette);
+        }
+    }
+
+    // Feeds the skinning pass the current pose. The pass is skipped when the skin is outside the
+    // camera frustum, the sphere is inflated since the pose can move vertices away from the bind pose.
+    void updateSkinning(uint32_t currentImage, const glm::mat4 &model, const glm::mat3x4 *joints) {
+        glm::vec3 center = model * glm::vec4(glm::vec3(boundingSphere), 1.0f);
+        glm::vec3 scale(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])),
+                        glm::length(glm::vec3(model[2])));
+        float radius = 2.0f * boundingSphere.w * std::max({scale.x, scale.y, scale.z});
+
+        Frustum frustum{};
+        frustum.setPlanes(camera->getFrustumPlanes());
+        AABB bounds;
+        bounds.expand(center - glm::vec3(radius));
+        bounds.expand(center + glm::vec3(radius));
+        bool onScreen = frustum.testAABB(bounds) != FRUSTUM_OUTSIDE;
+        gpuSkinning->update(skinnedVertices, currentImage, joints, onScreen);
+    }
+
+    void createInstanceBuffers() {
+        VkDeviceSize bufferSize = sizeof(InstanceData) * instanceCount;
+        size_t imageCount = BP->swapChainImages.size();
+        instanceBuffers.resize(imageCount);
+        instanceBuffersMemory.resize(imageCount);
+        instanceBuffersMapped.resize(imageCount);
+
+        for (size_t i = 0; i < imageCount; i++) {
+            // also read as a storage buffer by the culling pass
+            BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             instanceBuffers[i], instanceBuffersMemory[i]);
+            // kept mapped, it is rewritten every frame
+            vkMapMemory(BP->device, instanceBuffersMemory[i], 0, bufferSize, 0, &instanceBuffersMapped[i]);
+        }
+    }
+
+    void updateInstances(uint32_t currentImage, const std::vector<glm::mat4> &models) {
+        if (models.size() != instanceCount) {
+            throw std::runtime_error("RenderSystem " + id + ": expected " + std::to_string(instanceCount) +
+                                     " instances, got " + std::to_string(models.size()));
+        }
+        auto *instances = static_cast<InstanceData *>(instanceBuffersMapped[currentImage]);
+        maxInstanceScale = 0.0f;
+        for (size_t i = 0; i < models.size(); i++) {
+            instances[i].model = models[i];
+            for (int column = 0; column < 3; column++) {
+                maxInstanceScale = std::max(maxInstanceScale, glm::length(glm::vec3(models[i][column])));
+            }
+        }
+        if (maxInstanceScale <= 0.0f) {
+            maxInstanceScale = 1.0f;
+        }
     }
 
     void createVertexBuffer() {
         VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 
-        BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        // also read as a storage buffer by the skinning pass
+        BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                         VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                          vertexBuffer, vertexBufferMemory);
+        BP->uploadToBuffer(vertexBuffer, vertices.data(), bufferSize);
+    }
 
-        void *data;
-        vkMapMemory(BP->device, vertexBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, vertices.data(), (size_t) bufferSize);
-        vkUnmapMemory(BP->device, vertexBufferMemory);
-
+    void createPositionBuffer() {
+        std::vector<glm::vec3> positions;
+        positions.reserve(vertices.size());
+        for (const auto &v: vertices) {
+            positions.push_back(v.pos);
+        }
+        VkDeviceSize bufferSize = sizeof(positions[0]) * positions.size();
+        BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                         positionBuffer, positionBufferMemory);
+        BP->uploadToBuffer(positionBuffer, positions.data(), bufferSize);
     }
 
     void createIndexBuffer() {
         VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-        BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                          indexBuffer, indexBufferMemory);
-
-        void *data;
-        vkMapMemory(BP->device, indexBufferMemory, 0, bufferSize, 0, &data);
-        memcpy(data, indices.data(), (size_t) bufferSize);
-        vkUnmapMemory(BP->device, indexBufferMemory);
-
-
+        BP->uploadToBuffer(indexBuffer, indices.data(), bufferSize);
     }
 
 
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <stb_image.h>
+
+// Number of mips of a full chain down to 1x1, as allocated by Texture
+inline uint32_t getMipLevels(uint32_t width, uint32_t height) {
+    return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+}
+
+inline uint32_t getMipSize(uint32_t size, uint32_t mip) {
+    return std::max(1u, size >> mip);
+}
+
+// Bytes of the RGBA8 mips from firstMip to 1x1
+inline uint64_t getMipChainSize(uint32_t width, uint32_t height, uint32_t firstMip) {
+    uint64_t size = 0;
+    for (uint32_t mip = firstMip; mip < getMipLevels(width, height); mip++) {
+        size += (uint64_t) getMipSize(width, mip) * getMipSize(height, mip) * 4;
+    }
+    return size;
+}
+
+// One RGBA8 mip of an image file
+struct MipImage {
+    uint32_t mip = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+/**
+ * Decodes an image file and box filters it down to the given mip. sRGB images are averaged in
+ * linear space, like the blits of Texture's mip generation.
+ */
+inline MipImage decodeMip(const std::string &path, uint32_t mip, bool srgb) {
+    int width, height, channels;
+    stbi_uc *decoded = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!decoded) {
+        throw std::runtime_error("failed to load texture image " + path);
+    }
+    MipImage image;
+    image.width = (uint32_t) width;
+    image.height = (uint32_t) height;
+    image.pixels.assign(decoded, decoded + (size_t) width * height * 4);
+    stbi_image_free(decoded);
+
+    static const std::vector<float> toLinear = []() {
+        std::vector<float> table(256);
+        for (int i = 0; i < 256; i++) {
+            float c = (float) i / 255.0f;
+            table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }();
+    // linear value quantized to 4096 steps -> sRGB byte
+    static const std::vector<unsigned char> toSrgb = []() {
+        std::vector<unsigned char> table(4096);
+        for (int i = 0; i < 4096; i++) {
+            float c = (float) i / 4095.0f;
+            float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            table[i] = (unsigned char) std::lround(std::clamp(s, 0.0f, 1.0f) * 255.0f);
+        }
+        return table;
+    }();
+
+    uint32_t levels = getMipLevels(image.width, image.height);
+    for (uint32_t level = 1; level <= std::min(mip, levels - 1); level++) {
+        uint32_t srcWidth = image.width, srcHeight = image.height;
+        uint32_t dstWidth = getMipSize(srcWidth, 1), dstHeight = getMipSize(srcHeight, 1);
+        std::vector<unsigned char> dst((size_t) dstWidth * dstHeight * 4);
+        for (uint32_t y = 0; y < dstHeight; y++) {
+            uint32_t y0 = std::min(2 * y, srcHeight - 1), y1 = std::min(2 * y + 1, srcHeight - 1);
+            for (uint32_t x = 0; x < dstWidth; x++) {
+                uint32_t x0 = std::min(2 * x, srcWidth - 1), x1 = std::min(2 * x + 1, srcWidth - 1);
+                const unsigned char *texels[4] = {
+                        &image.pixels[((size_t) y0 * srcWidth + x0) * 4], &image.pixels[((size_t) y0 * srcWidth + x1) * 4],
+                        &image.pixels[((size_t) y1 * srcWidth + x0) * 4], &image.pixels[((size_t) y1 * srcWidth + x1) * 4],
+                };
+                unsigned char *out = &dst[((size_t) y * dstWidth + x) * 4];
+                for (int c = 0; c < 4; c++) {
+                    if (srgb && c < 3) {
+                        float sum = toLinear[texels[0][c]] + toLinear[texels[1][c]] + toLinear[texels[2][c]] +
+                                    toLinear[texels[3][c]];
+                        out[c] = toSrgb[(size_t) std::lround(sum * 0.25f * 4095.0f)];
+                    } else {
+                        out[c] = (unsigned char) ((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+                    }
+                }
+            }
+        }
+        image.pixels.swap(dst);
+        image.width = dstWidth;
+        image.height = dstHeight;
+        image.mip = level;
+    }
+    return image;
+}
+
+/**
+ * Decodes texture mips on a worker thread, started with the first submit(). Jobs are done in
+ * submission order, finished ones are picked up with collect() without blocking.
+ */
+class MipDecoder {
+public:
+    struct Job {
+        uint32_t texture;
+        std::string path;
+        uint32_t mip;
+        bool srgb;
+    };
+
+    struct Result {
+        uint32_t texture;
+        MipImage image;
+        // empty when the file could not be decoded
+        std::string error;
+    };
+
+    ~MipDecoder() {
+        if (!worker.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        jobReady.notify_one();
+        worker.join();
+    }
+
+    void submit(Job job) {
+        if (!worker.joinable()) {
+            worker = std::thread([this]() { run(); });
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+            inFlight++;
+        }
+        jobReady.notify_one();
+    }
+
+    std::vector<Result> collect() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Result> finished;
+        finished.swap(results);
+        inFlight -= (uint32_t) finished.size();
+        return finished;
+    }
+
+    // submitted jobs whose result was not collected yet
+    uint32_t pending() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return inFlight;
+    }
+
+    // Drops the queued jobs and the uncollected results, waiting for the job being decoded
+    void cancel() {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobs.clear();
+        jobDone.wait(lock, [this]() { return !busy; });
+        results.clear();
+        inFlight = 0;
+    }
+
+private:
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    std::deque<Job> jobs;
+    std::vector<Result> results;
+    uint32_t inFlight = 0;
+    bool busy = false;
+    bool quit = false;
+
+    void run() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobReady.wait(lock, [this]() { return !jobs.empty() || quit; });
+                if (quit) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                busy = true;
+            }
+            Result result{job.texture};
+            try {
+                result.image = decodeMip(job.path, job.mip, job.srgb);
+            } catch (const std::exception &e) {
+                result.error = e.what();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                results.push_back(std::move(result));
+                busy = false;
+            }
+            jobDone.notify_all();
+        }
+    }
+};
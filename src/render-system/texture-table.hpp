@@ -0,0 +1,664 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <unordered_map>
+#include "modules/Starter.hpp"
+#include "common.hpp"
+#include "render-system/texture-streamer.hpp"
+
+/**
+ * Bindless texture table: a descriptor set per swap chain image with an array of combined image
+ * samplers holding every texture of a scene. Textures are loaded once per path and format, render
+ * systems keep the returned index and pass it to the shader as a push constant, so draws only bind
+ * the table once per pipeline instead of a texture set per render system.
+ *
+ * Textures are streamed: loadResident() uploads every texture from a mip of at most
+ * BASE_MIP_SIZE texels, and updateStreaming() decodes the finer mips render systems ask for with
+ * requestMip() in the background. When the mips would exceed QualitySettings::textureBudget, the
+ * least recently needed ones are dropped first. A texture that changes image is rewritten in the
+ * set of each swap chain image by update(), once that image's previous frame is done, and its old
+ * image is destroyed when no set points at it anymore.
+ */
+class TextureTable {
+public:
+    static const uint32_t MAX_TEXTURES = 1024;
+    // largest side of the mip every texture starts with, and falls back to when unused
+    static const uint32_t BASE_MIP_SIZE = 128;
+    // frames a texture keeps its mips after its last request
+    static const uint32_t STALE_FRAMES = 120;
+    static const uint32_t MAX_PENDING_DECODES = 4;
+    DescriptorSetLayout DSL;
+
+    void init(BaseProject *bp) {
+        BP = bp;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(BP->physicalDevice, &properties);
+        capacity = std::min({MAX_TEXTURES, properties.limits.maxPerStageDescriptorSamplers,
+                             properties.limits.maxPerStageDescriptorSampledImages,
+                             properties.limits.maxDescriptorSetSamplers,
+                             properties.limits.maxDescriptorSetSampledImages});
+        if (BP->descriptorUpdateAfterBindSupported) {
+            VkPhysicalDeviceVulkan12Properties properties12{};
+            properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+            VkPhysicalDeviceProperties2 properties2{};
+            properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+            properties2.pNext = &properties12;
+            vkGetPhysicalDeviceProperties2(BP->physicalDevice, &properties2);
+            capacity = std::min({capacity, properties12.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                 properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                 properties12.maxDescriptorSetUpdateAfterBindSamplers,
+                                 properties12.maxDescriptorSetUpdateAfterBindSampledImages});
+        }
+
+        createDescriptorSetLayout();
+        createDescriptorSets();
+        initialized = true;
+    }
+
+    // Returns the table index of the texture. Only the image header is read, the texture is
+    // uploaded by the next loadResident().
+    uint32_t addTexture(const TextureInfo &info) {
+        std::string key = info.path + "|" + std::to_string(info.format);
+        auto it = indices.find(key);
+        if (it != indices.end()) {
+            return it->second;
+        }
+        if (textures.size() >= capacity) {
+            throw std::runtime_error("TextureTable: more than " + std::to_string(capacity) + " textures");
+        }
+
+        int width, height, channels;
+        if (!stbi_info(info.path.c_str(), &width, &height, &channels)) {
+            std::cout << "Not found: " << info.path << "\n";
+            throw std::runtime_error("failed to load texture image!");
+        }
+        StreamState state{info.path, info.format, (uint32_t) width, (uint32_t) height};
+        state.levels = getMipLevels(state.width, state.height);
+        while (std::max(getMipSize(state.width, state.baseMip), getMipSize(state.height, state.baseMip)) >
+               BASE_MIP_SIZE) {
+            state.baseMip++;
+        }
+        state.residentMip = state.baseMip;
+        state.requestedMip = state.baseMip;
+        state.neededMip = state.baseMip;
+        state.frameMip = state.baseMip;
+
+        auto texture = new Texture();
+        texture->BP = BP;
+        texture->imgs = 1;
+        uint32_t index = static_cast<uint32_t>(textures.size());
+        textures.push_back(texture);
+        streams.push_back(state);
+        indices[key] = index;
+        return index;
+    }
+
+    // Uploads the base mips of the textures added since the last call, decoding the files in
+    // parallel. Call once the render systems are initialized, before the first frame.
+    void loadResident() {
+        std::vector<uint32_t> pending;
+        for (uint32_t index = 0; index < textures.size(); index++) {
+            if (textures[index]->textureImage == VK_NULL_HANDLE) {
+                pending.push_back(index);
+            }
+        }
+        if (pending.empty()) {
+            return;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+
+        std::vector<MipImage> images(pending.size());
+        std::vector<std::exception_ptr> errors(pending.size());
+        std::atomic<size_t> next{0};
+        auto decode = [&]() {
+            for (size_t i = next++; i < pending.size(); i = next++) {
+                const StreamState &state = streams[pending[i]];
+                try {
+                    images[i] = decodeMip(state.path, state.baseMip, isSrgb(state.format));
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        size_t workerCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), pending.size());
+        for (size_t i = 0; i < workerCount; i++) {
+            workers.emplace_back(decode);
+        }
+        for (auto &worker: workers) {
+            worker.join();
+        }
+
+        // a single submission for every upload, unless the scene load batches them already
+        bool ownsUploads = BP->beginUploads();
+        uint64_t fullSize = 0;
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (errors[i]) {
+                std::rethrow_exception(errors[i]);
+            }
+            uint32_t index = pending[i];
+            const StreamState &state = streams[index];
+            VkImage image;
+            VkDeviceMemory memory;
+            uploadMip(images[i], state.format, image, memory);
+
+            Texture *texture = textures[index];
+            texture->textureImage = image;
+            texture->textureImageMemory = memory;
+            texture->mipLevels = state.levels - state.baseMip;
+            texture->createTextureImageView(state.format);
+            // the table always samples, so every texture gets a sampler
+            texture->createTextureSampler();
+            writeDescriptor(index);
+            residentBytes += getMipChainSize(state.width, state.height, state.baseMip);
+            fullSize += getMipChainSize(state.width, state.height, 0);
+        }
+        if (ownsUploads) {
+            BP->flushUploads();
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "TextureTable: " << pending.size() << " textures resident in " << ms << " ms, "
+                  << residentBytes / (1024.0 * 1024.0) << " MB (full mip chains: " << fullSize / (1024.0 * 1024.0)
+                  << " MB)\n";
+    }
+
+    // Asks for the mip a draw needs this frame, given how many uv units one pixel covers
+    void requestMip(uint32_t index, float uvPerPixel) {
+        StreamState &state = streams[index];
+        float texelsPerPixel = uvPerPixel * (float) std::max(state.width, state.height);
+        uint32_t mip = texelsPerPixel <= 1.0f ? 0 : (uint32_t) std::floor(std::log2(texelsPerPixel));
+        if (state.lastUsedFrame != BP->frameCounter) {
+            state.lastUsedFrame = BP->frameCounter;
+            state.frameMip = mip;
+        } else {
+            state.frameMip = std::min(state.frameMip, mip);
+        }
+    }
+
+    // Swaps in the decoded mips and schedules the next decodes. Call once per frame after the
+    // draws requested their mips, before update(). The decoded mips and the copies of the evicted
+    // ones are recorded into one upload batch, the frames in flight keep sampling the old images.
+    void updateStreaming() {
+        std::vector<MipDecoder::Result> results = decoder.collect();
+        bool ownsUploads = !results.empty() && BP->beginUploads();
+        for (auto &result: results) {
+            StreamState &state = streams[result.texture];
+            if (!result.error.empty()) {
+                std::cout << "TextureTable: " << result.error << "\n";
+                state.requestedMip = state.residentMip;
+                continue;
+            }
+            if (result.image.mip < state.residentMip) {
+                VkImage image;
+                VkDeviceMemory memory;
+                uploadMip(result.image, state.format, image, memory);
+                // only frames submitted after the batch sample the new image
+                replaceImage(result.texture, image, memory, result.image.mip);
+            }
+            state.requestedMip = state.residentMip;
+        }
+
+        uint32_t frame = BP->frameCounter;
+        std::vector<uint32_t> upgrades;
+        for (uint32_t index = 0; index < streams.size(); index++) {
+            StreamState &state = streams[index];
+            if (state.lastUsedFrame == frame) {
+                state.neededMip = state.frameMip;
+            } else if (frame - state.lastUsedFrame > STALE_FRAMES) {
+                state.neededMip = state.baseMip;
+            }
+            state.neededMip = std::clamp(state.neededMip, std::min(getCapMip(state), state.baseMip), state.baseMip);
+            if (state.neededMip < state.residentMip && state.requestedMip == state.residentMip) {
+                upgrades.push_back(index);
+            }
+        }
+        // the textures furthest from their needed mip first
+        std::sort(upgrades.begin(), upgrades.end(), [this](uint32_t a, uint32_t b) {
+            return streams[a].residentMip - streams[a].neededMip > streams[b].residentMip - streams[b].neededMip;
+        });
+
+        uint64_t budget = (uint64_t) BP->quality.textureBudget * 1024 * 1024;
+        for (uint32_t index: upgrades) {
+            if (decoder.pending() >= MAX_PENDING_DECODES) {
+                break;
+            }
+            StreamState &state = streams[index];
+            uint32_t mip = state.neededMip;
+            if (budget > 0) {
+                // a coarser mip than needed is better than none
+                while (mip < state.residentMip && getCommittedBytes() + getUpgradeSize(state, mip) > budget &&
+                       !evict(getCommittedBytes() + getUpgradeSize(state, mip) - budget, index, ownsUploads)) {
+                    mip++;
+                }
+                if (mip == state.residentMip) {
+                    continue;
+                }
+            }
+            state.requestedMip = mip;
+            decoder.submit({index, state.path, mip, isSrgb(state.format)});
+        }
+        if (ownsUploads) {
+            BP->flushUploads();
+        }
+    }
+
+    // Points the set of the swap chain image at the textures replaced since the image was last
+    // drawn, and destroys the old images no set points at anymore. Call every frame before the
+    // image's command buffer is recorded, once its previous submission is done.
+    void update(uint32_t currentImage) {
+        std::vector<uint32_t> &slots = staleSlots[currentImage];
+        if (slots.empty()) {
+            return;
+        }
+        for (uint32_t index: slots) {
+            writeDescriptor(index, descriptorSets[currentImage]);
+        }
+        // without update after bind, rewriting a bound set invalidates the command buffer
+        if (!BP->descriptorUpdateAfterBindSupported) {
+            BP->invalidateCommandBuffer(currentImage);
+        }
+        for (auto &image: retired) {
+            if (std::find(slots.begin(), slots.end(), image.texture) != slots.end()) {
+                image.referenced[currentImage] = false;
+            }
+        }
+        slots.clear();
+
+        auto unused = std::partition(retired.begin(), retired.end(), [](const RetiredImage &image) {
+            return std::find(image.referenced.begin(), image.referenced.end(), true) != image.referenced.end();
+        });
+        for (auto it = unused; it != retired.end(); it++) {
+            destroyRetired(*it);
+        }
+        retired.erase(unused, retired.end());
+    }
+
+    // Bytes of the mips in memory
+    uint64_t getResidentBytes() {
+        return residentBytes;
+    }
+
+    // Rewrites every slot of every set, e.g. after the samplers were recreated or the swap chain
+    // changed its image count. No command buffer may use the sets.
+    void refresh() {
+        if (!initialized) {
+            return;
+        }
+        for (auto &image: retired) {
+            destroyRetired(image);
+        }
+        retired.clear();
+        if (descriptorSets.size() != BP->swapChainImages.size()) {
+            vkDestroyDescriptorPool(BP->device, descriptorPool, nullptr);
+            createDescriptorSets();
+        }
+        for (uint32_t index = 0; index < textures.size(); index++) {
+            writeDescriptor(index);
+        }
+        for (auto &slots: staleSlots) {
+            slots.clear();
+        }
+    }
+
+    void bind(VkCommandBuffer commandBuffer, Pipeline &P, int setId, int currentImage, BindState &state) {
+        state.bindDescriptorSet(commandBuffer, P.pipelineLayout, setId, descriptorSets[currentImage]);
+    }
+
+    size_t size() {
+        return textures.size();
+    }
+
+    bool isInitialized() {
+        return initialized;
+    }
+
+    void cleanup() {
+        if (!initialized) {
+            return;
+        }
+        decoder.cancel();
+        for (auto &image: retired) {
+            destroyRetired(image);
+        }
+        retired.clear();
+        for (auto texture: textures) {
+            texture->cleanup();
+            delete texture;
+        }
+        textures.clear();
+        streams.clear();
+        indices.clear();
+        residentBytes = 0;
+        vkDestroyDescriptorPool(BP->device, descriptorPool, nullptr);
+        DSL.cleanup();
+        initialized = false;
+    }
+
+private:
+    // Mips of a table texture: its image holds residentMip down to 1x1
+    struct StreamState {
+        std::string path;
+        VkFormat format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t levels = 1;
+        uint32_t baseMip = 0;
+        uint32_t residentMip = 0;
+        // being decoded when less than residentMip
+        uint32_t requestedMip = 0;
+        // finest mip asked for by the last requests
+        uint32_t neededMip = 0;
+        uint32_t frameMip = 0;
+        uint32_t lastUsedFrame = 0;
+    };
+
+    // An image a texture moved off, still sampled through the sets not rewritten yet
+    struct RetiredImage {
+        uint32_t texture;
+        VkImage image;
+        VkImageView view;
+        VkDeviceMemory memory;
+        VkSampler sampler;
+        // per swap chain image, whether its set still points at the image
+        std::vector<bool> referenced;
+    };
+
+    BaseProject *BP;
+    bool initialized = false;
+    uint32_t capacity = 0;
+    VkDescriptorPool descriptorPool{};
+    // one per swap chain image, so a swap only rewrites the sets of the images not in flight
+    std::vector<VkDescriptorSet> descriptorSets;
+    // per swap chain image, the slots its set has to move to the texture's current image
+    std::vector<std::vector<uint32_t>> staleSlots;
+    std::vector<RetiredImage> retired;
+    std::vector<Texture *> textures;
+    std::vector<StreamState> streams;
+    // path|format -> index
+    std::unordered_map<std::string, uint32_t> indices;
+    MipDecoder decoder;
+    uint64_t residentBytes = 0;
+
+    const uint32_t TEXTURES_BINDING = 0;
+
+    static bool isSrgb(VkFormat format) {
+        return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_B8G8R8A8_SRGB;
+    }
+
+    // finest mip the quality settings let the sampler use
+    uint32_t getCapMip(const StreamState &state) {
+        uint32_t maxSize = BP->quality.maxTextureSize;
+        uint32_t mip = 0;
+        while (maxSize > 0 && mip + 1 < state.levels &&
+               std::max(getMipSize(state.width, mip), getMipSize(state.height, mip)) > maxSize) {
+            mip++;
+        }
+        return mip;
+    }
+
+    uint64_t getUpgradeSize(const StreamState &state, uint32_t mip) {
+        return getMipChainSize(state.width, state.height, mip) -
+               getMipChainSize(state.width, state.height, state.residentMip);
+    }
+
+    // resident mips plus the ones being decoded
+    uint64_t getCommittedBytes() {
+        uint64_t bytes = residentBytes;
+        for (const auto &state: streams) {
+            if (state.requestedMip < state.residentMip) {
+                bytes += getUpgradeSize(state, state.requestedMip);
+            }
+        }
+        return bytes;
+    }
+
+    // Frees at least the given bytes by dropping mips finer than needed, least recently used first,
+    // without touching the texture being upgraded. The copies go into the open upload batch, or a
+    // new one the caller flushes when ownsUploads is set. Returns false if not enough can be freed.
+    bool evict(uint64_t bytes, uint32_t upgrading, bool &ownsUploads) {
+        std::vector<uint32_t> candidates;
+        uint64_t freeable = 0;
+        for (uint32_t index = 0; index < streams.size(); index++) {
+            const StreamState &state = streams[index];
+            if (index != upgrading && state.residentMip < state.neededMip && state.requestedMip == state.residentMip) {
+                candidates.push_back(index);
+                freeable += getMipChainSize(state.width, state.height, state.residentMip) -
+                            getMipChainSize(state.width, state.height, state.neededMip);
+            }
+        }
+        if (freeable < bytes) {
+            return false;
+        }
+        std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+            return streams[a].lastUsedFrame < streams[b].lastUsedFrame;
+        });
+        if (!BP->uploadsOpen()) {
+            ownsUploads = BP->beginUploads();
+        }
+        uint64_t freed = 0;
+        for (uint32_t index: candidates) {
+            if (freed >= bytes) {
+                break;
+            }
+            const StreamState &state = streams[index];
+            freed += getMipChainSize(state.width, state.height, state.residentMip) -
+                     getMipChainSize(state.width, state.height, state.neededMip);
+            dropMips(index, state.neededMip);
+        }
+        return true;
+    }
+
+    // Creates an image holding the decoded mip and the mips below it, ready to be sampled
+    void uploadMip(const MipImage &mipImage, VkFormat format, VkImage &image, VkDeviceMemory &memory) {
+        VkDeviceSize imageSize = mipImage.pixels.size();
+        uint32_t mipLevels = getMipLevels(mipImage.width, mipImage.height);
+
+        bool ownsUploads = BP->beginUploads();
+        VkBuffer stagingBuffer;
+        VkDeviceSize stagingOffset;
+        memcpy(BP->stageUpload(imageSize, stagingBuffer, stagingOffset), mipImage.pixels.data(),
+               static_cast<size_t>(imageSize));
+
+        // also a transfer source, dropMips copies the coarser mips out of it
+        BP->createImage(mipImage.width, mipImage.height, mipLevels, 1, VK_SAMPLE_COUNT_1_BIT, format,
+                        VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                                                 VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                        0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+        BP->transitionImageLayout(image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                  mipLevels, 1);
+        BP->copyBufferToImage(stagingBuffer, image, mipImage.width, mipImage.height, 1, stagingOffset);
+        BP->generateMipmaps(image, format, mipImage.width, mipImage.height, mipLevels, 1);
+
+        if (ownsUploads) {
+            BP->flushUploads();
+        }
+    }
+
+    // Shrinks a texture to the given mip by copying its coarser mips into a smaller image. The old
+    // image goes back to being sampled, the sets not rewritten yet still point at it.
+    void dropMips(uint32_t index, uint32_t mip) {
+        StreamState &state = streams[index];
+        Texture *texture = textures[index];
+        uint32_t skipped = mip - state.residentMip;
+        uint32_t width = getMipSize(state.width, mip), height = getMipSize(state.height, mip);
+        uint32_t mipLevels = state.levels - mip;
+
+        VkImage image;
+        VkDeviceMemory memory;
+        BP->createImage(width, height, mipLevels, 1, VK_SAMPLE_COUNT_1_BIT, state.format, VK_IMAGE_TILING_OPTIMAL,
+                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                        0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, memory);
+
+        VkCommandBuffer commandBuffer = BP->beginUploadCommands();
+        VkImageMemoryBarrier barriers[2]{};
+        for (auto &barrier: barriers) {
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier.subresourceRange.layerCount = 1;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        }
+        barriers[0].image = texture->textureImage;
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barriers[0].subresourceRange.baseMipLevel = skipped;
+        barriers[0].subresourceRange.levelCount = mipLevels;
+        barriers[1].image = image;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].subresourceRange.levelCount = mipLevels;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2, barriers);
+
+        std::vector<VkImageCopy> regions(mipLevels);
+        for (uint32_t level = 0; level < mipLevels; level++) {
+            regions[level].srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, skipped + level, 0, 1};
+            regions[level].dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+            regions[level].extent = {getMipSize(width, level), getMipSize(height, level), 1};
+        }
+        vkCmdCopyImage(commandBuffer, texture->textureImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, regions.data());
+
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barriers[0].srcAccessMask = 0;
+        barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                             0, nullptr, 0, nullptr, 2, barriers);
+        BP->endUploadCommands(commandBuffer);
+
+        replaceImage(index, image, memory, mip);
+    }
+
+    // Points a texture at a new image starting at the given mip. The old image, view and sampler
+    // are retired until update() moved every set off them.
+    void replaceImage(uint32_t index, VkImage image, VkDeviceMemory memory, uint32_t mip) {
+        StreamState &state = streams[index];
+        Texture *texture = textures[index];
+        retired.push_back({index, texture->textureImage, texture->textureImageView, texture->textureImageMemory,
+                           texture->textureSampler, std::vector<bool>(descriptorSets.size(), true)});
+
+        residentBytes -= getMipChainSize(state.width, state.height, state.residentMip);
+        residentBytes += getMipChainSize(state.width, state.height, mip);
+        state.residentMip = mip;
+        texture->textureImage = image;
+        texture->textureImageMemory = memory;
+        texture->mipLevels = state.levels - mip;
+        texture->createTextureImageView(state.format);
+        // the maxTextureSize cap is relative to the first mip of the image
+        texture->samplerSettings.maxLod = static_cast<float>(texture->mipLevels);
+        texture->createSampler();
+        for (auto &slots: staleSlots) {
+            if (std::find(slots.begin(), slots.end(), index) == slots.end()) {
+                slots.push_back(index);
+            }
+        }
+    }
+
+    void destroyRetired(const RetiredImage &image) {
+        vkDestroyImageView(BP->device, image.view, nullptr);
+        vkDestroyImage(BP->device, image.image, nullptr);
+        vkFreeMemory(BP->device, image.memory, nullptr);
+        BP->objectCache.releaseSampler(image.sampler);
+    }
+
+    void createDescriptorSetLayout() {
+        VkDescriptorSetLayoutBinding binding{};
+        binding.binding = TEXTURES_BINDING;
+        binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        binding.descriptorCount = capacity;
+        binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        binding.pImmutableSamplers = nullptr;
+
+        // slots past the loaded textures are never written, and with update after bind a streamed
+        // texture is rewritten without recording the command buffers again
+        VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+        VkDescriptorSetLayoutCreateFlags layoutFlags = 0;
+        if (BP->descriptorUpdateAfterBindSupported) {
+            bindingFlags |= VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+            layoutFlags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+        }
+        DSL.descriptorSetLayout = BP->objectCache.getDescriptorSetLayout({binding}, {bindingFlags}, layoutFlags);
+        DSL.BP = BP;
+        DSL.Bindings = {{TEXTURES_BINDING, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                         (int) capacity}};
+        DSL.imgInfoSize = (int) capacity;
+    }
+
+    // The table outlives the pipelines, so it lives in its own pool, recreated by refresh() when
+    // the swap chain image count changes
+    void createDescriptorSets() {
+        uint32_t setCount = static_cast<uint32_t>(BP->swapChainImages.size());
+        VkDescriptorPoolSize poolSize{};
+        poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        poolSize.descriptorCount = capacity * setCount;
+
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        if (BP->descriptorUpdateAfterBindSupported) {
+            poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+        }
+        poolInfo.poolSizeCount = 1;
+        poolInfo.pPoolSizes = &poolSize;
+        poolInfo.maxSets = setCount;
+
+        VkResult result = vkCreateDescriptorPool(BP->device, &poolInfo, nullptr, &descriptorPool);
+        if (result != VK_SUCCESS) {
+            PrintVkError(result);
+            throw std::runtime_error("failed to create texture table descriptor pool!");
+        }
+
+        std::vector<VkDescriptorSetLayout> layouts(setCount, DSL.descriptorSetLayout);
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = descriptorPool;
+        allocInfo.descriptorSetCount = setCount;
+        allocInfo.pSetLayouts = layouts.data();
+
+        descriptorSets.resize(setCount);
+        result = vkAllocateDescriptorSets(BP->device, &allocInfo, descriptorSets.data());
+        if (result != VK_SUCCESS) {
+            PrintVkError(result);
+            throw std::runtime_error("failed to allocate texture table descriptor set!");
+        }
+        staleSlots.assign(setCount, {});
+    }
+
+    // Written in every set while the scene loads, see update for the streamed textures
+    void writeDescriptor(uint32_t index) {
+        for (VkDescriptorSet set: descriptorSets) {
+            writeDescriptor(index, set);
+        }
+    }
+
+    void writeDescriptor(uint32_t index, VkDescriptorSet set) {
+        if (textures[index]->textureImage == VK_NULL_HANDLE) {
+            return;
+        }
+        VkDescriptorImageInfo imageInfo{};
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageInfo.imageView = textures[index]->textureImageView;
+        imageInfo.sampler = textures[index]->textureSampler;
+
+        VkWriteDescriptorSet write{};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = set;
+        write.dstBinding = TEXTURES_BINDING;
+        write.dstArrayElement = index;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.descriptorCount = 1;
+        write.pImageInfo = &imageInfo;
+        vkUpdateDescriptorSets(BP->device, 1, &write, 0, nullptr);
+    }
+};
@@ -25,6 +25,8 @@ public:
     const int RUN_ANIMATION = 3;
     const int WALK_ANIMATION = 4;
     const int WALKSENT_ANIMATION = 5;
+    const int MAX_OCCLUDERS = 32;
+    const size_t MAX_OCCLUDER_TRIANGLES = 30000;
 
     CityScene(std::string pId, std::string worldFile) :
             SceneBase(pId, worldFile) {
@@ -37,28 +39,24 @@ public:
     std::unordered_map<std::string, StationaryRenderSystem *> cityRenderSystems;
     std::unordered_map<std::string, AnimatedSkinRenderSystem *> animatedSkinRenderSystems;
 
-    PoolSizes getPoolSizes() override {
-        PoolSizes poolSizes;
-        for (auto [id, system]: cityRenderSystems) {
-            poolSizes.uniformBlocksInPool += system->getPoolSizes().uniformBlocksInPool;
-            poolSizes.texturesInPool += system->getPoolSizes().texturesInPool;
-            poolSizes.setsInPool += system->getPoolSizes().setsInPool;
-        }
-        for (auto [id, system]: animatedSkinRenderSystems) {
-            poolSizes.uniformBlocksInPool += system->getPoolSizes().uniformBlocksInPool;
-            poolSizes.texturesInPool += system->getPoolSizes().texturesInPool;
-            poolSizes.setsInPool += system->getPoolSizes().setsInPool;
-        }
-        return poolSizes;
-    }
-
     void initRenderSystems() override {
+        textureTable.init(BP);
+        enableDepthPrePass(cityRenderSystems);
+        enableDepthPrePass(animatedSkinRenderSystems);
+        gpuCulling.init(BP, cityRenderSystems.size());
         for (auto [id, system]: cityRenderSystems) {
-            system->init(BP, camera, light);
+            system->setTextureTable(&textureTable);
+            system->setGpuCulling(&gpuCulling);
+            system->init(BP, &renderCamera, &renderLight);
         }
+        gpuCulling.createBuffers();
+        enableJointPalettes(animatedSkinRenderSystems);
+        enableGpuSkinning(animatedSkinRenderSystems);
         for (auto [id, system]: animatedSkinRenderSystems) {
-            system->init(BP, camera, light);
+            system->init(BP, &renderCamera, &renderLight);
         }
+
+        textureTable.loadResident();
     }
 
     void setCity() {
@@ -109,6 +107,8 @@ public:
             auto go = new GameObjectBase(m.name);
             go->vertices = m.vertices;
             go->indices = m.indices;
+            go->setModelPath(modelPath + "#" + m.name);
+            go->setBounds(m.bounds);
             TextureInfo textureInfo{};
             textureInfo.path = baseFolder + "/" + m.baseColorTexture;
             textureInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
@@ -117,8 +117,12 @@ public:
             go->addTexture("base", textureInfo);
             go->renderType = STATIONARY;
             gameObjects[m.name] = go;
+        }
+
 
-            auto renderSystem = new StationaryRenderSystem(go->getId());
+        for (auto &[groupId, ids]: groupInstances(STATIONARY)) {
+            auto go = gameObjects[groupId];
+            auto renderSystem = new StationaryRenderSystem(groupId);
             std::vector<StationarySystemVertex> vertices;
             for (auto v: go->vertices) {
                 StationarySystemVertex vertex;
@@ -129,26 +133,8 @@ public:
             }
             renderSystem->addVertices(vertices, go->indices);
             renderSystem->setTextures(go->textures);
-            cityRenderSystems[go->getId()] = renderSystem;
-        }
-
-
-        for (auto [id, go]: gameObjects) {
-            if (go->renderType == STATIONARY) {
-                auto renderSystem = new StationaryRenderSystem(id);
-                std::vector<StationarySystemVertex> vertices;
-                for (auto v: go->vertices) {
-                    StationarySystemVertex vertex;
-                    vertex.pos = v.pos;
-                    vertex.normal = v.normal;
-                    vertex.uv = v.uv;
-                    vertices.push_back(vertex);
-                }
-                renderSystem->addVertices(vertices, go->indices);
-                renderSystem->setTextures(go->textures);
-                cityRenderSystems[id] = renderSystem;
-            }
-
+            renderSystem->setInstanceCount(ids.size());
+            cityRenderSystems[groupId] = renderSystem;
         }
 
         for (const auto &[id, skin]: skins) {
@@ -182,32 +168,37 @@ public:
 
 
         setCity();
-
+        buildBvh();
+        enableOcclusionCulling(MAX_OCCLUDERS, MAX_OCCLUDER_TRIANGLES);
     }
 
     bool pause = false;
     float lookAng = 180;
 
-    void updateUniformBuffer(uint32_t currentImage, UserInput userInput) override {
+    glm::mat4 getWorldMatrix() override {
+        return CityWorldMatrix;
+    }
+
+    void simulate(const UserInput &userInput) override {
         auto walkingCharacter = skins[walkingCharacterId];
         walkingCharacter->setActiveAnimation(IDLE_ANIMATION);
 
-        if (userInput.key == GLFW_KEY_P) {
+        if (userInput.keys.wasPressed(GLFW_KEY_P)) {
             pause = true;
         }
 
-        if (userInput.key == GLFW_KEY_O) {
+        if (userInput.keys.wasPressed(GLFW_KEY_O)) {
             pause = false;
         }
 
-        if (userInput.key == GLFW_KEY_0) {
+        if (userInput.keys.wasPressed(GLFW_KEY_0)) {
             walkingCharacter->setTranslation(glm::vec3(0, 0, 0));
             walkingCharacter->setRotation(glm::vec3(0, 0, 0));
         }
         if (!pause) {
-            if (userInput.key == GLFW_KEY_X) {
+            if (userInput.keys.isDown(GLFW_KEY_X)) {
                 walkingCharacter->setActiveAnimation(JUMP_ANIMATION);
-            } else if (userInput.key == GLFW_KEY_C) {
+            } else if (userInput.keys.isDown(GLFW_KEY_C)) {
                 walkingCharacter->setActiveAnimation(ATTACK_ANIMATION);
             } else {
 
@@ -234,15 +225,12 @@ public:
             }
         }
 
-        for (auto [id, s]: skins) {
-            s->update(BP->frameTime * gameConfig.heroAnimationSpeed, pause);
-        }
-
-        if (userInput.key == GLFW_KEY_B) {
+        if (userInput.keys.wasPressed(GLFW_KEY_B)) {
             this->sceneLoader.readJson();
 //            setWorld();
             this->setLight();
             setCity();
+            buildBvh();
             setCamera(userInput.aspectRatio);
 
             setGame();
@@ -253,27 +241,34 @@ public:
         camera->lookAt(walkingCharacter->getPosition());
         camera->updateWorld();
         camera->updateViewMatrix();
+
+        for (auto [id, s]: skins) {
+            s->update(userInput.frameTime * gameConfig.heroAnimationSpeed, pause);
+        }
+    }
+
+    void render(uint32_t currentImage) override {
+        // the occlusion test runs on its worker thread while the uniform buffers are written
+        beginCulling();
         updateRenderSystems(currentImage);
+        endCulling();
+        updateRenderQueue(currentImage);
     }
 
     void updateRenderSystems(uint32_t currentImage) {
 
         for (auto [id, system]: cityRenderSystems) {
-            auto go = gameObjects[id];
             system->updateUniformBuffers(currentImage, {
-                    CityWorldMatrix * go->getModel()
+                    getInstanceModels(id)
             });
         }
+        gpuCulling.update(currentImage, renderCamera.getFrustumPlanes());
 
         for (auto [id, system]: animatedSkinRenderSystems) {
-            auto skin = skins[id];
-            auto jointMatrices = skin->getJointMatrices();
-
+            const SkinPose &pose = getSkinPose(id);
             AnimatedSkinRenderSystemData data{};
-            data.model = skin->getModel();
-            for (auto [jointIndex, jointMatrix]: jointMatrices) {
-                data.jointTransformMatrices[jointIndex] = jointMatrix;
-            }
+            data.model = pose.model;
+            data.jointMatrices = &pose.joints;
             system->updateUniformBuffers(currentImage, data);
         }
 
@@ -306,20 +301,26 @@ public:
         for (auto [id, system]: cityRenderSystems) {
             system->cleanup();
         }
+        gpuCulling.cleanup();
+        textureTable.cleanup();
 
         for (auto [id, system]: animatedSkinRenderSystems) {
             system->cleanup();
         }
+        gpuSkinning.cleanup();
+        jointPalettes.cleanup();
     }
 
-    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) override {
+    void submitDraws(RenderQueue &queue) override {
         for (auto [id, system]: cityRenderSystems) {
-            system->populateCommandBuffer(commandBuffer, currentImage);
+            if (isVisible(id)) {
+                pushDraw(queue, system, STATIONARY, getGroupDistance(id));
+            }
         }
 
 
         for (auto [id, system]: animatedSkinRenderSystems) {
-            system->populateCommandBuffer(commandBuffer, currentImage);
+            pushDraw(queue, system, ANIMATED_SKIN, getDistance(getSkinPose(id).position));
         }
     }
 };
\ No newline at end of file
@@ -15,19 +15,12 @@ public:
 
     std::unordered_map<std::string, PepsimanRenderSystem *> pepsimanRenderSystems;
 
-    PoolSizes getPoolSizes() override {
-        PoolSizes poolSizes;
-        for (auto [id, system]: pepsimanRenderSystems) {
-            poolSizes.uniformBlocksInPool += system->getPoolSizes().uniformBlocksInPool;
-            poolSizes.texturesInPool += system->getPoolSizes().texturesInPool;
-            poolSizes.setsInPool += system->getPoolSizes().setsInPool;
-        }
-        return poolSizes;
-    }
-
     void initRenderSystems() override {
+        enableJointPalettes(pepsimanRenderSystems);
+        enableGpuSkinning(pepsimanRenderSystems);
+        enableDepthPrePass(pepsimanRenderSystems);
         for (auto [id, system]: pepsimanRenderSystems) {
-            system->init(BP, camera, light);
+            system->init(BP, &renderCamera, &renderLight);
         }
     }
 
@@ -62,12 +55,12 @@ public:
 
     }
 
-    void updateUniformBuffer(uint32_t currentImage, UserInput userInput) override {
+    void simulate(const UserInput &userInput) override {
         for (auto [id, s]: skins) {
-            s->update(BP->frameTime, false);
+            s->update(userInput.frameTime, false);
         }
 
-        if (userInput.key == GLFW_KEY_B) {
+        if (userInput.keys.wasPressed(GLFW_KEY_B)) {
             this->sceneLoader.readJson();
             setWorld();
             setCamera(userInput.aspectRatio);
@@ -85,18 +78,19 @@ public:
         camera->updateWorld();
         camera->updateViewMatrix();
         camera->updatePerspective();
+    }
+
+    void render(uint32_t currentImage) override {
         updateRenderSystems(currentImage);
+        updateRenderQueue(currentImage);
     }
 
     void updateRenderSystems(uint32_t currentImage) {
         for (auto [id, system]: pepsimanRenderSystems) {
-            auto skin = skins[id];
-            auto jointMatrices = skin->getJointMatrices();
+            const SkinPose &pose = getSkinPose(id);
             PepsimanRenderSystemData data{};
-            data.model = skin->getModel();
-            for (auto [jointIndex, jointMatrix]: jointMatrices) {
-                data.jointTransformMatrices[jointIndex] = jointMatrix;
-            }
+            data.model = pose.model;
+            data.jointMatrices = &pose.joints;
             system->updateUniformBuffers(currentImage, data);
         }
     }
@@ -118,11 +112,13 @@ public:
         for (auto [id, system]: pepsimanRenderSystems) {
             system->cleanup();
         }
+        gpuSkinning.cleanup();
+        jointPalettes.cleanup();
     }
 
-    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) override {
+    void submitDraws(RenderQueue &queue) override {
         for (auto [id, system]: pepsimanRenderSystems) {
-            system->populateCommandBuffer(commandBuffer, currentImage);
+            pushDraw(queue, system, PEPSIMAN, getDistance(getSkinPose(id).position));
         }
     }
 };
\ No newline at end of file
@@ -23,42 +23,30 @@ public:
     std::unordered_map<std::string, StationaryRenderSystem *> stationaryRenderSystems;
     std::unordered_map<std::string, MetallicRenderSystem *> mettalicRenderSystems;
 
-    PoolSizes getPoolSizes() override {
-        PoolSizes poolSizes;
-        for (auto [id, system]: pepsimanRenderSystems) {
-            poolSizes.uniformBlocksInPool += system->getPoolSizes().uniformBlocksInPool;
-            poolSizes.texturesInPool += system->getPoolSizes().texturesInPool;
-            poolSizes.setsInPool += system->getPoolSizes().setsInPool;
-        }
-        for (auto [id, system]: stationaryRenderSystems) {
-            poolSizes.uniformBlocksInPool += system->getPoolSizes().uniformBlocksInPool;
-            poolSizes.texturesInPool += system->getPoolSizes().texturesInPool;
-            poolSizes.setsInPool += system->getPoolSizes().setsInPool;
-        }
-        for (auto [id, system]: mettalicRenderSystems) {
-            poolSizes.uniformBlocksInPool += system->getPoolSizes().uniformBlocksInPool;
-            poolSizes.texturesInPool += system->getPoolSizes().texturesInPool;
-            poolSizes.setsInPool += system->getPoolSizes().setsInPool;
-        }
-
-        poolSizes.uniformBlocksInPool += skybox.getPoolSizes().uniformBlocksInPool;
-        poolSizes.texturesInPool += skybox.getPoolSizes().texturesInPool;
-        poolSizes.setsInPool += skybox.getPoolSizes().setsInPool;
-        return poolSizes;
-    }
-
     void initRenderSystems() override {
+        textureTable.init(BP);
+        enableJointPalettes(pepsimanRenderSystems);
+        enableGpuSkinning(pepsimanRenderSystems);
+        enableDepthPrePass(pepsimanRenderSystems);
+        enableDepthPrePass(stationaryRenderSystems);
+        enableDepthPrePass(mettalicRenderSystems);
         for (auto [id, system]: pepsimanRenderSystems) {
-            system->init(BP, camera, light);
+            system->init(BP, &renderCamera, &renderLight);
         }
+        gpuCulling.init(BP, stationaryRenderSystems.size() + mettalicRenderSystems.size());
         for (auto [id, system]: stationaryRenderSystems) {
-            system->init(BP, camera, light);
+            system->setTextureTable(&textureTable);
+            system->setGpuCulling(&gpuCulling);
+            system->init(BP, &renderCamera, &renderLight);
         }
 
         for (auto [id, system]: mettalicRenderSystems) {
-            system->init(BP, camera, light);
+            system->setTextureTable(&textureTable);
+            system->setGpuCulling(&gpuCulling);
+            system->init(BP, &renderCamera, &renderLight);
         }
-
+        gpuCulling.createBuffers();
+        textureTable.loadResident();
     }
 
     void createRenderSystems() override {
@@ -85,42 +73,47 @@ public:
 
         }
 
-        for (auto [id, go]: gameObjects) {
-            if (go->renderType == STATIONARY) {
-                auto renderSystem = new StationaryRenderSystem(id);
-                std::vector<StationarySystemVertex> vertices;
-                for (auto v: go->vertices) {
-                    StationarySystemVertex vertex;
-                    vertex.pos = v.pos;
-                    vertex.normal = v.normal;
-                    vertex.uv = v.uv;
-                    vertices.push_back(vertex);
-                }
-                renderSystem->addVertices(vertices, go->indices);
-                renderSystem->setTextures(go->textures);
-                stationaryRenderSystems[id] = renderSystem;
+        for (auto &[groupId, ids]: groupInstances(STATIONARY)) {
+            auto go = gameObjects[groupId];
+            auto renderSystem = new StationaryRenderSystem(groupId);
+            std::vector<StationarySystemVertex> vertices;
+            for (auto v: go->vertices) {
+                StationarySystemVertex vertex;
+                vertex.pos = v.pos;
+                vertex.normal = v.normal;
+                vertex.uv = v.uv;
+                vertices.push_back(vertex);
             }
-            if (go->renderType == METTALIC) {
-                auto renderSystem = new MetallicRenderSystem(id);
-                std::vector<MetallicSystemVertex> vertices;
-                for (auto v: go->vertices) {
-                    MetallicSystemVertex vertex;
-                    vertex.pos = v.pos;
-                    vertex.normal = v.normal;
-                    vertex.uv = v.uv;
-                    vertex.tangent = v.tangent;
-                    vertices.push_back(vertex);
-                }
-                renderSystem->addVertices(vertices, go->indices);
-                renderSystem->setTextures(go->textures);
-                mettalicRenderSystems[id] = renderSystem;
+            renderSystem->addVertices(vertices, go->indices);
+            renderSystem->setTextures(go->textures);
+            renderSystem->setInstanceCount(ids.size());
+            stationaryRenderSystems[groupId] = renderSystem;
+        }
+
+        for (auto &[groupId, ids]: groupInstances(METTALIC)) {
+            auto go = gameObjects[groupId];
+            auto renderSystem = new MetallicRenderSystem(groupId);
+            std::vector<MetallicSystemVertex> vertices;
+            for (auto v: go->vertices) {
+                MetallicSystemVertex vertex;
+                vertex.pos = v.pos;
+                vertex.normal = v.normal;
+                vertex.uv = v.uv;
+                vertex.tangent = v.tangent;
+                vertices.push_back(vertex);
             }
+            renderSystem->addVertices(vertices, go->indices);
+            renderSystem->setTextures(go->textures);
+            renderSystem->setInstanceCount(ids.size());
+            mettalicRenderSystems[groupId] = renderSystem;
         }
     }
 
 
     void localInit() override {
         setWorld();
+        gameObjects[followerId]->setDynamic(true);
+        buildBvh();
         setLight();
         skybox.setModel("assets/models/Sphere.obj", ModelType::OBJ);
 //        skybox.setCubeMapTexture({
@@ -132,7 +125,7 @@ public:
 //                                         "assets/textures/skybox/Citadella2/negz.jpg"
 //                                 });
         skybox.setBaseTexture("assets/textures/skybox/GLAST.0272.jpg");
-        skybox.init(BP, camera);
+        skybox.init(BP, &renderCamera);
         for (auto [id, s]: skins) {
             s->updateJointMatrices();
         }
@@ -141,30 +134,30 @@ public:
 
     bool pause = true;
 
-    void updateUniformBuffer(uint32_t currentImage, UserInput userInput)
-    override {
+    void simulate(const UserInput &userInput) override {
 
-        if (userInput.key == GLFW_KEY_B) {
+        if (userInput.keys.wasPressed(GLFW_KEY_B)) {
             this->sceneLoader.readJson();
             setWorld();
+            buildBvh();
             setCamera(userInput.aspectRatio);
             this->setLight();
             setGame();
             skins[pepsimanId]->setTranslation(glm::vec3(0.0f, 0.0f, 0.0f));
         }
-        if (userInput.key == GLFW_KEY_P) {
+        if (userInput.keys.wasPressed(GLFW_KEY_P)) {
             pause = false;
         }
-        if (userInput.key == GLFW_KEY_O) {
+        if (userInput.keys.wasPressed(GLFW_KEY_O)) {
             pause = true;
         }
 
 
         if (!pause) {
-            skins[pepsimanId]->move(glm::vec3(0, -gameConfig.heroSpeed, 0));
-            skins[pepsimanId]->update(BP->frameTime * gameConfig.heroAnimationSpeed, false);
-            gameObjects[followerId]->rotate(glm::vec3(0, 0, gameConfig.villainAnimationSpeed));
-            gameObjects[followerId]->move(glm::vec3(0, 0, gameConfig.villainSpeed));
+            skins[pepsimanId]->move(glm::vec3(0, -gameConfig.heroSpeed * userInput.deltaTime, 0));
+            skins[pepsimanId]->update(userInput.frameTime * gameConfig.heroAnimationSpeed, false);
+            gameObjects[followerId]->rotate(glm::vec3(0, 0, gameConfig.villainAnimationSpeed * userInput.deltaTime));
+            gameObjects[followerId]->move(glm::vec3(0, 0, gameConfig.villainSpeed * userInput.deltaTime));
 
         }
 
@@ -174,35 +167,36 @@ public:
         camera->lookAt(skins[pepsimanId]->getPosition());
         camera->updateWorld();
         camera->updateViewMatrix();
+    }
+
+    void render(uint32_t currentImage) override {
+        updateCulling();
         updateRenderSystems(currentImage);
         skybox.render(currentImage);
+        updateRenderQueue(currentImage);
     }
 
     void updateRenderSystems(uint32_t currentImage) {
         for (auto [id, system]: pepsimanRenderSystems) {
-            auto skin = skins[id];
-            auto jointMatrices = skin->getJointMatrices();
+            const SkinPose &pose = getSkinPose(id);
             PepsimanRenderSystemData data{};
-            data.model = skin->getModel();
-            for (auto [jointIndex, jointMatrix]: jointMatrices) {
-                data.jointTransformMatrices[jointIndex] = jointMatrix;
-            }
+            data.model = pose.model;
+            data.jointMatrices = &pose.joints;
             system->updateUniformBuffers(currentImage, data);
         }
 
         for (auto [id, system]: stationaryRenderSystems) {
-            auto go = gameObjects[id];
             system->updateUniformBuffers(currentImage, {
-                    go->getModel()
+                    getInstanceModels(id)
             });
         }
 
         for (auto [id, system]: mettalicRenderSystems) {
-            auto go = gameObjects[id];
             system->updateUniformBuffers(currentImage, {
-                    go->getModel()
+                    getInstanceModels(id)
             });
         }
+        gpuCulling.update(currentImage, renderCamera.getFrustumPlanes());
     }
 
     void pipelinesAndDescriptorSetsInit()
@@ -250,23 +244,32 @@ public:
         for (auto [id, system]: mettalicRenderSystems) {
             system->cleanup();
         }
+        gpuCulling.cleanup();
+        gpuSkinning.cleanup();
+        jointPalettes.cleanup();
+        textureTable.cleanup();
         skybox.localCleanup();
     }
 
-    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage)
-    override {
+    void submitDraws(RenderQueue &queue) override {
         for (auto [id, system]: pepsimanRenderSystems) {
-            system->populateCommandBuffer(commandBuffer, currentImage);
+            pushDraw(queue, system, PEPSIMAN, getDistance(getSkinPose(id).position));
         }
         for (auto [id, system]: stationaryRenderSystems) {
-            system->populateCommandBuffer(commandBuffer, currentImage);
+            if (isVisible(id)) {
+                pushDraw(queue, system, STATIONARY, getGroupDistance(id));
+            }
         }
 
         for (auto [id, system]: mettalicRenderSystems) {
-            system->populateCommandBuffer(commandBuffer, currentImage);
+            if (isVisible(id)) {
+                pushDraw(queue, system, METTALIC, getGroupDistance(id));
+            }
         }
 
-        skybox.populateCommandBuffer(commandBuffer, currentImage);
-
+        queue.push(RenderQueue::makeKey(PASS_SKYBOX, SKYBOX, 0, 0.0f), &skybox, "skybox",
+                   [this](VkCommandBuffer commandBuffer, int currentImage, BindState &state) {
+                       skybox.populateCommandBuffer(commandBuffer, currentImage, state);
+                   });
     }
 };
\ No newline at end of file
@@ -2,21 +2,73 @@
 
 #include <light-object.hpp>
 #include <render-system/render-system.hpp>
+#include "render-system/gpu-culling.hpp"
+#include "render-system/gpu-skinning.hpp"
+#include "render-system/render-queue.hpp"
+#include "render-system/texture-table.hpp"
+#include "culling/bvh.hpp"
+#include "culling/occlusion-culler.hpp"
+#include <unordered_set>
 #include "game-objects/game-object-base.hpp"
 #include "modules/Starter.hpp"
 #include "camera.hpp"
 #include "scene/scene-loader.hpp"
+#include "scene/simulation.hpp"
+#include <map>
+
+// Pose of a skinned character at the end of a simulation step
+struct SkinPose {
+    glm::mat4 model;
+    glm::vec3 position;
+    std::unordered_map<int, glm::mat4> joints;
+};
+
+// What the render thread reads of a simulation step, see SceneBase::publishSnapshot. Also holds
+// the state of the last two ticks it is blended from.
+struct RenderSnapshot {
+    Camera camera;
+    Light light;
+    // world matrices of the instanced game objects
+    std::unordered_map<std::string, glm::mat4> objectModels;
+    std::unordered_map<std::string, SkinPose> skins;
+    // bumped by buildBvh
+    uint32_t bvhVersion = 0;
+    // sample time of the input the step ran with, for the latency stats
+    std::chrono::steady_clock::time_point inputTime;
+};
 
 class SceneBase {
 public:
     BaseProject *BP;
     std::unordered_map<std::string, GameObjectBase *> gameObjects;
     std::unordered_map<std::string, GltfSkinBase *> skins;
+    // simulated camera and light, only touched by the simulation step
     Camera *camera;
     Light *light;
+    // camera and light of the snapshot being drawn, the render systems read these
+    Camera renderCamera;
+    Light renderLight;
     SceneLoader sceneLoader;
     std::string id;
     GameConfig gameConfig;
+    // render system id -> ids of the game objects it draws as instances
+    std::unordered_map<std::string, std::vector<std::string>> instanceGroups;
+    GpuCulling gpuCulling;
+    CullingStats cullingStats;
+    RenderQueue renderQueue;
+    TextureTable textureTable;
+    GpuSkinning gpuSkinning;
+    JointPalettes jointPalettes;
+    // skinned characters are skinned in a compute pre-pass instead of their vertex shader
+    bool gpuSkinningEnabled = true;
+    // opaque systems that support it lay down depth first, so their fragment shaders run about
+    // once per pixel. "depthPrePass" in the scene file, see setDepthPrePass.
+    bool depthPrePass = false;
+    // the simulation advances in ticks of this many seconds, whatever the frame rate
+    float tickTime = 1.0f / 60.0f;
+    // a step runs at most this many ticks, the rest of a long frame is dropped so that a slow
+    // frame does not make the next one slower
+    int maxTicksPerStep = 8;
 
 
     SceneBase(std::string pId, std::string worldFile) :
@@ -48,11 +100,66 @@ public:
         this->initRenderSystems();
         setGame();
         this->localInit();
+        captureState(previousTick);
+        publishSnapshot(1.0f, {});
+    }
+
+    void setTickRate(float ticksPerSecond) {
+        tickTime = 1.0f / ticksPerSecond;
+    }
+
+    // One simulation step: advances by userInput.frameTime in fixed ticks of input, animation,
+    // movement and camera, then publishes the state between the last two ticks. Runs on the
+    // simulation thread, the render thread keeps drawing the previous snapshot meanwhile.
+    // Returns the number of ticks run.
+    int step(const UserInput &userInput) {
+        tickAccumulator += userInput.frameTime;
+        int ticks = std::min((int) (tickAccumulator / tickTime), maxTicksPerStep);
+        UserInput tickInput = userInput;
+        tickInput.deltaTime = tickTime;
+        tickInput.frameTime = tickTime;
+        for (int i = 0; i < ticks; i++) {
+            if (i == ticks - 1) {
+                captureState(previousTick);
+            }
+            simulate(tickInput);
+            tickInput.keys.clearEdges();
+        }
+        tickAccumulator -= (float) ticks * tickTime;
+        if (tickAccumulator >= tickTime) {
+            tickAccumulator = std::fmod(tickAccumulator, tickTime);
+        }
+        publishSnapshot(tickAccumulator / tickTime, userInput.sampleTime);
+        return ticks;
+    }
+
+    // Switches the render thread to the newest published step, call before render
+    void acquireSnapshot() {
+        if (!snapshots.acquire()) {
+            return;
+        }
+        const RenderSnapshot &snapshot = snapshots.front();
+        renderCamera = snapshot.camera;
+        renderLight = snapshot.light;
+        if (snapshot.bvhVersion != builtBvhVersion) {
+            builtBvhVersion = snapshot.bvhVersion;
+            rebuildBvh();
+        }
+    }
+
+    // Sample time of the input the acquired snapshot shows
+    std::chrono::steady_clock::time_point getSnapshotInputTime() const {
+        return snapshots.front().inputTime;
+    }
+
+    const SkinPose &getSkinPose(const std::string &skinId) const {
+        return snapshots.front().skins.at(skinId);
     }
 
     void load(BaseProject *bp, float ar) {
         this->BP = bp;
         this->sceneLoader.readJson();
+        this->depthPrePass = sceneLoader.getJson().value("depthPrePass", depthPrePass);
         this->camera = new Camera();
         this->light = new Light();
         this->setCamera(ar);
@@ -86,7 +193,185 @@ public:
         setLight();
     }
 
-    virtual PoolSizes getPoolSizes() = 0;
+    // Groups the game objects of a render type that share model and material.
+    // Each group is keyed by the id of its first member, which also names its render system.
+    std::map<std::string, std::vector<std::string>> groupInstances(RenderType type) {
+        std::map<std::string, std::vector<std::string>> byKey;
+        for (auto [id, go]: gameObjects) {
+            if (go->renderType == type) {
+                byKey[go->getInstanceKey()].push_back(id);
+            }
+        }
+
+        std::map<std::string, std::vector<std::string>> groups;
+        for (auto &[key, ids]: byKey) {
+            std::sort(ids.begin(), ids.end());
+            groups[ids[0]] = ids;
+            instanceGroups[ids[0]] = ids;
+        }
+        return groups;
+    }
+
+    // World matrices of the members of an instance group in the snapshot being drawn
+    std::vector<glm::mat4> getInstanceModels(const std::string &groupId) {
+        const RenderSnapshot &snapshot = snapshots.front();
+        std::vector<glm::mat4> models;
+        for (const auto &id: instanceGroups.at(groupId)) {
+            models.push_back(snapshot.objectModels.at(id));
+        }
+        return models;
+    }
+
+    // Builds the culling BVH over the world bounds of every instanced game object, once the
+    // render thread draws this step. Must be called again when static objects are moved
+    // (e.g. after reloading the world).
+    void buildBvh() {
+        bvhVersion++;
+    }
+
+    // Adds software occlusion culling on top of the frustum test. The largest static objects,
+    // up to maxOccluders and triangleBudget triangles in total, are rasterized as occluders.
+    void enableOcclusionCulling(int maxOccluders, size_t triangleBudget) {
+        occlusionEnabled = true;
+        occluderCount = maxOccluders;
+        occluderTriangleBudget = triangleBudget;
+        if (cullingEnabled) {
+            setOccluders();
+        }
+    }
+
+    // Refits moving objects and collects the visible instance groups. Command buffers are
+    // re-recorded only when the visible set changes.
+    void updateCulling() {
+        beginCulling();
+        endCulling();
+    }
+
+    // Runs the frustum test and starts the occlusion test on its worker thread. Render work that
+    // does not depend on the visible set (e.g. uniform buffer writes) can run before endCulling().
+    void beginCulling() {
+        if (!cullingEnabled) {
+            return;
+        }
+        for (int item: dynamicItems) {
+            bvh.refit(item, getWorldBounds(bvhItems[item]));
+        }
+
+        Frustum frustum{};
+        frustum.setPlanes(renderCamera.getFrustumPlanes());
+        frustumVisibleItems.clear();
+        bvh.query(frustum, [&](int item) {
+            frustumVisibleItems.push_back(item);
+        }, cullingStats);
+
+        if (occlusionEnabled) {
+            std::vector<AABB> boxes;
+            boxes.reserve(frustumVisibleItems.size());
+            for (int item: frustumVisibleItems) {
+                boxes.push_back(getWorldBounds(bvhItems[item]));
+            }
+            occlusionCuller.submit(renderCamera.matrices.perspective * renderCamera.matrices.view, std::move(boxes));
+            occlusionPending = true;
+        }
+    }
+
+    void endCulling() {
+        if (!cullingEnabled) {
+            return;
+        }
+        std::unordered_set<std::string> visible;
+        if (occlusionPending) {
+            const std::vector<bool> &occluded = occlusionCuller.wait();
+            occlusionPending = false;
+            for (size_t i = 0; i < frustumVisibleItems.size(); i++) {
+                if (occluded[i]) {
+                    // counted as visible by the frustum test
+                    cullingStats.visible--;
+                    cullingStats.occluded++;
+                } else {
+                    visible.insert(instanceGroupOf[bvhItems[frustumVisibleItems[i]]]);
+                }
+            }
+        } else {
+            for (int item: frustumVisibleItems) {
+                visible.insert(instanceGroupOf[bvhItems[item]]);
+            }
+        }
+
+        if (visible != visibleGroups) {
+            visibleGroups.swap(visible);
+            BP->invalidateCommandBuffers();
+        }
+    }
+
+    bool isVisible(const std::string &groupId) {
+        return !cullingEnabled || visibleGroups.count(groupId) > 0;
+    }
+
+    // Collects and sorts the draws of the frame. Command buffers are re-recorded only when the
+    // sorted order changes, so call it every frame after the camera update.
+    void updateRenderQueue(uint32_t currentImage) {
+        renderQueue.clear();
+        submitDraws(renderQueue);
+        if (textureTable.isInitialized()) {
+            textureTable.updateStreaming();
+            textureTable.update(currentImage);
+        }
+        if (renderQueue.sort()) {
+            BP->invalidateCommandBuffers();
+        }
+    }
+
+    // The pipelines are rebuilt for the new setting after the current frame
+    void setDepthPrePass(bool enabled) {
+        if (depthPrePass != enabled) {
+            depthPrePass = enabled;
+            BP->RebuildPipeline();
+        }
+    }
+
+    // Opaque draw of a render system, keyed by pipeline, material and camera distance. Systems with
+    // a depth pre-pass also get a depth-only draw, front to back before every opaque draw. The
+    // distance also decides which texture mips the system streams in.
+    template<typename TSystem>
+    void pushDraw(RenderQueue &queue, TSystem *system, RenderType pipeline, float distance) {
+        system->requestTextureMips(distance);
+        if (system->isDepthPrePassActive()) {
+            queue.push(RenderQueue::makeKey(PASS_DEPTH, pipeline, 0, distance), system, system->getId() + " depth",
+                       [system](VkCommandBuffer commandBuffer, int currentImage, BindState &state) {
+                           system->populateDepthCommandBuffer(commandBuffer, currentImage, state);
+                       });
+        }
+        uint64_t key = RenderQueue::makeKey(PASS_OPAQUE, pipeline, queue.getMaterialId(system->getMaterialKey()),
+                                            distance);
+        queue.push(key, system, system->getId(),
+                   [system](VkCommandBuffer commandBuffer, int currentImage, BindState &state) {
+                       system->populateCommandBuffer(commandBuffer, currentImage, state);
+        });
+    }
+
+    // Hands the scene's depthPrePass flag to its systems, call before their init
+    template<typename TRenderSystem>
+    void enableDepthPrePass(std::unordered_map<std::string, TRenderSystem *> &systems) {
+        for (auto [id, system]: systems) {
+            system->setDepthPrePass(&depthPrePass);
+        }
+    }
+
+    // Distance from the camera to the nearest member of an instance group
+    float getGroupDistance(const std::string &groupId) {
+        float distance = FLT_MAX;
+        for (const auto &id: instanceGroups.at(groupId)) {
+            AABB bounds = getWorldBounds(id);
+            glm::vec3 closest = glm::clamp(renderCamera.CamPosition, bounds.min, bounds.max);
+            distance = std::min(distance, glm::length(renderCamera.CamPosition - closest));
+        }
+        return distance;
+    }
+
+    float getDistance(const glm::vec3 &position) {
+        return glm::length(renderCamera.CamPosition - position);
+    }
 
     virtual void localInit() = 0;
 
@@ -94,7 +379,16 @@ public:
 
     virtual void createRenderSystems() = 0;
 
-    virtual void updateUniformBuffer(uint32_t currentImage, UserInput userInput) = 0;
+    // advances the simulated state by one tick of userInput.deltaTime seconds, see step
+    virtual void simulate(const UserInput &userInput) = 0;
+
+    // writes the uniform buffers and collects the draws of the acquired snapshot
+    virtual void render(uint32_t currentImage) = 0;
+
+    // applied to the models of the instanced game objects
+    virtual glm::mat4 getWorldMatrix() {
+        return glm::mat4(1.0f);
+    }
 
     virtual void pipelinesAndDescriptorSetsInit() = 0;
 
@@ -102,6 +396,196 @@ public:
 
     virtual void localCleanup() = 0;
 
-    virtual void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) = 0;
+    // recorded before the render pass begins
+    void populateComputeCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) {
+        BP->beginGpuScope(commandBuffer, currentImage, "culling");
+        gpuCulling.populateCommandBuffer(commandBuffer, currentImage, [this](const std::string &groupId) {
+            return isVisible(groupId);
+        });
+        BP->endGpuScope(commandBuffer, currentImage);
+        BP->beginGpuScope(commandBuffer, currentImage, "skinning");
+        gpuSkinning.populateCommandBuffer(commandBuffer, currentImage);
+        BP->endGpuScope(commandBuffer, currentImage);
+    }
+
+    // One palette buffer for the joints of all the given systems, each keyed by the id of its
+    // skin. Call before enableGpuSkinning and their init.
+    template<typename TRenderSystem>
+    void enableJointPalettes(std::unordered_map<std::string, TRenderSystem *> &systems) {
+        if (systems.empty()) {
+            return;
+        }
+        uint32_t capacity = 0;
+        for (auto [id, system]: systems) {
+            capacity += skins[id]->getPaletteSize();
+        }
+        jointPalettes.init(BP, capacity);
+        for (auto [id, system]: systems) {
+            system->setJointPalettes(&jointPalettes, skins[id]->getPaletteSize());
+        }
+    }
 
+    // One skinning pass for all the given systems, call before their init
+    template<typename TRenderSystem>
+    void enableGpuSkinning(std::unordered_map<std::string, TRenderSystem *> &systems) {
+        if (!gpuSkinningEnabled || systems.empty()) {
+            return;
+        }
+        gpuSkinning.init(BP, systems.size());
+        for (auto [id, system]: systems) {
+            system->setGpuSkinning(&gpuSkinning);
+        }
+    }
+
+    // The swap chain can be recreated with another number of images, the per image joint
+    // palettes and skinning outputs follow it. Call before pipelinesAndDescriptorSetsInit.
+    void resizeSkinning() {
+        if (jointPalettes.resize()) {
+            gpuSkinning.resize(&jointPalettes);
+        }
+    }
+
+    // adds the draws of the frame to the queue, see pushDraw
+    virtual void submitDraws(RenderQueue &queue) = 0;
+
+    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) {
+        renderQueue.record(commandBuffer, currentImage, BP);
+    }
+
+private:
+    TripleBuffer<RenderSnapshot> snapshots;
+    // simulated time not run as a tick yet
+    float tickAccumulator = 0.0f;
+    // state before and after the last tick
+    RenderSnapshot previousTick;
+    RenderSnapshot currentTick;
+    // simulation side, published with each snapshot
+    uint32_t bvhVersion = 0;
+    // render side, the version the BVH was built for
+    uint32_t builtBvhVersion = 0;
+
+    Bvh bvh;
+    bool cullingEnabled = false;
+    // BVH item -> game object id
+    std::vector<std::string> bvhItems;
+    std::vector<int> dynamicItems;
+    std::unordered_map<std::string, std::string> instanceGroupOf;
+    std::unordered_set<std::string> visibleGroups;
+    std::vector<int> frustumVisibleItems;
+
+    OcclusionCuller occlusionCuller;
+    bool occlusionEnabled = false;
+    bool occlusionPending = false;
+    int occluderCount = 0;
+    size_t occluderTriangleBudget = 0;
+
+    // Copies what the render thread reads of the simulated state
+    void captureState(RenderSnapshot &state) {
+        state.camera = *camera;
+        state.light = *light;
+        glm::mat4 world = getWorldMatrix();
+        for (const auto &[groupId, ids]: instanceGroups) {
+            for (const auto &id: ids) {
+                state.objectModels[id] = world * gameObjects.at(id)->getModel();
+            }
+        }
+        for (auto [id, skin]: skins) {
+            SkinPose &pose = state.skins[id];
+            pose.model = skin->getModel();
+            pose.position = skin->getPosition();
+            pose.joints = skin->getJointMatrices();
+        }
+        state.bvhVersion = bvhVersion;
+    }
+
+    // Publishes the state alpha of the way from the previous tick to the current one, called at
+    // the end of each step
+    void publishSnapshot(float alpha, std::chrono::steady_clock::time_point inputTime) {
+        captureState(currentTick);
+        // a reloaded world is not blended with the old one
+        if (previousTick.bvhVersion != currentTick.bvhVersion) {
+            alpha = 1.0f;
+        }
+        RenderSnapshot &snapshot = snapshots.back();
+        snapshot.camera = currentTick.camera;
+        snapshot.camera.CamPosition = glm::mix(previousTick.camera.CamPosition, currentTick.camera.CamPosition, alpha);
+        snapshot.camera.CamTarget = glm::mix(previousTick.camera.CamTarget, currentTick.camera.CamTarget, alpha);
+        snapshot.camera.updateWorld();
+        snapshot.camera.updateViewMatrix();
+        snapshot.light = currentTick.light;
+        for (const auto &[id, model]: currentTick.objectModels) {
+            snapshot.objectModels[id] = mixTransform(previousTick.objectModels.at(id), model, alpha);
+        }
+        for (const auto &[id, current]: currentTick.skins) {
+            const SkinPose &previous = previousTick.skins.at(id);
+            SkinPose &pose = snapshot.skins[id];
+            pose.model = mixTransform(previous.model, current.model, alpha);
+            pose.position = glm::mix(previous.position, current.position, alpha);
+            for (const auto &[index, joint]: current.joints) {
+                auto it = previous.joints.find(index);
+                pose.joints[index] = it == previous.joints.end() ? joint : mixTransform(it->second, joint, alpha);
+            }
+        }
+        snapshot.bvhVersion = currentTick.bvhVersion;
+        snapshot.inputTime = inputTime;
+        snapshots.publish();
+    }
+
+    void rebuildBvh() {
+        bvhItems.clear();
+        dynamicItems.clear();
+        instanceGroupOf.clear();
+        std::vector<AABB> bounds;
+        for (auto &[groupId, ids]: instanceGroups) {
+            for (const auto &id: ids) {
+                if (gameObjects.at(id)->isDynamic()) {
+                    dynamicItems.push_back((int) bvhItems.size());
+                }
+                instanceGroupOf[id] = groupId;
+                bvhItems.push_back(id);
+                bounds.push_back(getWorldBounds(id));
+            }
+        }
+        bvh.build(bounds);
+        cullingEnabled = true;
+        if (occlusionEnabled) {
+            setOccluders();
+        }
+    }
+
+    AABB getWorldBounds(const std::string &id) {
+        return gameObjects.at(id)->getBounds().transform(snapshots.front().objectModels.at(id));
+    }
+
+    void setOccluders() {
+        // (volume, id) of the static objects, largest first
+        std::vector<std::pair<float, std::string>> candidates;
+        for (const auto &id: bvhItems) {
+            if (!gameObjects.at(id)->isDynamic() && !gameObjects.at(id)->indices.empty()) {
+                AABB bounds = getWorldBounds(id);
+                glm::vec3 size = bounds.max - bounds.min;
+                candidates.emplace_back(size.x * size.y * size.z, id);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), std::greater<>());
+
+        std::vector<glm::vec3> triangles;
+        int occluders = 0;
+        for (const auto &[volume, id]: candidates) {
+            if (occluders >= occluderCount) {
+                break;
+            }
+            auto go = gameObjects.at(id);
+            // meshes too detailed for the remaining budget are skipped, smaller ones may still fit
+            if (triangles.size() / 3 + go->indices.size() / 3 > occluderTriangleBudget) {
+                continue;
+            }
+            glm::mat4 m = snapshots.front().objectModels.at(id);
+            for (uint32_t index: go->indices) {
+                triangles.push_back(glm::vec3(m * glm::vec4(go->vertices[index].pos, 1.0f)));
+            }
+            occluders++;
+        }
+        occlusionCuller.setOccluders(std::move(triangles));
+    }
 };
@@ -58,6 +58,7 @@ public:
                 std::cout << "Loading game object: " << it.key() << std::endl;
                 gameObjectsMap[it.key()] = loadGameObject(it.key(), it.value());
             }
+            loadedModels.clear();
             return gameObjectsMap;
         } else {
             return {};
@@ -103,17 +104,22 @@ public:
         for (auto &t: textureInfo) {
             gameObject->addTexture(t.first, t.second);
         }
-        GameObjectLoader::GameObjectLoaderResult result{};
-        if (modelType == "gltf") {
-            result = GameObjectLoader::loadGltf(modelPath);
-        } else if (modelType == "obj") {
-            result = GameObjectLoader::loadModelOBJ(modelPath);
-        } else {
-            throw std::runtime_error("Model type not supported ");
+        // objects referencing the same model file are parsed once
+        if (loadedModels.find(modelPath) == loadedModels.end()) {
+            if (modelType == "gltf") {
+                loadedModels[modelPath] = GameObjectLoader::loadGltf(modelPath);
+            } else if (modelType == "obj") {
+                loadedModels[modelPath] = GameObjectLoader::loadModelOBJ(modelPath);
+            } else {
+                throw std::runtime_error("Model type not supported ");
+            }
         }
+        const GameObjectLoader::GameObjectLoaderResult &result = loadedModels[modelPath];
 
+        gameObject->setModelPath(modelPath);
         gameObject->setVertices(result.vertices);
         gameObject->setIndices(result.indices);
+        gameObject->setBounds(result.bounds);
         gameObject->setRenderType(renderTypes[renderType]);
         return gameObject;
     }
@@ -297,4 +303,5 @@ public:
 private :
     nlohmann::json jsonData;
     std::string filename;
+    std::unordered_map<std::string, GameObjectLoader::GameObjectLoaderResult> loadedModels;
 };
\ No newline at end of file
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <utility>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Blends two affine transforms, the rotation by slerp so a turning object does not shrink halfway.
+// Mirrored or degenerate transforms are blended per component.
+inline glm::mat4 mixTransform(const glm::mat4 &a, const glm::mat4 &b, float t) {
+    if (a == b) {
+        return a;
+    }
+    glm::vec3 scaleA(glm::length(glm::vec3(a[0])), glm::length(glm::vec3(a[1])), glm::length(glm::vec3(a[2])));
+    glm::vec3 scaleB(glm::length(glm::vec3(b[0])), glm::length(glm::vec3(b[1])), glm::length(glm::vec3(b[2])));
+    const float EPSILON = 1e-6f;
+    if (glm::min(glm::min(scaleA.x, scaleA.y), scaleA.z) < EPSILON ||
+        glm::min(glm::min(scaleB.x, scaleB.y), scaleB.z) < EPSILON) {
+        return a + (b - a) * t;
+    }
+    glm::mat3 rotationA(glm::vec3(a[0]) / scaleA.x, glm::vec3(a[1]) / scaleA.y, glm::vec3(a[2]) / scaleA.z);
+    glm::mat3 rotationB(glm::vec3(b[0]) / scaleB.x, glm::vec3(b[1]) / scaleB.y, glm::vec3(b[2]) / scaleB.z);
+    if (glm::determinant(rotationA) < 0.0f || glm::determinant(rotationB) < 0.0f) {
+        return a + (b - a) * t;
+    }
+    glm::mat4 m = glm::mat4_cast(glm::slerp(glm::quat_cast(rotationA), glm::quat_cast(rotationB), t));
+    glm::vec3 scale = glm::mix(scaleA, scaleB, t);
+    m[0] *= scale.x;
+    m[1] *= scale.y;
+    m[2] *= scale.z;
+    m[3] = glm::mix(a[3], b[3], t);
+    return m;
+}
+
+/**
+ * Three copies of a value handed from one producer thread to one consumer thread. The producer
+ * fills back() and publish()es it, the consumer acquire()s the newest published copy and reads it
+ * through front() until its next acquire. Neither side ever waits for the other to be done with
+ * its copy.
+ */
+template<typename T>
+class TripleBuffer {
+public:
+    T &back() {
+        return slots[backSlot];
+    }
+
+    void publish() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(backSlot, readySlot);
+        fresh = true;
+    }
+
+    // False when nothing was published since the last acquire, front() is unchanged then
+    bool acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!fresh) {
+            return false;
+        }
+        std::swap(frontSlot, readySlot);
+        fresh = false;
+        return true;
+    }
+
+    const T &front() const {
+        return slots[frontSlot];
+    }
+
+private:
+    std::array<T, 3> slots{};
+    int frontSlot = 0;
+    int readySlot = 1;
+    int backSlot = 2;
+    bool fresh = false;
+    std::mutex mutex;
+};
+
+/**
+ * Runs simulation steps one at a time on a worker thread, started with the first submit(). The
+ * caller goes on with its own work and calls wait() before it touches the simulated state again.
+ */
+class SimulationThread {
+public:
+    ~SimulationThread() {
+        if (!worker.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        jobReady.notify_one();
+        worker.join();
+    }
+
+    // Waits for the previous step first
+    void submit(std::function<void()> step) {
+        wait();
+        if (!worker.joinable()) {
+            worker = std::thread([this]() { run(); });
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = std::move(step);
+            pending = true;
+        }
+        jobReady.notify_one();
+    }
+
+    // Blocks until the submitted step is done, rethrowing what it threw
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobDone.wait(lock, [this]() { return !pending; });
+        if (error) {
+            std::exception_ptr failure = error;
+            error = nullptr;
+            std::rethrow_exception(failure);
+        }
+    }
+
+private:
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    std::function<void()> job;
+    std::exception_ptr error;
+    bool pending = false;
+    bool quit = false;
+
+    void run() {
+        while (true) {
+            std::function<void()> step;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobReady.wait(lock, [this]() { return pending || quit; });
+                if (quit) {
+                    return;
+                }
+                step = std::move(job);
+            }
+            std::exception_ptr failure;
+            try {
+                step();
+            } catch (...) {
+                failure = std::current_exception();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                error = failure;
+                pending = false;
+            }
+            jobDone.notify_all();
+        }
+    }
+};
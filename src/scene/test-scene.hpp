@@ -15,48 +15,43 @@ public:
     std::unordered_map<std::string, StationaryRenderSystem *> stationaryRenderSystems;
     std::unordered_map<std::string, AnimatedSkinRenderSystem *> animatedSkinRenderSystems;
 
-    PoolSizes getPoolSizes() override {
-        PoolSizes poolSizes;
-        for (auto [id, system]: stationaryRenderSystems) {
-            poolSizes.uniformBlocksInPool += system->getPoolSizes().uniformBlocksInPool;
-            poolSizes.texturesInPool += system->getPoolSizes().texturesInPool;
-            poolSizes.setsInPool += system->getPoolSizes().setsInPool;
-        }
-        for (auto [id, system]: animatedSkinRenderSystems) {
-            poolSizes.uniformBlocksInPool += system->getPoolSizes().uniformBlocksInPool;
-            poolSizes.texturesInPool += system->getPoolSizes().texturesInPool;
-            poolSizes.setsInPool += system->getPoolSizes().setsInPool;
-        }
-        return poolSizes;
-    }
-
     void initRenderSystems() override {
+        textureTable.init(BP);
+        enableDepthPrePass(stationaryRenderSystems);
+        enableDepthPrePass(animatedSkinRenderSystems);
+        gpuCulling.init(BP, stationaryRenderSystems.size());
         for (auto [id, system]: stationaryRenderSystems) {
-            system->init(BP, camera, light);
+            system->setTextureTable(&textureTable);
+            system->setGpuCulling(&gpuCulling);
+            system->init(BP, &renderCamera, &renderLight);
         }
+        gpuCulling.createBuffers();
+        enableJointPalettes(animatedSkinRenderSystems);
+        enableGpuSkinning(animatedSkinRenderSystems);
         for (auto [id, system]: animatedSkinRenderSystems) {
-            system->init(BP, camera, light);
+            system->init(BP, &renderCamera, &renderLight);
         }
+
+        textureTable.loadResident();
     }
 
     void createRenderSystems() override {
-        for (auto [id, go]: gameObjects) {
-            if (go->renderType == STATIONARY) {
-                auto renderSystem = new StationaryRenderSystem(id);
-                std::vector<StationarySystemVertex> vertices;
-
-                for (auto v: go->vertices) {
-                    StationarySystemVertex vertex;
-                    vertex.pos = v.pos;
-                    vertex.normal = v.normal;
-                    vertex.uv = v.uv;
-                    vertices.push_back(vertex);
-                }
-                renderSystem->addVertices(vertices, go->indices);
-                renderSystem->setTextures(go->textures);
-                stationaryRenderSystems[id] = renderSystem;
+        for (auto &[groupId, ids]: groupInstances(STATIONARY)) {
+            auto go = gameObjects[groupId];
+            auto renderSystem = new StationaryRenderSystem(groupId);
+            std::vector<StationarySystemVertex> vertices;
+
+            for (auto v: go->vertices) {
+                StationarySystemVertex vertex;
+                vertex.pos = v.pos;
+                vertex.normal = v.normal;
+                vertex.uv = v.uv;
+                vertices.push_back(vertex);
             }
-
+            renderSystem->addVertices(vertices, go->indices);
+            renderSystem->setTextures(go->textures);
+            renderSystem->setInstanceCount(ids.size());
+            stationaryRenderSystems[groupId] = renderSystem;
         }
 
         for (const auto &[id, skin]: skins) {
@@ -89,12 +84,12 @@ public:
 
     }
 
-    void updateUniformBuffer(uint32_t currentImage, UserInput userInput) override {
+    void simulate(const UserInput &userInput) override {
         for (auto [id, s]: skins) {
-            s->update(BP->frameTime, false);
+            s->update(userInput.frameTime, false);
         }
 
-        if (userInput.key == GLFW_KEY_B) {
+        if (userInput.keys.wasPressed(GLFW_KEY_B)) {
             this->sceneLoader.readJson();
             setWorld();
             this->setLight();
@@ -104,28 +99,29 @@ public:
         camera->lookAt(skins["luna"]->getPosition());
         camera->updateWorld();
         camera->updateViewMatrix();
+    }
 
+    void render(uint32_t currentImage) override {
         updateRenderSystems(currentImage);
+        updateRenderQueue(currentImage);
     }
 
     void updateRenderSystems(uint32_t currentImage) {
 
         for (auto [id, system]: stationaryRenderSystems) {
-            auto go = gameObjects[id];
-            system->updateUniformBuffers(currentImage, {
-                    go->getModel() * camera->matrices.world
-            });
+            std::vector<glm::mat4> models = getInstanceModels(id);
+            for (auto &model: models) {
+                model = model * renderCamera.matrices.world;
+            }
+            system->updateUniformBuffers(currentImage, {models});
         }
+        gpuCulling.update(currentImage, renderCamera.getFrustumPlanes());
 
         for (auto [id, system]: animatedSkinRenderSystems) {
-            auto skin = skins[id];
-            auto jointMatrices = skin->getJointMatrices();
-
+            const SkinPose &pose = getSkinPose(id);
             AnimatedSkinRenderSystemData data{};
-            data.model = skin->getModel();
-            for (auto [jointIndex, jointMatrix]: jointMatrices) {
-                data.jointTransformMatrices[jointIndex] = jointMatrix;
-            }
+            data.model = pose.model;
+            data.jointMatrices = &pose.joints;
             system->updateUniformBuffers(currentImage, data);
         }
 
@@ -158,20 +154,26 @@ public:
         for (auto [id, system]: stationaryRenderSystems) {
             system->cleanup();
         }
+        gpuCulling.cleanup();
+        textureTable.cleanup();
 
         for (auto [id, system]: animatedSkinRenderSystems) {
             system->cleanup();
         }
+        gpuSkinning.cleanup();
+        jointPalettes.cleanup();
     }
 
-    void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) override {
+    void submitDraws(RenderQueue &queue) override {
         for (auto [id, system]: stationaryRenderSystems) {
-            system->populateCommandBuffer(commandBuffer, currentImage);
+            if (isVisible(id)) {
+                pushDraw(queue, system, STATIONARY, getGroupDistance(id));
+            }
         }
 
 
         for (auto [id, system]: animatedSkinRenderSystems) {
-            system->populateCommandBuffer(commandBuffer, currentImage);
+            pushDraw(queue, system, ANIMATED_SKIN, getDistance(getSkinPose(id).position));
         }
     }
 };
\ No newline at end of file